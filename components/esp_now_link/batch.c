@@ -0,0 +1,60 @@
+/**
+ * batch.c
+ *
+ * Building and splitting of FRAME_TYPE_BATCH frames (see batch.h).
+ */
+
+#include <string.h>
+#include "batch.h"
+
+void batch_begin(batch_t *batch, uint8_t *buf)
+{
+    batch->buf = buf;
+    batch->len = FRAME_HEADER_LEN;
+    batch->count = 0;
+}
+
+bool batch_add(batch_t *batch, uint8_t type, const void *payload, int len)
+{
+    if (len < 0 || len > BATCH_MAX_RECORD_LEN || batch->len + BATCH_RECORD_OVERHEAD + len > FRAME_MAX_PLAIN_LEN) {
+        return false;
+    }
+    uint8_t *record = batch->buf + batch->len;
+    record[0] = type;
+    record[1] = (uint8_t)len;
+    if (len > 0) {
+        memcpy(record + BATCH_RECORD_OVERHEAD, payload, len);
+    }
+    batch->len += BATCH_RECORD_OVERHEAD + len;
+    batch->count++;
+    return true;
+}
+
+int batch_finish(batch_t *batch, uint16_t seq)
+{
+    uint8_t *payload = batch->buf + FRAME_HEADER_LEN;
+    if (batch->count == 1) {
+        uint8_t type = payload[0];
+        int len = payload[1];
+        memmove(payload, payload + BATCH_RECORD_OVERHEAD, len);
+        return frame_write_header(batch->buf, type, 0, seq, len);
+    }
+    return frame_write_header(batch->buf, FRAME_TYPE_BATCH, 0, seq, batch->len - FRAME_HEADER_LEN);
+}
+
+bool batch_split(const uint8_t *payload, int len, batch_record_cb_t cb, void *ctx)
+{
+    // Validate the whole batch first so a truncated frame delivers nothing.
+    int offset = 0;
+    while (offset < len) {
+        if (offset + BATCH_RECORD_OVERHEAD > len || offset + BATCH_RECORD_OVERHEAD + payload[offset + 1] > len) {
+            return false;
+        }
+        offset += BATCH_RECORD_OVERHEAD + payload[offset + 1];
+    }
+
+    for (offset = 0; offset < len; offset += BATCH_RECORD_OVERHEAD + payload[offset + 1]) {
+        cb(payload[offset], payload + offset + BATCH_RECORD_OVERHEAD, payload[offset + 1], ctx);
+    }
+    return true;
+}
@@ -0,0 +1,38 @@
+/**
+ * batch.h
+ *
+ * Coalescing of small messages into a single FRAME_TYPE_BATCH frame. Each record
+ * in the batch payload is a type byte, a length byte and the message payload.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "frame.h"
+
+#define BATCH_RECORD_OVERHEAD 2
+#define BATCH_MAX_RECORD_LEN (FRAME_MAX_PAYLOAD_LEN - BATCH_RECORD_OVERHEAD)
+
+typedef struct {
+    uint8_t *buf;                   // FRAME_MAX_LEN bytes owned by the caller
+    int len;                        // Bytes used, including room for the frame header
+    int count;                      // Records added so far
+} batch_t;
+
+typedef void (*batch_record_cb_t)(uint8_t type, const uint8_t *payload, int len, void *ctx);
+
+/** Starts an empty batch that is built in place in buf. */
+void batch_begin(batch_t *batch, uint8_t *buf);
+
+/** Appends a record. Returns false, leaving the batch untouched, if it does not fit. */
+bool batch_add(batch_t *batch, uint8_t type, const void *payload, int len);
+
+/**
+ * Writes the frame header and returns the frame length. A batch holding a single
+ * record is turned into a plain frame of that record's type to save the record overhead.
+ */
+int batch_finish(batch_t *batch, uint16_t seq);
+
+/** Calls cb for every record of a FRAME_TYPE_BATCH payload. Returns false if it is malformed. */
+bool batch_split(const uint8_t *payload, int len, batch_record_cb_t cb, void *ctx);
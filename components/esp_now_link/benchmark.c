@@ -0,0 +1,343 @@
+/**
+ * benchmark.c
+ *
+ * Throughput and latency benchmark for the ESP-NOW link (see benchmark.h).
+ * Every result is printed on one line as "BENCH,<test>,key=value,..." so runs
+ * can be collected from the console with a simple grep.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "benchmark.h"
+#include "frame.h"
+#include "esp_now_link_priv.h"
+#include "link_crypto.h"
+
+static const char *TAG = "BENCH";
+
+#define BENCH_MIN_FRAME_LEN (FRAME_HEADER_LEN + (int)sizeof(bench_msg_t))
+#define BENCH_EVENT_QUEUE_LEN 16
+#define BENCH_REPORT_TIMEOUT_MS 1000
+#define BENCH_END_ATTEMPTS 3
+#define BENCH_DRAIN_DELAY_MS 50     // Lets in-flight retransmissions land before FLOOD_END
+#define BENCH_CRYPTO_ROUNDS 500
+// Sealed frames lose FRAME_CRYPTO_OVERHEAD bytes to the counter and tag.
+#define BENCH_FRAME_LEN (CONFIG_BENCHMARK_FRAME_LEN < FRAME_MAX_PLAIN_LEN ? CONFIG_BENCHMARK_FRAME_LEN : FRAME_MAX_PLAIN_LEN)
+
+// Leading bytes of every PING, PONG and FLOOD payload; the rest is padding.
+typedef struct __attribute__((packed)) {
+    uint32_t test_id;
+    uint32_t index;
+} bench_msg_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t test_id;
+    uint32_t sent;
+} bench_flood_end_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t test_id;
+    uint32_t received;
+    uint32_t bytes;                 // Frame bytes, headers included
+    uint32_t duration_us;           // First to last flood frame, responder clock
+} bench_report_t;
+
+typedef struct {
+    uint8_t type;
+    int64_t rx_us;
+    union {
+        bench_msg_t msg;
+        bench_report_t report;
+    };
+} bench_event_t;
+
+// Replies for the initiator; stays NULL on nodes that only respond.
+static QueueHandle_t bench_events;
+
+// Responder side flood accounting, only touched from the RX worker.
+static struct {
+    uint32_t test_id;
+    uint32_t received;
+    uint32_t bytes;
+    int64_t first_us;
+    int64_t last_us;
+} flood_rx;
+
+void benchmark_handle_rx(const uint8_t *src_mac, uint8_t type, const uint8_t *payload, int len)
+{
+    int64_t now_us = esp_timer_get_time();
+
+    switch (type) {
+    case FRAME_TYPE_BENCH_PING:
+        send_message(src_mac, FRAME_TYPE_BENCH_PONG, payload, len, TX_MSG_FLAG_FLUSH);
+        break;
+    case FRAME_TYPE_BENCH_FLOOD: {
+        bench_msg_t msg;
+        if (len < (int)sizeof(msg)) {
+            break;
+        }
+        memcpy(&msg, payload, sizeof(msg));
+        if (msg.test_id != flood_rx.test_id) {
+            memset(&flood_rx, 0, sizeof(flood_rx));
+            flood_rx.test_id = msg.test_id;
+            flood_rx.first_us = now_us;
+        }
+        flood_rx.received++;
+        flood_rx.bytes += FRAME_HEADER_LEN + len;
+        flood_rx.last_us = now_us;
+        break;
+    }
+    case FRAME_TYPE_BENCH_FLOOD_END: {
+        bench_flood_end_t end;
+        if (len != (int)sizeof(end)) {
+            break;
+        }
+        memcpy(&end, payload, sizeof(end));
+        bench_report_t report = { .test_id = end.test_id };
+        if (flood_rx.test_id == end.test_id) {
+            report.received = flood_rx.received;
+            report.bytes = flood_rx.bytes;
+            report.duration_us = (uint32_t)(flood_rx.last_us - flood_rx.first_us);
+        }
+        send_message(src_mac, FRAME_TYPE_BENCH_REPORT, &report, sizeof(report), TX_MSG_FLAG_FLUSH);
+        break;
+    }
+    case FRAME_TYPE_BENCH_PONG:
+    case FRAME_TYPE_BENCH_REPORT: {
+        if (bench_events == NULL) {
+            break;
+        }
+        bench_event_t event = { .type = type, .rx_us = now_us };
+        if (type == FRAME_TYPE_BENCH_PONG && len >= (int)sizeof(event.msg)) {
+            memcpy(&event.msg, payload, sizeof(event.msg));
+        } else if (type == FRAME_TYPE_BENCH_REPORT && len == (int)sizeof(event.report)) {
+            memcpy(&event.report, payload, sizeof(event.report));
+        } else {
+            break;
+        }
+        xQueueSend(bench_events, &event, 0);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+#if CONFIG_BENCHMARK_MODE && CONFIG_BENCHMARK_ROLE_INITIATOR
+
+static uint32_t next_test_id;
+static uint8_t tx_payload[FRAME_MAX_PAYLOAD_LEN];
+static uint32_t rtt_samples[CONFIG_BENCHMARK_PING_COUNT];
+
+static bool wait_event(bench_event_t *event, int64_t deadline_us)
+{
+    int64_t remaining_us = deadline_us - esp_timer_get_time();
+    if (remaining_us <= 0) {
+        return xQueueReceive(bench_events, event, 0) == pdTRUE;
+    }
+    TickType_t wait = pdMS_TO_TICKS((remaining_us + 999) / 1000);
+    return xQueueReceive(bench_events, event, wait > 0 ? wait : 1) == pdTRUE;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of a sorted array.
+static uint32_t percentile(const uint32_t *sorted, int count, int pct)
+{
+    int rank = (pct * count + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static void run_ping(const uint8_t *peer_mac, int frame_len)
+{
+    uint32_t test_id = next_test_id++;
+    int payload_len = frame_len - FRAME_HEADER_LEN;
+    int received = 0;
+    uint64_t total_us = 0;
+
+    xQueueReset(bench_events);
+    for (int i = 0; i < CONFIG_BENCHMARK_PING_COUNT; i++) {
+        bench_msg_t msg = { .test_id = test_id, .index = i };
+        memcpy(tx_payload, &msg, sizeof(msg));
+
+        int64_t sent_us = esp_timer_get_time();
+        int64_t deadline_us = sent_us + CONFIG_BENCHMARK_PING_TIMEOUT_MS * 1000LL;
+        if (!send_message_wait(peer_mac, FRAME_TYPE_BENCH_PING, tx_payload, payload_len, TX_MSG_FLAG_FLUSH,
+                               pdMS_TO_TICKS(CONFIG_BENCHMARK_PING_TIMEOUT_MS))) {
+            continue;
+        }
+
+        bench_event_t event;
+        while (wait_event(&event, deadline_us)) {
+            if (event.type == FRAME_TYPE_BENCH_PONG && event.msg.test_id == test_id && event.msg.index == (uint32_t)i) {
+                uint32_t rtt_us = (uint32_t)(event.rx_us - sent_us);
+                rtt_samples[received++] = rtt_us;
+                total_us += rtt_us;
+                break;
+            }
+        }
+    }
+
+    if (received == 0) {
+        printf("BENCH,ping,len=%d,sent=%d,received=0\n", frame_len, CONFIG_BENCHMARK_PING_COUNT);
+        return;
+    }
+    qsort(rtt_samples, received, sizeof(rtt_samples[0]), compare_u32);
+    printf("BENCH,ping,len=%d,sent=%d,received=%d,min_us=%lu,avg_us=%lu,p50_us=%lu,p99_us=%lu,max_us=%lu\n",
+           frame_len, CONFIG_BENCHMARK_PING_COUNT, received,
+           (unsigned long)rtt_samples[0], (unsigned long)(total_us / received),
+           (unsigned long)percentile(rtt_samples, received, 50), (unsigned long)percentile(rtt_samples, received, 99),
+           (unsigned long)rtt_samples[received - 1]);
+}
+
+static bool request_flood_report(const uint8_t *peer_mac, uint32_t test_id, uint32_t sent, bench_report_t *report)
+{
+    bench_flood_end_t end = { .test_id = test_id, .sent = sent };
+    for (int attempt = 0; attempt < BENCH_END_ATTEMPTS; attempt++) {
+        if (!send_message_wait(peer_mac, FRAME_TYPE_BENCH_FLOOD_END, &end, sizeof(end), TX_MSG_FLAG_FLUSH,
+                               pdMS_TO_TICKS(BENCH_REPORT_TIMEOUT_MS))) {
+            continue;
+        }
+        int64_t deadline_us = esp_timer_get_time() + BENCH_REPORT_TIMEOUT_MS * 1000LL;
+        bench_event_t event;
+        while (wait_event(&event, deadline_us)) {
+            if (event.type == FRAME_TYPE_BENCH_REPORT && event.report.test_id == test_id) {
+                *report = event.report;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void run_flood(const uint8_t *peer_mac, int frame_len)
+{
+    uint32_t test_id = next_test_id++;
+    int payload_len = frame_len - FRAME_HEADER_LEN;
+    uint32_t sent = 0;
+
+    xQueueReset(bench_events);
+    int64_t start_us = esp_timer_get_time();
+    for (int i = 0; i < CONFIG_BENCHMARK_FLOOD_COUNT; i++) {
+        bench_msg_t msg = { .test_id = test_id, .index = i };
+        memcpy(tx_payload, &msg, sizeof(msg));
+        if (!send_message_wait(peer_mac, FRAME_TYPE_BENCH_FLOOD, tx_payload, payload_len, TX_MSG_FLAG_FLUSH,
+                               pdMS_TO_TICKS(BENCH_REPORT_TIMEOUT_MS))) {
+            ESP_LOGW(TAG, "TX queue stalled, stopping flood after %lu frames", (unsigned long)sent);
+            break;
+        }
+        sent++;
+    }
+    int64_t tx_us = esp_timer_get_time() - start_us;
+    vTaskDelay(pdMS_TO_TICKS(BENCH_DRAIN_DELAY_MS));
+
+    bench_report_t report;
+    if (!request_flood_report(peer_mac, test_id, sent, &report)) {
+        printf("BENCH,flood,len=%d,sent=%lu,report=timeout\n", frame_len, (unsigned long)sent);
+        return;
+    }
+
+    double duration_s = report.duration_us > 0 ? report.duration_us / 1e6 : 0;
+    printf("BENCH,flood,len=%d,sent=%lu,received=%lu,loss_pct=%.2f,fps=%.1f,bytes_per_s=%.0f,tx_fps=%.1f\n",
+           frame_len, (unsigned long)sent, (unsigned long)report.received,
+           sent > 0 ? 100.0 * (sent - (report.received < sent ? report.received : sent)) / sent : 0.0,
+           duration_s > 0 ? report.received / duration_s : 0.0,
+           duration_s > 0 ? report.bytes / duration_s : 0.0,
+           tx_us > 0 ? sent * 1e6 / tx_us : 0.0);
+}
+
+#if CONFIG_LINK_ENCRYPT
+// Cost of sealing and opening one frame, i.e. the latency encryption adds to a
+// one-way trip over the plaintext path.
+static void run_crypto(const uint8_t *peer_mac, int frame_len)
+{
+    static link_crypto_ctx_t ctx;
+    static uint8_t frame[FRAME_MAX_LEN];
+    static const uint8_t key[LINK_CRYPTO_KEY_LEN] = { 0x42 };
+    static bool ctx_ready;
+    if (!ctx_ready) {
+        link_crypto_ctx_init(&ctx);
+        ctx_ready = true;
+    }
+
+    int64_t seal_us = 0;
+    int64_t open_us = 0;
+    for (int i = 0; i < BENCH_CRYPTO_ROUNDS; i++) {
+        int len = frame_write_header(frame, FRAME_TYPE_BENCH_FLOOD, 0, (uint16_t)i, frame_len - FRAME_HEADER_LEN);
+        uint16_t counter_hi;
+        int64_t start_us = esp_timer_get_time();
+        len = link_crypto_seal(&ctx, key, peer_mac, frame, len, 0);
+        int64_t sealed_us = esp_timer_get_time();
+        if (len == 0 || !link_crypto_open(&ctx, key, peer_mac, frame, &len, &counter_hi)) {
+            printf("BENCH,crypto,len=%d,error=1\n", frame_len);
+            return;
+        }
+        seal_us += sealed_us - start_us;
+        open_us += esp_timer_get_time() - sealed_us;
+    }
+    printf("BENCH,crypto,len=%d,rounds=%d,seal_us=%.2f,open_us=%.2f\n", frame_len, BENCH_CRYPTO_ROUNDS,
+           (double)seal_us / BENCH_CRYPTO_ROUNDS, (double)open_us / BENCH_CRYPTO_ROUNDS);
+}
+#endif
+
+void benchmark_run(const uint8_t *peer_mac)
+{
+    if (bench_events == NULL) {
+        bench_events = xQueueCreate(BENCH_EVENT_QUEUE_LEN, sizeof(bench_event_t));
+        if (bench_events == NULL) {
+            ESP_LOGE(TAG, "Failed to create benchmark queue");
+            return;
+        }
+        next_test_id = esp_random();
+    }
+
+    printf("BENCH,start,peer=" MACSTR ",encrypt=%d\n", MAC2STR(peer_mac), FRAME_CRYPTO_OVERHEAD > 0);
+#if CONFIG_BENCHMARK_PING
+    run_ping(peer_mac, BENCH_FRAME_LEN);
+#endif
+#if CONFIG_BENCHMARK_FLOOD
+    run_flood(peer_mac, BENCH_FRAME_LEN);
+#endif
+#if CONFIG_LINK_ENCRYPT
+    run_crypto(peer_mac, BENCH_FRAME_LEN);
+#endif
+#if CONFIG_BENCHMARK_SWEEP
+    for (int len = BENCH_MIN_FRAME_LEN; ; len += CONFIG_BENCHMARK_SWEEP_STEP) {
+        if (len > FRAME_MAX_PLAIN_LEN) {
+            len = FRAME_MAX_PLAIN_LEN;
+        }
+        run_ping(peer_mac, len);
+        run_flood(peer_mac, len);
+#if CONFIG_LINK_ENCRYPT
+        run_crypto(peer_mac, len);
+#endif
+        if (len == FRAME_MAX_PLAIN_LEN) {
+            break;
+        }
+    }
+#endif
+    printf("BENCH,done\n");
+}
+
+#else
+
+void benchmark_run(const uint8_t *peer_mac)
+{
+    ESP_LOGW(TAG, "Benchmark initiator not enabled in menuconfig");
+}
+
+#endif
@@ -0,0 +1,203 @@
+/**
+ * bulk.c
+ *
+ * Bulk transfers (see bulk.h): the blocking sender and the RX hook around the
+ * fragment bookkeeping of bulk_frag.c.
+ *
+ * Each round the sender queues every fragment the peer has not acknowledged and
+ * sets FRAG_FLAG_ACK_REQ on the last one. The receiver answers that fragment, and
+ * every fragment after the transfer completed, with a bitmap of the fragments it
+ * holds. The zero runs of that bitmap are the NACK ranges resent next round.
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "bulk.h"
+#include "bulk_frag.h"
+#include "frame.h"
+#include "esp_now_link_priv.h"
+
+static const char *TAG = "BULK";
+
+#define BULK_ACK_QUEUE_LEN 4
+
+// A FRAG_ACK handed from the RX worker to bulk_send(), with the peer it came from.
+typedef struct {
+    uint8_t mac[6];
+    frag_ack_t ack;
+} bulk_ack_event_t;
+
+// Sender side; bulk_lock allows one outgoing transfer at a time.
+static SemaphoreHandle_t bulk_lock;
+static QueueHandle_t bulk_acks;
+static uint16_t next_transfer_id;
+
+// Receiver side, only touched from the RX worker.
+static bulk_rx_t bulk_rx;
+static bulk_recv_cb_t recv_cb;
+
+static void log_transfer(const uint8_t *src_mac, const uint8_t *data, size_t len)
+{
+    ESP_LOGI(TAG, "Received %u bytes from " MACSTR, (unsigned)len, MAC2STR(src_mac));
+}
+
+esp_err_t bulk_init(void)
+{
+    bulk_lock = xSemaphoreCreateMutex();
+    bulk_acks = xQueueCreate(BULK_ACK_QUEUE_LEN, sizeof(bulk_ack_event_t));
+    if (bulk_lock == NULL || bulk_acks == NULL) {
+        ESP_LOGE(TAG, "Failed to create bulk transfer queues");
+        return ESP_ERR_NO_MEM;
+    }
+    bulk_rx_init(&bulk_rx);
+    next_transfer_id = (uint16_t)esp_random();
+    recv_cb = log_transfer;
+    return ESP_OK;
+}
+
+void bulk_set_recv_cb(bulk_recv_cb_t cb)
+{
+    recv_cb = cb != NULL ? cb : log_transfer;
+}
+
+static TickType_t ticks_until(int64_t deadline_us)
+{
+    int64_t remaining_us = deadline_us - esp_timer_get_time();
+    return remaining_us > 0 ? pdMS_TO_TICKS((remaining_us + 999) / 1000) + 1 : 0;
+}
+
+// Queues every fragment missing from acked. Returns false on timeout.
+static bool send_round(const uint8_t *dest_mac, const uint8_t *data, const frag_header_t *base,
+                       uint64_t acked, int64_t deadline_us, uint32_t *ticket)
+{
+    int last = bulk_frag_last_missing(acked);
+
+    for (int i = 0; i <= last; i++) {
+        if (acked & ((uint64_t)1 << i)) {
+            continue;
+        }
+        frag_header_t hdr = *base;
+        hdr.index = i;
+        hdr.flags = i == last ? FRAG_FLAG_ACK_REQ : 0;
+        if (!send_message_ref(dest_mac, FRAME_TYPE_FRAG, &hdr, sizeof(hdr), data + i * FRAG_CHUNK_LEN,
+                              bulk_frag_len(i, base->count, base->total_len), ticks_until(deadline_us), ticket)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+esp_err_t bulk_send(const uint8_t *dest_mac, const void *data, size_t len, uint32_t timeout_ms)
+{
+    if (len == 0 || len > CONFIG_BULK_MAX_LEN || (dest_mac[0] & 0x01)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int64_t deadline_us = esp_timer_get_time() + timeout_ms * 1000LL;
+    if (xSemaphoreTake(bulk_lock, ticks_until(deadline_us)) != pdTRUE) {
+        return ESP_ERR_TIMEOUT;
+    }
+
+    frag_header_t base = {
+        .transfer_id = next_transfer_id++,
+        .count = bulk_frag_count(len),
+        .total_len = len,
+    };
+    uint64_t all = bulk_frag_mask(base.count);
+    uint64_t acked = ~all;          // Bits past the last fragment count as acknowledged
+    uint32_t ticket = 0;
+    int rounds = 0;
+    esp_err_t ret = ESP_OK;
+
+    xQueueReset(bulk_acks);
+    while (acked != UINT64_MAX) {
+        if (!send_round(dest_mac, data, &base, acked, deadline_us, &ticket)) {
+            ret = ESP_ERR_TIMEOUT;
+            break;
+        }
+        rounds++;
+
+        int64_t ack_deadline_us = esp_timer_get_time() + BULK_ACK_TIMEOUT_MS * 1000LL;
+        if (ack_deadline_us > deadline_us) {
+            ack_deadline_us = deadline_us;
+        }
+        bulk_ack_event_t event;
+        while (xQueueReceive(bulk_acks, &event, ticks_until(ack_deadline_us)) == pdTRUE) {
+            if (event.ack.transfer_id == base.transfer_id && memcmp(event.mac, dest_mac, 6) == 0) {
+                acked |= event.ack.received & all;
+                break;
+            }
+        }
+        if (acked != UINT64_MAX && esp_timer_get_time() >= deadline_us) {
+            ret = ESP_ERR_TIMEOUT;
+            break;
+        }
+    }
+
+    // Fragments may still sit in the TX ring pointing into data.
+    if (ticket != 0) {
+        tx_ref_wait(ticket);
+    }
+    xSemaphoreGive(bulk_lock);
+
+    if (ret == ESP_OK) {
+        ESP_LOGI(TAG, "Sent %u bytes to " MACSTR " in %d fragment(s), %d round(s)",
+                 (unsigned)len, MAC2STR(dest_mac), base.count, rounds);
+    } else {
+        ESP_LOGW(TAG, "Transfer to " MACSTR " timed out", MAC2STR(dest_mac));
+    }
+    return ret;
+}
+
+static void send_ack(const uint8_t *src_mac, const bulk_rx_slot_t *slot)
+{
+    frag_ack_t ack;
+    bulk_rx_ack(slot, &ack);
+    send_message(src_mac, FRAME_TYPE_FRAG_ACK, &ack, sizeof(ack), TX_MSG_FLAG_FLUSH);
+}
+
+static void handle_fragment(const uint8_t *src_mac, const uint8_t *payload, int len)
+{
+    const bulk_rx_slot_t *slot = NULL;
+    switch (bulk_rx_fragment(&bulk_rx, src_mac, payload, len, esp_timer_get_time(), &slot)) {
+    case BULK_FRAG_MALFORMED:
+        ESP_LOGW(TAG, "Dropping malformed fragment from " MACSTR, MAC2STR(src_mac));
+        break;
+    case BULK_FRAG_COMPLETE:
+        send_ack(src_mac, slot);
+        recv_cb(src_mac, slot->buf, slot->total_len);
+        break;
+    case BULK_FRAG_ACK:
+        send_ack(src_mac, slot);
+        break;
+    default:
+        break;
+    }
+}
+
+void bulk_handle_rx(const uint8_t *src_mac, uint8_t type, const uint8_t *payload, int len)
+{
+    switch (type) {
+    case FRAME_TYPE_FRAG:
+        handle_fragment(src_mac, payload, len);
+        break;
+    case FRAME_TYPE_FRAG_ACK: {
+        bulk_ack_event_t event;
+        if (len != (int)sizeof(event.ack) || bulk_acks == NULL) {
+            break;
+        }
+        memcpy(event.mac, src_mac, sizeof(event.mac));
+        memcpy(&event.ack, payload, sizeof(event.ack));
+        xQueueSend(bulk_acks, &event, 0);
+        break;
+    }
+    default:
+        break;
+    }
+}
@@ -0,0 +1,108 @@
+/**
+ * bulk_frag.c
+ *
+ * Fragments and reassembly of bulk transfers (see bulk_frag.h).
+ */
+
+#include <string.h>
+#include "bulk_frag.h"
+
+uint64_t bulk_frag_mask(int count)
+{
+    return count >= BULK_MAX_FRAGMENTS ? UINT64_MAX : ((uint64_t)1 << count) - 1;
+}
+
+int bulk_frag_count(size_t len)
+{
+    return (int)((len + FRAG_CHUNK_LEN - 1) / FRAG_CHUNK_LEN);
+}
+
+int bulk_frag_len(int index, int count, int total_len)
+{
+    return index == count - 1 ? total_len - index * FRAG_CHUNK_LEN : FRAG_CHUNK_LEN;
+}
+
+int bulk_frag_last_missing(uint64_t acked)
+{
+    int last = BULK_MAX_FRAGMENTS - 1;
+    while (acked & ((uint64_t)1 << last)) {
+        last--;
+    }
+    return last;
+}
+
+void bulk_rx_init(bulk_rx_t *rx)
+{
+    memset(rx, 0, sizeof(*rx));
+}
+
+static bulk_rx_slot_t *find_rx_slot(bulk_rx_t *rx, const uint8_t *src_mac, uint16_t transfer_id, int64_t now_us)
+{
+    bulk_rx_slot_t *reuse = NULL;
+    for (int i = 0; i < CONFIG_BULK_RX_SLOTS; i++) {
+        bulk_rx_slot_t *slot = &rx->slots[i];
+        if (slot->used && slot->transfer_id == transfer_id && memcmp(slot->mac, src_mac, 6) == 0) {
+            return slot;
+        }
+        bool reusable = !slot->used || slot->complete || now_us - slot->last_us > BULK_RX_IDLE_TIMEOUT_US;
+        if (reusable && (reuse == NULL || !slot->used || (reuse->used && slot->last_us < reuse->last_us))) {
+            reuse = slot;
+        }
+    }
+    return reuse;
+}
+
+bulk_frag_result_t bulk_rx_fragment(bulk_rx_t *rx, const uint8_t *src_mac, const uint8_t *payload, int len,
+                                    int64_t now_us, const bulk_rx_slot_t **out)
+{
+    frag_header_t hdr;
+    if (len < (int)sizeof(hdr)) {
+        return BULK_FRAG_MALFORMED;
+    }
+    memcpy(&hdr, payload, sizeof(hdr));
+    int chunk_len = len - (int)sizeof(hdr);
+    if (hdr.count == 0 || hdr.count > BULK_MAX_FRAGMENTS || hdr.index >= hdr.count ||
+        hdr.total_len > CONFIG_BULK_MAX_LEN || hdr.count != bulk_frag_count(hdr.total_len) ||
+        chunk_len != bulk_frag_len(hdr.index, hdr.count, hdr.total_len)) {
+        return BULK_FRAG_MALFORMED;
+    }
+
+    bulk_rx_slot_t *slot = find_rx_slot(rx, src_mac, hdr.transfer_id, now_us);
+    if (slot == NULL) {
+        return BULK_FRAG_DROPPED;   // All buffers busy
+    }
+    if (!slot->used || slot->transfer_id != hdr.transfer_id || memcmp(slot->mac, src_mac, 6) != 0) {
+        slot->used = true;
+        slot->complete = false;
+        memcpy(slot->mac, src_mac, 6);
+        slot->transfer_id = hdr.transfer_id;
+        slot->count = hdr.count;
+        slot->total_len = hdr.total_len;
+        slot->received = 0;
+    } else if (slot->count != hdr.count || slot->total_len != hdr.total_len) {
+        return BULK_FRAG_DROPPED;
+    }
+    slot->last_us = now_us;
+
+    uint64_t bit = (uint64_t)1 << hdr.index;
+    if (!(slot->received & bit)) {
+        memcpy(slot->buf + hdr.index * FRAG_CHUNK_LEN, payload + sizeof(hdr), chunk_len);
+        slot->received |= bit;
+    }
+
+    *out = slot;
+    if (!slot->complete && slot->received == bulk_frag_mask(slot->count)) {
+        slot->complete = true;
+        return BULK_FRAG_COMPLETE;
+    }
+    if (slot->complete || (hdr.flags & FRAG_FLAG_ACK_REQ)) {
+        return BULK_FRAG_ACK;
+    }
+    return BULK_FRAG_KEPT;
+}
+
+void bulk_rx_ack(const bulk_rx_slot_t *slot, frag_ack_t *ack)
+{
+    ack->transfer_id = slot->transfer_id;
+    ack->received = slot->received;
+}
@@ -0,0 +1,90 @@
+/**
+ * bulk_frag.h
+ *
+ * Wire format and bookkeeping of bulk transfers (see bulk.h): the fragment
+ * header and selective acknowledgement, the split of a buffer into fragments,
+ * and the receiver's reassembly slots. No FreeRTOS or ESP-IDF dependencies;
+ * bulk.c adds the blocking sender and the RX hook on top, and the host harness
+ * in host/ drives these directly.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "frame.h"
+#include "bulk.h"
+
+#define FRAG_FLAG_ACK_REQ 0x01      // Receiver answers this fragment with a FRAG_ACK
+#define FRAG_CHUNK_LEN (FRAME_MAX_PAYLOAD_LEN - (int)sizeof(frag_header_t))
+#define BULK_ACK_TIMEOUT_MS 300     // Sender waits this long for an acknowledgement after the last fragment of a round
+#define BULK_RX_IDLE_TIMEOUT_US 2000000 // An incomplete transfer this quiet may be replaced
+
+typedef struct __attribute__((packed)) {
+    uint16_t transfer_id;
+    uint8_t index;
+    uint8_t count;
+    uint8_t flags;
+    uint16_t total_len;
+} frag_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t transfer_id;
+    uint64_t received;              // Bit n set: fragment n has arrived
+} frag_ack_t;
+
+_Static_assert(CONFIG_BULK_MAX_LEN <= BULK_MAX_FRAGMENTS * FRAG_CHUNK_LEN, "CONFIG_BULK_MAX_LEN needs more fragments than the ACK bitmap holds");
+
+typedef struct {
+    bool used;
+    bool complete;                  // Kept so late fragments are still acknowledged
+    uint8_t mac[6];
+    uint16_t transfer_id;
+    uint8_t count;
+    uint16_t total_len;
+    uint64_t received;
+    int64_t last_us;
+    uint8_t buf[CONFIG_BULK_MAX_LEN];
+} bulk_rx_slot_t;
+
+typedef struct {
+    bulk_rx_slot_t slots[CONFIG_BULK_RX_SLOTS];
+} bulk_rx_t;
+
+typedef enum {
+    BULK_FRAG_MALFORMED,
+    BULK_FRAG_DROPPED,              // No slot free, or it contradicts its transfer; the sender retries it
+    BULK_FRAG_KEPT,
+    BULK_FRAG_ACK,                  // Kept or known: answer with the slot's bitmap
+    BULK_FRAG_COMPLETE,             // Completed the transfer: answer, then deliver the slot's buffer
+} bulk_frag_result_t;
+
+/** Bitmap of count fragments, all set. */
+uint64_t bulk_frag_mask(int count);
+
+/** Fragments needed for len bytes. */
+int bulk_frag_count(size_t len);
+
+/** Length of fragment index of a total_len transfer in count fragments. */
+int bulk_frag_len(int index, int count, int total_len);
+
+/**
+ * The last fragment missing from acked, which ends a round and carries
+ * FRAG_FLAG_ACK_REQ. acked must not have every bit set.
+ */
+int bulk_frag_last_missing(uint64_t acked);
+
+void bulk_rx_init(bulk_rx_t *rx);
+
+/**
+ * Stores a FRAME_TYPE_FRAG payload from src_mac. For BULK_FRAG_ACK and
+ * BULK_FRAG_COMPLETE, *slot is the transfer to acknowledge with
+ * bulk_rx_ack(); it stays valid until the next call.
+ */
+bulk_frag_result_t bulk_rx_fragment(bulk_rx_t *rx, const uint8_t *src_mac, const uint8_t *payload, int len,
+                                    int64_t now_us, const bulk_rx_slot_t **slot);
+
+/** The acknowledgement for slot's current state. */
+void bulk_rx_ack(const bulk_rx_slot_t *slot, frag_ack_t *ack);
@@ -0,0 +1,339 @@
+/**
+ * channel.c
+ *
+ * Channel survey, coordinated channel switch and channel search (see channel.h).
+ *
+ * The radio does not report clear-channel-assessment busy time, so the survey
+ * estimates it from the frames overheard in promiscuous mode: their lengths at
+ * the 1 Mbps base rate give an upper bound on airtime, which is then combined
+ * with the average noise floor.
+ */
+
+#include <stdatomic.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#include "channel.h"
+#include "discovery.h"
+#include "frame.h"
+#include "esp_now_link_priv.h"
+
+static const char *TAG = "CHANNEL";
+
+#define CHANNEL_SURVEY_DWELL_MS 50  // Listening time per channel during the survey
+#define CHANNEL_NOISE_REF_DBM -100  // Noise floor that adds nothing to a channel's score
+#define CHANNEL_NOISE_WEIGHT 10     // Score per dB above the reference, in busy permille
+#define CHANNEL_SEARCH_DWELL_MS 1500 // Time on a channel without peers before hopping on
+#define CHANNEL_SWITCH_DELAY_MS 200 // Lets the switch message reach every peer first
+#define CHANNEL_LOSS_WINDOW_MS 10000
+#define CHANNEL_LOSS_MIN_ATTEMPTS 50 // Ignore the retransmission rate below this many attempts
+#define CHANNEL_NVS_NAMESPACE "esp_now_link"
+#define CHANNEL_NVS_KEY "channel"
+
+typedef struct __attribute__((packed)) {
+    uint8_t channel;
+    uint16_t delay_ms;
+} channel_switch_t;
+
+static atomic_uint current_channel;
+
+static void tune(uint8_t channel)
+{
+    esp_err_t ret = esp_wifi_set_channel(channel, WIFI_SECOND_CHAN_NONE);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set channel %u: %s", channel, esp_err_to_name(ret));
+        return;
+    }
+    atomic_store(&current_channel, channel);
+}
+
+uint8_t channel_current(void)
+{
+    return atomic_load(&current_channel);
+}
+
+#if CONFIG_CHANNEL_AUTO
+
+static const uint8_t broadcast_mac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static const uint8_t fallback_channels[] = {1, 6, 11}; // Non-overlapping, used without survey data
+
+static uint8_t my_mac[6];
+static uint8_t saved_channel;
+static esp_timer_handle_t switch_timer;
+static atomic_uint pending_channel;
+
+// Survey results by channel, lower is better; -1 where no survey ran.
+static int scores[CHANNEL_MAX + 1];
+static bool propose_surveyed;       // Survey found a better channel than the home channel
+
+// Written by the promiscuous callback in the Wi-Fi task during the survey only.
+static struct {
+    uint32_t frames;
+    uint32_t airtime_us;
+    int32_t noise_sum;
+} sample;
+
+// channel_poll() state, upkeep task only.
+static int64_t no_peers_since_ms = -1;
+static int64_t loss_window_start_ms;
+static uint32_t loss_attempts_start;
+static uint32_t loss_first_start;
+
+static void on_survey_rx(void *buf, wifi_promiscuous_pkt_type_t type)
+{
+    const wifi_promiscuous_pkt_t *pkt = buf;
+    sample.frames++;
+    sample.airtime_us += pkt->rx_ctrl.sig_len * 8;
+    sample.noise_sum += pkt->rx_ctrl.noise_floor;
+}
+
+static int channel_score(uint32_t airtime_us, int noise_dbm)
+{
+    int busy_permille = (int)((uint64_t)airtime_us * 1000 / (CHANNEL_SURVEY_DWELL_MS * 1000));
+    if (busy_permille > 1000) {
+        busy_permille = 1000;
+    }
+    int noise_db = noise_dbm > CHANNEL_NOISE_REF_DBM ? noise_dbm - CHANNEL_NOISE_REF_DBM : 0;
+    return busy_permille + CHANNEL_NOISE_WEIGHT * noise_db;
+}
+
+static uint8_t survey(void)
+{
+    uint8_t best = 0;
+    esp_wifi_set_promiscuous_rx_cb(on_survey_rx);
+    esp_wifi_set_promiscuous(true);
+    for (int ch = CHANNEL_MIN; ch <= CHANNEL_MAX; ch++) {
+        esp_wifi_set_channel(ch, WIFI_SECOND_CHAN_NONE);
+        memset(&sample, 0, sizeof(sample));
+        vTaskDelay(pdMS_TO_TICKS(CHANNEL_SURVEY_DWELL_MS));
+
+        int noise_dbm = sample.frames > 0 ? sample.noise_sum / (int32_t)sample.frames : CHANNEL_NOISE_REF_DBM;
+        scores[ch] = channel_score(sample.airtime_us, noise_dbm);
+        ESP_LOGI(TAG, "Channel %2d: %3lu frames, %6lu us airtime, noise %d dBm, score %d", ch,
+                 (unsigned long)sample.frames, (unsigned long)sample.airtime_us, noise_dbm, scores[ch]);
+        if (best == 0 || scores[ch] < scores[best]) {
+            best = ch;
+        }
+    }
+    esp_wifi_set_promiscuous(false);
+    return best;
+}
+
+static void save_home_channel(uint8_t channel)
+{
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(CHANNEL_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret == ESP_OK) {
+        ret = nvs_set_u8(handle, CHANNEL_NVS_KEY, channel);
+        if (ret == ESP_OK) {
+            ret = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (ret == ESP_OK) {
+        saved_channel = channel;
+    } else {
+        ESP_LOGW(TAG, "Failed to save home channel: %s", esp_err_to_name(ret));
+    }
+}
+
+static void on_switch_timer(void *arg)
+{
+    uint8_t channel = atomic_exchange(&pending_channel, 0);
+    if (channel != 0 && channel != channel_current()) {
+        ESP_LOGI(TAG, "Switching to channel %u", channel);
+        tune(channel);
+    }
+}
+
+static void schedule_switch(uint8_t channel, uint16_t delay_ms)
+{
+    atomic_store(&pending_channel, channel);
+    esp_timer_stop(switch_timer);
+    esp_timer_start_once(switch_timer, delay_ms * 1000LL);
+}
+
+static bool is_coordinator(const uint8_t macs[][6], int peer_count)
+{
+    for (int i = 0; i < peer_count; i++) {
+        if (memcmp(macs[i], my_mac, 6) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint8_t best_other_channel(uint8_t current)
+{
+    int best = -1;
+    for (int ch = CHANNEL_MIN; ch <= CHANNEL_MAX; ch++) {
+        if (ch != current && scores[ch] >= 0 && (best < 0 || scores[ch] < scores[best])) {
+            best = ch;
+        }
+    }
+    if (best > 0) {
+        return best;
+    }
+    for (int i = 0; i < (int)sizeof(fallback_channels); i++) {
+        if (fallback_channels[i] > current) {
+            return fallback_channels[i];
+        }
+    }
+    return fallback_channels[0] != current ? fallback_channels[0] : fallback_channels[1];
+}
+
+static void propose_switch(uint8_t channel, const uint8_t macs[][6], int peer_count)
+{
+    channel_switch_t msg = { .channel = channel, .delay_ms = CHANNEL_SWITCH_DELAY_MS };
+    ESP_LOGI(TAG, "Moving %d peer(s) from channel %u to %u", peer_count, channel_current(), channel);
+    for (int i = 0; i < peer_count; i++) {
+        send_message(macs[i], FRAME_TYPE_CHANNEL_SWITCH, &msg, sizeof(msg), TX_MSG_FLAG_FLUSH);
+    }
+    send_message(broadcast_mac, FRAME_TYPE_CHANNEL_SWITCH, &msg, sizeof(msg), TX_MSG_FLAG_FLUSH);
+    schedule_switch(channel, CHANNEL_SWITCH_DELAY_MS);
+}
+
+// Percentage of transmission attempts since the window started that were retries.
+static int retransmit_pct(int64_t now_ms, bool *window_done)
+{
+    link_stats_t stats;
+    esp_now_link_get_stats(NULL, &stats);
+    uint32_t first = stats.tx_acked + stats.tx_failed;
+    uint32_t attempts = stats.tx_failed * LINK_STATS_RETRY_BUCKETS;
+    for (int i = 0; i < LINK_STATS_RETRY_BUCKETS; i++) {
+        attempts += (i + 1) * stats.tx_attempts[i];
+    }
+
+    *window_done = now_ms - loss_window_start_ms >= CHANNEL_LOSS_WINDOW_MS;
+    uint32_t window_attempts = attempts - loss_attempts_start;
+    uint32_t window_first = first - loss_first_start;
+    if (*window_done) {
+        loss_window_start_ms = now_ms;
+        loss_attempts_start = attempts;
+        loss_first_start = first;
+    }
+    if (window_attempts < CHANNEL_LOSS_MIN_ATTEMPTS) {
+        return 0;
+    }
+    return (int)((window_attempts - window_first) * 100 / window_attempts);
+}
+
+static esp_err_t channel_init_auto(void)
+{
+    for (int ch = 0; ch <= CHANNEL_MAX; ch++) {
+        scores[ch] = -1;
+    }
+    esp_read_mac(my_mac, ESP_MAC_WIFI_STA);
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = on_switch_timer,
+        .name = "channel_switch",
+    };
+    esp_err_t ret = esp_timer_create(&timer_args, &switch_timer);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    nvs_handle_t handle;
+    if (nvs_open(CHANNEL_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+        if (nvs_get_u8(handle, CHANNEL_NVS_KEY, &saved_channel) != ESP_OK ||
+            saved_channel < CHANNEL_MIN || saved_channel > CHANNEL_MAX) {
+            saved_channel = 0;
+        }
+        nvs_close(handle);
+    }
+
+    uint8_t home = saved_channel != 0 ? saved_channel : CONFIG_CHANNEL_DEFAULT;
+    if (saved_channel == 0) {
+        // First boot: peers are still on the default channel, so only propose the result once paired.
+        uint8_t best = survey();
+        propose_surveyed = best != home && scores[best] < scores[home];
+        ESP_LOGI(TAG, "Least loaded channel: %u", best);
+    }
+    tune(home);
+    return ESP_OK;
+}
+
+#endif
+
+esp_err_t channel_init(void)
+{
+#if CONFIG_CHANNEL_AUTO
+    esp_err_t ret = channel_init_auto();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+#else
+    tune(CONFIG_CHANNEL_DEFAULT);
+#endif
+    ESP_LOGI(TAG, "Home channel %u", channel_current());
+    return ESP_OK;
+}
+
+void channel_poll(const uint8_t macs[][6], int peer_count)
+{
+#if CONFIG_CHANNEL_AUTO
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    uint8_t current = channel_current();
+
+    if (peer_count == 0) {
+        if (no_peers_since_ms < 0) {
+            no_peers_since_ms = now_ms;
+        } else if (now_ms - no_peers_since_ms >= CHANNEL_SEARCH_DWELL_MS) {
+            uint8_t next = current < CHANNEL_MAX ? current + 1 : CHANNEL_MIN;
+            ESP_LOGI(TAG, "No peers on channel %u, searching channel %u", current, next);
+            tune(next);
+            discovery_restart();
+            no_peers_since_ms = now_ms;
+        }
+        return;
+    }
+    no_peers_since_ms = -1;
+
+    if (current != saved_channel) {
+        save_home_channel(current);
+    }
+    if (atomic_load(&pending_channel) != 0 || !is_coordinator(macs, peer_count)) {
+        return;
+    }
+
+    if (propose_surveyed) {
+        propose_surveyed = false;
+        uint8_t best = best_other_channel(current);
+        if (scores[best] >= 0 && scores[current] >= 0 && scores[best] < scores[current]) {
+            propose_switch(best, macs, peer_count);
+            return;
+        }
+    }
+
+    bool window_done;
+    int pct = retransmit_pct(now_ms, &window_done);
+    if (window_done && pct >= CONFIG_CHANNEL_LOSS_THRESHOLD_PCT) {
+        ESP_LOGW(TAG, "%d%% retransmissions on channel %u", pct, current);
+        propose_switch(best_other_channel(current), macs, peer_count);
+    }
+#endif
+}
+
+void channel_handle_rx(const uint8_t *src_mac, uint8_t type, const uint8_t *payload, int len)
+{
+#if CONFIG_CHANNEL_AUTO
+    channel_switch_t msg;
+    if (type != FRAME_TYPE_CHANNEL_SWITCH || len != (int)sizeof(msg)) {
+        return;
+    }
+    memcpy(&msg, payload, sizeof(msg));
+    if (msg.channel < CHANNEL_MIN || msg.channel > CHANNEL_MAX || msg.channel == channel_current() ||
+        msg.delay_ms > 10 * CHANNEL_SWITCH_DELAY_MS) {
+        return;
+    }
+    ESP_LOGI(TAG, MACSTR " requested channel %u", MAC2STR(src_mac), msg.channel);
+    schedule_switch(msg.channel, msg.delay_ms);
+#endif
+}
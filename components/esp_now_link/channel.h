@@ -0,0 +1,36 @@
+/**
+ * channel.h
+ *
+ * Wi-Fi channel selection for the ESP-NOW link. A startup survey scores every
+ * channel by the traffic and noise it hears; the node with the lowest MAC among
+ * its peers (the coordinator) moves everyone to the best channel with a
+ * FRAME_TYPE_CHANNEL_SWITCH message, and again when retransmissions climb on the
+ * current one. A node without peers hops channels until it finds them.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#define CHANNEL_MIN 1
+#define CHANNEL_MAX CONFIG_CHANNEL_MAX
+
+/**
+ * Tunes to the home channel: the one saved in NVS, else CONFIG_CHANNEL_DEFAULT
+ * after a survey. Without CONFIG_CHANNEL_AUTO always CONFIG_CHANNEL_DEFAULT.
+ * Call after esp_wifi_start().
+ */
+esp_err_t channel_init(void);
+
+uint8_t channel_current(void);
+
+/**
+ * Periodic housekeeping from the main loop: channel search while there are no
+ * peers, switch proposals by the coordinator, and saving the home channel.
+ */
+void channel_poll(const uint8_t macs[][6], int peer_count);
+
+/** RX worker hook for FRAME_TYPE_CHANNEL_SWITCH messages. */
+void channel_handle_rx(const uint8_t *src_mac, uint8_t type, const uint8_t *payload, int len);
@@ -0,0 +1,288 @@
+/**
+ * command.c
+ *
+ * Command dispatch and request/response matching (see command.h).
+ *
+ * Opcodes index a 256-byte table of handler slots, so a lookup is a single
+ * array access. Deferred commands are copied into a frame_pool buffer, whose
+ * index goes through command_queue to the command task.
+ */
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "command.h"
+#include "frame_pool.h"
+#include "sdkconfig.h"
+#include "spsc_queue.h"
+#include "esp_now_link_priv.h"
+
+static const char *TAG = "CMD";
+
+#define COMMAND_QUEUE_LEN 8         // Deferred commands waiting for the command task (power of two)
+#define COMMAND_TASK_STACK_SIZE 4096
+#define COMMAND_MAX_PENDING 4       // command_call()s waiting for a reply at once
+#define COMMAND_REPLY_TIMEOUT_MS 20 // Room in the TX ring for a reply
+
+typedef struct {
+    command_handler_t handler;
+    void *arg;
+    command_mode_t mode;
+} command_slot_t;
+
+typedef struct {
+    bool used;
+    bool done;
+    uint16_t corr_id;
+    uint8_t mac[6];
+    command_status_t status;
+    int reply_len;
+    uint8_t reply[COMMAND_MAX_REPLY_LEN];
+    SemaphoreHandle_t done_sem;
+} command_pending_t;
+
+// Slot 0 means no handler; registered handlers live in slots 1..COMMAND_MAX_HANDLERS.
+static uint8_t opcode_slots[256];
+static command_slot_t slots[COMMAND_MAX_HANDLERS + 1];
+static int slot_count;
+
+// Frame pool indices from the RX worker, the only producer.
+static spsc_queue_t command_queue;
+static TaskHandle_t command_task_handle;
+static command_pending_t pending[COMMAND_MAX_PENDING];
+static portMUX_TYPE pending_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint16_t next_corr_id;
+
+static void echo_handler(const command_request_t *req, void *arg)
+{
+    command_reply(req, COMMAND_OK, req->args, req->args_len);
+}
+
+static void command_task(void *arg)
+{
+    uint8_t index;
+    while (1) {
+        if (!spsc_queue_pop(&command_queue, &index)) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        frame_buf_t *buf = frame_pool_at(index);
+        frame_cmd_t cmd;
+        command_request_t req = { .src_mac = buf->mac };
+        if (frame_decode_cmd(buf->data, buf->len, &cmd, &req.args, &req.args_len)) {
+            req.opcode = cmd.opcode;
+            req.corr_id = cmd.corr_id;
+            const command_slot_t *slot = &slots[opcode_slots[cmd.opcode]];
+            slot->handler(&req, slot->arg);
+        }
+        frame_pool_free(buf);
+    }
+}
+
+esp_err_t command_init(void)
+{
+    spsc_queue_init(&command_queue, COMMAND_QUEUE_LEN);
+    for (int i = 0; i < COMMAND_MAX_PENDING; i++) {
+        pending[i].done_sem = xSemaphoreCreateBinary();
+        if (pending[i].done_sem == NULL) {
+            ESP_LOGE(TAG, "Failed to create reply semaphores");
+            return ESP_ERR_NO_MEM;
+        }
+    }
+    next_corr_id = (uint16_t)esp_random();
+    if (xTaskCreatePinnedToCore(command_task, "esp_now_cmd", COMMAND_TASK_STACK_SIZE, NULL,
+                                CONFIG_COMMAND_TASK_PRIORITY, &command_task_handle, CONFIG_COMMAND_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create command task");
+        return ESP_ERR_NO_MEM;
+    }
+    return command_register(COMMAND_OPCODE_ECHO, echo_handler, NULL, COMMAND_RUN_INLINE);
+}
+
+// Call before the link is up: the RX worker reads the table without locking.
+esp_err_t command_register(uint8_t opcode, command_handler_t handler, void *arg, command_mode_t mode)
+{
+    if (handler == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    int slot = opcode_slots[opcode];
+    if (slot == 0) {
+        if (slot_count >= COMMAND_MAX_HANDLERS) {
+            return ESP_ERR_NO_MEM;
+        }
+        slot = ++slot_count;
+    }
+    slots[slot] = (command_slot_t){ .handler = handler, .arg = arg, .mode = mode };
+    opcode_slots[opcode] = slot;
+    return ESP_OK;
+}
+
+static esp_err_t send_cmd(const uint8_t *dest_mac, const frame_cmd_t *cmd, const void *head, int head_len,
+                          const void *body, int body_len, TickType_t timeout)
+{
+    uint8_t payload[FRAME_MAX_PAYLOAD_LEN];
+    if (head_len + body_len > COMMAND_MAX_ARGS_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    int len = frame_encode_cmd(payload, sizeof(payload), cmd, head, head_len);
+    if (body_len > 0) {
+        memcpy(payload + len, body, body_len);
+    }
+    len += body_len;
+    return send_message_wait(dest_mac, FRAME_TYPE_CMD, payload, len, TX_MSG_FLAG_FLUSH, timeout) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t command_reply(const command_request_t *req, command_status_t status, const void *data, int len)
+{
+    if (req->corr_id == 0) {
+        return ESP_OK;
+    }
+    if (len < 0 || len > COMMAND_MAX_REPLY_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    frame_cmd_t cmd = { .opcode = req->opcode, .flags = FRAME_CMD_FLAG_RESPONSE, .corr_id = req->corr_id };
+    uint8_t status_byte = status;
+    return send_cmd(req->src_mac, &cmd, &status_byte, 1, data, len, pdMS_TO_TICKS(COMMAND_REPLY_TIMEOUT_MS));
+}
+
+esp_err_t command_send(const uint8_t *dest_mac, uint8_t opcode, const void *args, int args_len, TickType_t timeout)
+{
+    frame_cmd_t cmd = { .opcode = opcode };
+    return send_cmd(dest_mac, &cmd, args, args_len, NULL, 0, timeout);
+}
+
+esp_err_t command_call(const uint8_t *dest_mac, uint8_t opcode, const void *args, int args_len,
+                       command_status_t *status, void *reply, int reply_cap, int *reply_len, TickType_t timeout)
+{
+    command_pending_t *entry = NULL;
+    portENTER_CRITICAL(&pending_lock);
+    for (int i = 0; i < COMMAND_MAX_PENDING && entry == NULL; i++) {
+        if (!pending[i].used) {
+            entry = &pending[i];
+            entry->used = true;
+            entry->done = false;
+            do {
+                entry->corr_id = next_corr_id++;
+            } while (entry->corr_id == 0);
+            memcpy(entry->mac, dest_mac, sizeof(entry->mac));
+        }
+    }
+    portEXIT_CRITICAL(&pending_lock);
+    if (entry == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    TickType_t start = xTaskGetTickCount();
+    frame_cmd_t cmd = { .opcode = opcode, .corr_id = entry->corr_id };
+    esp_err_t ret = send_cmd(dest_mac, &cmd, args, args_len, NULL, 0, timeout);
+    // A give can be left over from a reply that raced an earlier call's
+    // timeout, so only the done flag counts.
+    while (ret == ESP_OK) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout || xSemaphoreTake(entry->done_sem, timeout - elapsed) != pdTRUE) {
+            ret = ESP_ERR_TIMEOUT;
+            break;
+        }
+        portENTER_CRITICAL(&pending_lock);
+        bool done = entry->done;
+        portEXIT_CRITICAL(&pending_lock);
+        if (done) {
+            break;
+        }
+    }
+
+    portENTER_CRITICAL(&pending_lock);
+    if (ret == ESP_ERR_TIMEOUT && entry->done) {
+        ret = ESP_OK;  // The reply landed just as the wait ran out
+    }
+    entry->done = true;  // Keeps late replies out while the reply is copied
+    portEXIT_CRITICAL(&pending_lock);
+
+    if (ret == ESP_OK) {
+        int copy_len = entry->reply_len < reply_cap ? entry->reply_len : reply_cap;
+        if (copy_len > 0) {
+            memcpy(reply, entry->reply, copy_len);
+        }
+        if (reply_len != NULL) {
+            *reply_len = copy_len;
+        }
+        if (status != NULL) {
+            *status = entry->status;
+        }
+    }
+    portENTER_CRITICAL(&pending_lock);
+    entry->used = false;
+    portEXIT_CRITICAL(&pending_lock);
+    return ret;
+}
+
+static void handle_response(const uint8_t *src_mac, const frame_cmd_t *cmd, const uint8_t *args, int args_len)
+{
+    if (args_len < 1) {
+        return;
+    }
+    command_pending_t *matched = NULL;
+    portENTER_CRITICAL(&pending_lock);
+    for (int i = 0; i < COMMAND_MAX_PENDING; i++) {
+        command_pending_t *entry = &pending[i];
+        if (entry->used && !entry->done && entry->corr_id == cmd->corr_id &&
+            memcmp(entry->mac, src_mac, sizeof(entry->mac)) == 0) {
+            entry->status = args[0];
+            entry->reply_len = args_len - 1;
+            memcpy(entry->reply, args + 1, entry->reply_len);
+            entry->done = true;
+            matched = entry;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&pending_lock);
+    if (matched != NULL) {
+        xSemaphoreGive(matched->done_sem);
+    } else {
+        ESP_LOGD(TAG, "Unmatched reply 0x%04X from " MACSTR, cmd->corr_id, MAC2STR(src_mac));
+    }
+}
+
+void command_handle_rx(const uint8_t *src_mac, const uint8_t *payload, int len)
+{
+    frame_cmd_t cmd;
+    command_request_t req = { .src_mac = src_mac };
+    if (!frame_decode_cmd(payload, len, &cmd, &req.args, &req.args_len)) {
+        return;
+    }
+    if (cmd.flags & FRAME_CMD_FLAG_RESPONSE) {
+        handle_response(src_mac, &cmd, req.args, req.args_len);
+        return;
+    }
+    req.opcode = cmd.opcode;
+    req.corr_id = cmd.corr_id;
+
+    const command_slot_t *slot = &slots[opcode_slots[cmd.opcode]];
+    if (slot->handler == NULL) {
+        ESP_LOGW(TAG, "No handler for opcode 0x%02X from " MACSTR, cmd.opcode, MAC2STR(src_mac));
+        command_reply(&req, COMMAND_ERR_UNKNOWN_OPCODE, NULL, 0);
+        return;
+    }
+    if (slot->mode == COMMAND_RUN_INLINE) {
+        slot->handler(&req, slot->arg);
+        return;
+    }
+
+    frame_buf_t *buf = frame_pool_alloc();
+    if (buf == NULL) {
+        command_reply(&req, COMMAND_ERR_BUSY, NULL, 0);
+        return;
+    }
+    memcpy(buf->mac, src_mac, sizeof(buf->mac));
+    memcpy(buf->data, payload, len);
+    buf->len = len;
+    uint8_t index = frame_pool_index(buf);
+    if (!spsc_queue_push(&command_queue, index)) {
+        frame_pool_free(buf);
+        command_reply(&req, COMMAND_ERR_BUSY, NULL, 0);
+        return;
+    }
+    xTaskNotifyGive(command_task_handle);
+}
@@ -0,0 +1,268 @@
+/**
+ * compress.c
+ *
+ * Delta and LZ payload codecs and the keyframe history (see compress.h).
+ */
+
+#include <string.h>
+#include "compress.h"
+
+#define LZ_HASH_BITS 6              // 64 entries are plenty for one 250-byte frame
+#define LZ_NIBBLE_MAX 15            // Token value that is extended by a varint
+
+static int put_varint(uint8_t *out, int pos, int out_max, unsigned value)
+{
+    do {
+        if (pos >= out_max) {
+            return -1;
+        }
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        out[pos++] = value != 0 ? (byte | 0x80) : byte;
+    } while (value != 0);
+    return pos;
+}
+
+static int get_varint(const uint8_t *in, int pos, int len, unsigned *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 28; shift += 7) {
+        if (pos >= len) {
+            return -1;
+        }
+        uint8_t byte = in[pos++];
+        *value |= (unsigned)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return pos;
+        }
+    }
+    return -1;
+}
+
+static inline uint8_t ref_byte(const uint8_t *ref, int ref_len, int i)
+{
+    return i < ref_len ? ref[i] : 0;
+}
+
+int compress_delta_encode(const uint8_t *ref, int ref_len, const uint8_t *in, int len, uint8_t *out, int out_max)
+{
+    int op = put_varint(out, 0, out_max, len);
+    int i = 0;
+    while (op >= 0 && i < len) {
+        int run = i;
+        while (i < len && in[i] == ref_byte(ref, ref_len, i)) {
+            i++;
+        }
+        if (i == len) {
+            break;  // Trailing unchanged bytes are implied by the length
+        }
+        op = put_varint(out, op, out_max, i - run);
+        if (op < 0) {
+            break;
+        }
+        // A single unchanged byte costs two bytes of run and length, so it stays in the literal.
+        int lit = i;
+        while (i < len && !(in[i] == ref_byte(ref, ref_len, i) &&
+                            (i + 1 == len || in[i + 1] == ref_byte(ref, ref_len, i + 1)))) {
+            i++;
+        }
+        op = put_varint(out, op, out_max, i - lit);
+        if (op < 0 || op + (i - lit) > out_max) {
+            return 0;
+        }
+        for (int k = lit; k < i; k++) {
+            out[op++] = in[k] ^ ref_byte(ref, ref_len, k);
+        }
+    }
+    return op < 0 ? 0 : op;
+}
+
+int compress_delta_decode(const uint8_t *ref, int ref_len, const uint8_t *in, int len, uint8_t *out, int out_max)
+{
+    unsigned total;
+    int pos = get_varint(in, 0, len, &total);
+    if (pos < 0 || total > (unsigned)out_max) {
+        return 0;
+    }
+    unsigned o = 0;
+    while (o < total) {
+        unsigned run = total - o;
+        if (pos < len) {
+            pos = get_varint(in, pos, len, &run);
+        }
+        if (pos < 0 || run > total - o) {
+            return 0;
+        }
+        for (; run > 0; run--, o++) {
+            out[o] = ref_byte(ref, ref_len, o);
+        }
+        if (o == total) {
+            break;
+        }
+        unsigned lit;
+        pos = get_varint(in, pos, len, &lit);
+        if (pos < 0 || lit == 0 || lit > total - o || lit > (unsigned)(len - pos)) {
+            return 0;
+        }
+        for (; lit > 0; lit--, o++) {
+            out[o] = in[pos++] ^ ref_byte(ref, ref_len, o);
+        }
+    }
+    return pos == len ? (int)total : 0;
+}
+
+static unsigned lz_hash(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Appends one sequence; match_len 0 marks the last one. Returns the new output
+// position, or -1 if it does not fit.
+static int lz_put_sequence(uint8_t *out, int op, int out_max, const uint8_t *lit, int lit_len,
+                           int offset, int match_len)
+{
+    int match_code = match_len > 0 ? match_len - COMPRESS_LZ_MIN_MATCH : 0;
+    if (op >= out_max) {
+        return -1;
+    }
+    out[op++] = (uint8_t)(((lit_len < LZ_NIBBLE_MAX ? lit_len : LZ_NIBBLE_MAX) << 4) |
+                          (match_code < LZ_NIBBLE_MAX ? match_code : LZ_NIBBLE_MAX));
+    if (lit_len >= LZ_NIBBLE_MAX && (op = put_varint(out, op, out_max, lit_len - LZ_NIBBLE_MAX)) < 0) {
+        return -1;
+    }
+    if (op + lit_len > out_max) {
+        return -1;
+    }
+    memcpy(out + op, lit, lit_len);
+    op += lit_len;
+    if (match_len == 0) {
+        return op;
+    }
+    if (op >= out_max) {
+        return -1;
+    }
+    out[op++] = (uint8_t)offset;
+    if (match_code >= LZ_NIBBLE_MAX) {
+        op = put_varint(out, op, out_max, match_code - LZ_NIBBLE_MAX);
+    }
+    return op;
+}
+
+int compress_lz_encode(const uint8_t *in, int len, uint8_t *out, int out_max)
+{
+    int16_t table[1 << LZ_HASH_BITS];
+    for (int i = 0; i < (1 << LZ_HASH_BITS); i++) {
+        table[i] = -1;
+    }
+
+    int op = 0;
+    int anchor = 0;
+    int i = 0;
+    while (i + COMPRESS_LZ_MIN_MATCH <= len) {
+        unsigned h = lz_hash(in + i);
+        int candidate = table[h];
+        table[h] = (int16_t)i;
+        if (candidate < 0 || i - candidate > UINT8_MAX ||
+            memcmp(in + candidate, in + i, COMPRESS_LZ_MIN_MATCH) != 0) {
+            i++;
+            continue;
+        }
+        int match_len = COMPRESS_LZ_MIN_MATCH;
+        while (i + match_len < len && in[candidate + match_len] == in[i + match_len]) {
+            match_len++;
+        }
+        op = lz_put_sequence(out, op, out_max, in + anchor, i - anchor, i - candidate, match_len);
+        if (op < 0) {
+            return 0;
+        }
+        i += match_len;
+        anchor = i;
+    }
+    op = lz_put_sequence(out, op, out_max, in + anchor, len - anchor, 0, 0);
+    return op < 0 ? 0 : op;
+}
+
+int compress_lz_decode(const uint8_t *in, int len, uint8_t *out, int out_max)
+{
+    int ip = 0;
+    int op = 0;
+    while (ip < len) {
+        uint8_t token = in[ip++];
+        unsigned lit = token >> 4;
+        unsigned ext;
+        if (lit == LZ_NIBBLE_MAX) {
+            if ((ip = get_varint(in, ip, len, &ext)) < 0) {
+                return 0;
+            }
+            lit += ext;
+        }
+        if (lit > (unsigned)(len - ip) || lit > (unsigned)(out_max - op)) {
+            return 0;
+        }
+        memcpy(out + op, in + ip, lit);
+        ip += lit;
+        op += lit;
+        if (ip == len) {
+            return (token & 0x0F) == 0 ? op : 0;  // The last sequence has no match
+        }
+
+        unsigned offset = in[ip++];
+        unsigned match = token & 0x0F;
+        if (match == LZ_NIBBLE_MAX) {
+            if ((ip = get_varint(in, ip, len, &ext)) < 0) {
+                return 0;
+            }
+            match += ext;
+        }
+        match += COMPRESS_LZ_MIN_MATCH;
+        if (offset == 0 || offset > (unsigned)op || match > (unsigned)(out_max - op)) {
+            return 0;
+        }
+        // Byte by byte: a match may overlap the bytes it produces.
+        for (; match > 0; match--, op++) {
+            out[op] = out[op - offset];
+        }
+    }
+    return 0;
+}
+
+#if CONFIG_FRAME_COMPRESS
+void compress_history_init(compress_history_t *history)
+{
+    memset(history, 0, sizeof(*history));
+}
+
+void compress_history_put(compress_history_t *history, uint16_t seq, const uint8_t *data, int len)
+{
+    compress_ref_t *ref = &history->refs[history->next];
+    ref->seq = seq;
+    ref->len = (uint8_t)len;
+    ref->valid = true;
+    ref->acked = false;
+    memcpy(ref->data, data, len);
+    history->next = (history->next + 1) % COMPRESS_KEYFRAMES;
+}
+
+compress_ref_t *compress_history_find(compress_history_t *history, uint16_t seq)
+{
+    for (int i = 0; i < COMPRESS_KEYFRAMES; i++) {
+        if (history->refs[i].valid && history->refs[i].seq == seq) {
+            return &history->refs[i];
+        }
+    }
+    return NULL;
+}
+
+const compress_ref_t *compress_history_newest_acked(const compress_history_t *history)
+{
+    for (int k = 1; k <= COMPRESS_KEYFRAMES; k++) {
+        const compress_ref_t *ref = &history->refs[(history->next + COMPRESS_KEYFRAMES - k) % COMPRESS_KEYFRAMES];
+        if (ref->valid && ref->acked) {
+            return ref;
+        }
+    }
+    return NULL;
+}
+#endif
@@ -0,0 +1,68 @@
+/**
+ * compress.h
+ *
+ * Payload codecs of the framing layer (CONFIG_FRAME_COMPRESS). A compressed
+ * frame carries FRAME_FLAG_DELTA or FRAME_FLAG_LZ in its header:
+ *
+ *   delta:  back (1) | varint len | { varint zero_run, varint lit_len, lit_len bytes }... [varint zero_run]
+ *   lz:     { token, [varint], literals, offset (1), [varint] }...
+ *
+ * A delta payload is XORed with a reference payload the peer already holds,
+ * the frame back sequence numbers earlier, and the runs of zeros left by
+ * unchanged bytes are skipped; a trailing run may be left out. The LZ token
+ * holds the literal count in its high nibble and the match length minus
+ * COMPRESS_LZ_MIN_MATCH in its low one, each extended by a varint at 15; the
+ * last sequence has no match. The codecs are stateless; the references live
+ * in peer_t.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+#define COMPRESS_LZ_MIN_MATCH 4
+#define COMPRESS_KEYFRAMES 2        // Reference payloads kept per peer and direction
+#define COMPRESS_REF_MAX_AGE 32     // Frames a reference stays usable for, bounds the damage of a lost one
+
+/**
+ * Both encoders return the encoded length, or 0 if the result would not fit in
+ * out_max bytes. Pass the input length minus one to only accept a gain.
+ */
+int compress_delta_encode(const uint8_t *ref, int ref_len, const uint8_t *in, int len, uint8_t *out, int out_max);
+int compress_lz_encode(const uint8_t *in, int len, uint8_t *out, int out_max);
+
+/** Both decoders return the decoded length, or 0 if the input is malformed or does not fit in out_max. */
+int compress_delta_decode(const uint8_t *ref, int ref_len, const uint8_t *in, int len, uint8_t *out, int out_max);
+int compress_lz_decode(const uint8_t *in, int len, uint8_t *out, int out_max);
+
+#if CONFIG_FRAME_COMPRESS
+// Full DATA payloads ("keyframes") that deltas can refer to. The sender keeps
+// the ones it sent and uses the newest the peer acknowledged; the receiver
+// keeps the ones it got. Both sides store every unicast DATA frame sent in full,
+// so the two histories hold the same frames.
+typedef struct {
+    uint16_t seq;
+    uint8_t len;
+    bool valid;
+    bool acked;                     // Sender side: the peer acknowledged it, end to end with CONFIG_LINK_RELIABLE
+    uint8_t data[CONFIG_FRAME_COMPRESS_DELTA_MAX_LEN];
+} compress_ref_t;
+
+typedef struct {
+    compress_ref_t refs[COMPRESS_KEYFRAMES];
+    uint8_t next;                   // Entry the next keyframe replaces
+} compress_history_t;
+
+void compress_history_init(compress_history_t *history);
+
+/** Stores a keyframe, replacing the oldest. len must not exceed CONFIG_FRAME_COMPRESS_DELTA_MAX_LEN. */
+void compress_history_put(compress_history_t *history, uint16_t seq, const uint8_t *data, int len);
+
+/** Returns the keyframe sent with seq, or NULL if it is not kept. */
+compress_ref_t *compress_history_find(compress_history_t *history, uint16_t seq);
+
+/** Returns the most recent acknowledged keyframe, or NULL if there is none. */
+const compress_ref_t *compress_history_newest_acked(const compress_history_t *history);
+#endif
@@ -0,0 +1,182 @@
+/**
+ * discovery.c
+ *
+ * HELLO/HELLO-ACK discovery and the NVS peer cache (see discovery.h).
+ */
+
+#include <stdatomic.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "discovery.h"
+#include "frame.h"
+#include "mesh.h"
+#include "esp_now_link_priv.h"
+
+static const char *TAG = "DISCOVERY";
+
+#define DISCOVERY_BURST_START_MS 20 // First gap of a beacon burst, doubled after every beacon
+#define DISCOVERY_INTERVAL_MS 5000  // Steady beacon period once the burst is over
+#define PEER_CACHE_SIZE 8
+#define PEER_CACHE_NAMESPACE "esp_now_link"
+#define PEER_CACHE_KEY "peers"
+
+static const uint8_t broadcast_mac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static uint32_t boot_id;
+static esp_timer_handle_t beacon_timer;
+static atomic_int beacon_interval_ms;
+static TaskHandle_t peer_notify_task;
+
+// Most recently found peer first. Shared by the RX worker and the upkeep task.
+static uint8_t cache[PEER_CACHE_SIZE][6];
+static int cache_count;
+static bool cache_dirty;
+static portMUX_TYPE cache_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void send_hello(const uint8_t *mac, frame_type_t type)
+{
+    uint8_t payload[FRAME_MAX_PAYLOAD_LEN];
+    frame_hello_t hello = { .boot_id = boot_id };
+    link_session_hello(mac, &hello);
+    memcpy(payload, &hello, sizeof(hello));
+    int len = sizeof(hello) + mesh_write_routes(payload + sizeof(hello), sizeof(payload) - sizeof(hello));
+    send_message(mac, type, payload, len, TX_MSG_FLAG_FLUSH);
+}
+
+static void on_beacon_timer(void *arg)
+{
+    send_hello(broadcast_mac, FRAME_TYPE_DISCOVERY);
+
+    int interval_ms = atomic_load_explicit(&beacon_interval_ms, memory_order_relaxed);
+    esp_timer_start_once(beacon_timer, interval_ms * 1000LL);
+    int next_ms = interval_ms * 2 < DISCOVERY_INTERVAL_MS ? interval_ms * 2 : DISCOVERY_INTERVAL_MS;
+    atomic_compare_exchange_strong(&beacon_interval_ms, &interval_ms, next_ms);
+}
+
+static void load_cache(void)
+{
+    nvs_handle_t handle;
+    if (nvs_open(PEER_CACHE_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;                     // Nothing cached yet
+    }
+    size_t len = sizeof(cache);
+    if (nvs_get_blob(handle, PEER_CACHE_KEY, cache, &len) == ESP_OK) {
+        cache_count = len / sizeof(cache[0]);
+    }
+    nvs_close(handle);
+    ESP_LOGI(TAG, "%d cached peer(s)", cache_count);
+}
+
+uint32_t discovery_boot_id(void)
+{
+    return boot_id;
+}
+
+esp_err_t discovery_init(TaskHandle_t notify_task)
+{
+    peer_notify_task = notify_task;
+    boot_id = esp_random() | 1;     // 0 means "unknown" on the receiving side
+    atomic_store(&beacon_interval_ms, DISCOVERY_BURST_START_MS);
+    load_cache();
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = on_beacon_timer,
+        .name = "discovery",
+    };
+    return esp_timer_create(&timer_args, &beacon_timer);
+}
+
+int discovery_cached_peers(uint8_t macs[][6], int max)
+{
+    portENTER_CRITICAL(&cache_lock);
+    int count = cache_count < max ? cache_count : max;
+    memcpy(macs, cache, count * sizeof(cache[0]));
+    portEXIT_CRITICAL(&cache_lock);
+    return count;
+}
+
+void discovery_restart(void)
+{
+    esp_timer_stop(beacon_timer);
+    atomic_store(&beacon_interval_ms, DISCOVERY_BURST_START_MS);
+    on_beacon_timer(NULL);
+}
+
+void discovery_start(void)
+{
+    uint8_t macs[PEER_CACHE_SIZE][6];
+    int count = discovery_cached_peers(macs, PEER_CACHE_SIZE);
+    for (int i = 0; i < count; i++) {
+        send_hello(macs[i], FRAME_TYPE_DISCOVERY);
+    }
+    discovery_restart();
+}
+
+void discovery_peer_found(const uint8_t *mac)
+{
+    portENTER_CRITICAL(&cache_lock);
+    int index = 0;
+    while (index < cache_count && memcmp(cache[index], mac, 6) != 0) {
+        index++;
+    }
+    if (index == cache_count) {
+        cache_dirty = true;
+        if (cache_count < PEER_CACHE_SIZE) {
+            cache_count++;
+        } else {
+            index = PEER_CACHE_SIZE - 1; // Forget the least recently found peer
+        }
+    }
+    memmove(cache[1], cache[0], index * sizeof(cache[0]));
+    memcpy(cache[0], mac, 6);
+    portEXIT_CRITICAL(&cache_lock);
+
+    // Bursting only helps while nobody is around; fall back to the steady cadence.
+    atomic_store(&beacon_interval_ms, DISCOVERY_INTERVAL_MS);
+    if (peer_notify_task != NULL) {
+        xTaskNotifyGive(peer_notify_task);
+    }
+}
+
+void discovery_save_cache(void)
+{
+    uint8_t snapshot[PEER_CACHE_SIZE][6];
+    portENTER_CRITICAL(&cache_lock);
+    bool dirty = cache_dirty;
+    int count = cache_count;
+    memcpy(snapshot, cache, sizeof(snapshot));
+    cache_dirty = false;
+    portEXIT_CRITICAL(&cache_lock);
+    if (!dirty) {
+        return;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(PEER_CACHE_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret == ESP_OK) {
+        ret = nvs_set_blob(handle, PEER_CACHE_KEY, snapshot, count * sizeof(snapshot[0]));
+        if (ret == ESP_OK) {
+            ret = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to save peer cache: %s", esp_err_to_name(ret));
+    }
+}
+
+void discovery_send_ack(const uint8_t *mac)
+{
+    send_hello(mac, FRAME_TYPE_DISCOVERY_ACK);
+}
+
+void discovery_handle_rx(const uint8_t *src_mac, uint8_t type, const uint8_t *payload, int len)
+{
+    if (type == FRAME_TYPE_DISCOVERY) {
+        send_hello(src_mac, FRAME_TYPE_DISCOVERY_ACK);
+    }
+}
@@ -0,0 +1,42 @@
+/**
+ * discovery.h
+ *
+ * Peer discovery: HELLO beacons sent in a fast burst at boot that backs off to
+ * a slow steady cadence, HELLO-ACK replies so a booting node learns its
+ * neighbours from the first beacon that gets through, and a peer cache in NVS
+ * so known peers can be used before they have been heard from.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+
+/** Loads the peer cache. notify_task gets a task notification whenever a new peer is found. */
+esp_err_t discovery_init(TaskHandle_t notify_task);
+
+/** Random ID of this boot, sent in every HELLO. */
+uint32_t discovery_boot_id(void);
+
+/** Copies the cached peers, most recently found first, and returns how many there are. */
+int discovery_cached_peers(uint8_t macs[][6], int max);
+
+/** Sends HELLO to every cached peer and starts the boot beacon burst. */
+void discovery_start(void);
+
+/** Starts another beacon burst, for when every peer has been lost. */
+void discovery_restart(void);
+
+/** Called when a frame arrives from a peer that was not in the peer table. */
+void discovery_peer_found(const uint8_t *mac);
+
+/** Writes the peer cache to NVS if a new peer was found since the last call. */
+void discovery_save_cache(void);
+
+/** Sends a HELLO-ACK to mac, for a peer whose session handshake needs another round. */
+void discovery_send_ack(const uint8_t *mac);
+
+/** RX worker hook for FRAME_TYPE_DISCOVERY and FRAME_TYPE_DISCOVERY_ACK messages. */
+void discovery_handle_rx(const uint8_t *src_mac, uint8_t type, const uint8_t *payload, int len);
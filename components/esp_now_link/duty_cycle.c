@@ -0,0 +1,236 @@
+/**
+ * duty_cycle.c
+ *
+ * Wake window schedule and radio power save (see duty_cycle.h).
+ *
+ * ESP-NOW's own wake window only opens at an interval counted from each
+ * chip's boot, so two nodes cannot line their windows up with it. Instead the
+ * radio sits in modem sleep with a zero ESP-NOW wake window, and wake_timer
+ * turns power save off for the length of each scheduled window. With
+ * CONFIG_PM_ENABLE and tickless idle the CPU also light-sleeps in between.
+ */
+
+#include <stdatomic.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_now.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "sdkconfig.h"
+#if CONFIG_DUTY_CYCLE && CONFIG_PM_ENABLE && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+#include "esp_pm.h"
+#endif
+#include "duty_cycle.h"
+#include "frame.h"
+#include "esp_now_link_priv.h"
+
+#if CONFIG_DUTY_CYCLE
+
+static const char *TAG = "DUTY";
+
+#define DUTY_CYCLE_TX_GUARD_US 3000      // No new transmissions this close to the end of a window
+#define DUTY_CYCLE_SYNC_LOST_PERIODS 5   // Missed beacons before a follower stays awake again
+#define DUTY_CYCLE_MAX_WAKE_INTERVAL 65535 // ESP-NOW wake interval while asleep, in ms
+
+typedef struct __attribute__((packed)) {
+    uint16_t period_ms;
+    uint16_t window_ms;
+    uint32_t elapsed_us;    // Time since the window opened when the beacon was built
+} wake_schedule_t;
+
+static const uint8_t broadcast_mac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static uint8_t my_mac[6];
+static esp_timer_handle_t wake_timer;
+static atomic_bool coordinator;     // Set by duty_cycle_poll() from the peer list
+static atomic_bool awake = true;
+
+// Written by the RX worker and wake_timer, read by the sender task.
+static portMUX_TYPE schedule_lock = portMUX_INITIALIZER_UNLOCKED;
+static struct {
+    int64_t phase_us;       // Start of some window; all others follow every period_us
+    int64_t beacon_at_us;   // Last beacon from a lower MAC, -1 if none yet
+    uint32_t period_us;
+    uint32_t window_us;
+} schedule;
+
+typedef enum {
+    SCHEDULE_NONE,          // Not synchronized: keep the radio on
+    SCHEDULE_LEAD,
+    SCHEDULE_FOLLOW,
+} schedule_role_t;
+
+// Caller holds schedule_lock. Stores the position inside the period in *pos_us.
+static schedule_role_t schedule_role(int64_t now_us, int64_t *pos_us)
+{
+    schedule_role_t role;
+    if (schedule.beacon_at_us >= 0 &&
+        now_us - schedule.beacon_at_us < (int64_t)DUTY_CYCLE_SYNC_LOST_PERIODS * schedule.period_us) {
+        role = SCHEDULE_FOLLOW;
+    } else if (atomic_load(&coordinator)) {
+        role = SCHEDULE_LEAD;
+    } else {
+        role = SCHEDULE_NONE;
+    }
+    int64_t pos = (now_us - schedule.phase_us) % schedule.period_us;
+    *pos_us = pos < 0 ? pos + schedule.period_us : pos;
+    return role;
+}
+
+static void set_awake(bool on)
+{
+    if (atomic_exchange(&awake, on) == on) {
+        return;
+    }
+    esp_err_t ret = esp_wifi_set_ps(on ? WIFI_PS_NONE : WIFI_PS_MIN_MODEM);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to %s radio: %s", on ? "wake" : "sleep", esp_err_to_name(ret));
+    }
+    if (on) {
+        tx_resume();  // Send what was queued while asleep
+    }
+}
+
+static void send_beacon(int64_t pos_us)
+{
+    wake_schedule_t msg = {
+        .period_ms = CONFIG_DUTY_CYCLE_PERIOD_MS,
+        .window_ms = CONFIG_DUTY_CYCLE_WINDOW_MS,
+        .elapsed_us = (uint32_t)pos_us,
+    };
+    send_message(broadcast_mac, FRAME_TYPE_WAKE_SCHEDULE, &msg, sizeof(msg), TX_MSG_FLAG_FLUSH);
+}
+
+// Fires at every window edge and moves the radio in or out of power save.
+static void on_wake_timer(void *arg)
+{
+    int64_t now_us = esp_timer_get_time();
+    int64_t pos_us;
+    portENTER_CRITICAL(&schedule_lock);
+    schedule_role_t role = schedule_role(now_us, &pos_us);
+    uint32_t period_us = schedule.period_us;
+    uint32_t window_us = schedule.window_us;
+    portEXIT_CRITICAL(&schedule_lock);
+
+    if (role == SCHEDULE_NONE) {
+        set_awake(true);
+        esp_timer_start_once(wake_timer, period_us);
+        return;
+    }
+    bool in_window = pos_us < window_us;
+    set_awake(in_window);
+    if (in_window && role == SCHEDULE_LEAD && pos_us < DUTY_CYCLE_TX_GUARD_US) {
+        send_beacon(pos_us);
+    }
+    esp_timer_start_once(wake_timer, in_window ? window_us - pos_us : period_us - pos_us);
+}
+
+#endif // CONFIG_DUTY_CYCLE
+
+esp_err_t duty_cycle_init(void)
+{
+#if CONFIG_DUTY_CYCLE
+    esp_read_mac(my_mac, ESP_MAC_WIFI_STA);
+    schedule.phase_us = esp_timer_get_time();
+    schedule.beacon_at_us = -1;
+    schedule.period_us = CONFIG_DUTY_CYCLE_PERIOD_MS * 1000;
+    schedule.window_us = CONFIG_DUTY_CYCLE_WINDOW_MS * 1000;
+
+    esp_err_t ret = esp_now_set_wake_window(0);
+    if (ret == ESP_OK) {
+        ret = esp_wifi_connectionless_module_set_wake_interval(DUTY_CYCLE_MAX_WAKE_INTERVAL);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure ESP-NOW power save: %s", esp_err_to_name(ret));
+        return ret;
+    }
+#if CONFIG_PM_ENABLE && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+    const esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = CONFIG_XTAL_FREQ,
+        .light_sleep_enable = true,
+    };
+    ret = esp_pm_configure(&pm_config);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Light sleep not enabled: %s", esp_err_to_name(ret));
+    }
+#endif
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = on_wake_timer,
+        .name = "wake_window",
+    };
+    ret = esp_timer_create(&timer_args, &wake_timer);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    ESP_LOGI(TAG, "Awake %d ms every %d ms", CONFIG_DUTY_CYCLE_WINDOW_MS, CONFIG_DUTY_CYCLE_PERIOD_MS);
+    return esp_timer_start_once(wake_timer, schedule.period_us);
+#else
+    return ESP_OK;
+#endif
+}
+
+bool duty_cycle_tx_allowed(int64_t now_us)
+{
+#if CONFIG_DUTY_CYCLE
+    if (!atomic_load(&awake)) {
+        return false;
+    }
+    int64_t pos_us;
+    portENTER_CRITICAL(&schedule_lock);
+    schedule_role_t role = schedule_role(now_us, &pos_us);
+    int64_t last_start_us = (int64_t)schedule.window_us - DUTY_CYCLE_TX_GUARD_US;
+    portEXIT_CRITICAL(&schedule_lock);
+    return role == SCHEDULE_NONE || pos_us < last_start_us;
+#else
+    return true;
+#endif
+}
+
+void duty_cycle_poll(const uint8_t macs[][6], int peer_count)
+{
+#if CONFIG_DUTY_CYCLE
+    bool lowest = peer_count > 0;
+    for (int i = 0; i < peer_count; i++) {
+        if (memcmp(macs[i], my_mac, 6) < 0) {
+            lowest = false;
+        }
+    }
+    if (atomic_exchange(&coordinator, lowest) != lowest) {
+        ESP_LOGI(TAG, "%s the wake schedule", lowest ? "Leading" : "Following");
+    }
+#endif
+}
+
+void duty_cycle_handle_rx(const uint8_t *src_mac, uint8_t type, const uint8_t *payload, int len)
+{
+#if CONFIG_DUTY_CYCLE
+    wake_schedule_t msg;
+    if (wake_timer == NULL || type != FRAME_TYPE_WAKE_SCHEDULE || len != (int)sizeof(msg) ||
+        memcmp(src_mac, my_mac, 6) >= 0) {
+        return;  // Only the node with the lowest MAC sets the schedule
+    }
+    memcpy(&msg, payload, sizeof(msg));
+    if (msg.window_ms == 0 || msg.window_ms >= msg.period_ms || msg.elapsed_us >= msg.window_ms * 1000U) {
+        return;
+    }
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&schedule_lock);
+    bool first = schedule.beacon_at_us < 0;
+    schedule.phase_us = now_us - msg.elapsed_us;
+    schedule.beacon_at_us = now_us;
+    schedule.period_us = msg.period_ms * 1000;
+    schedule.window_us = msg.window_ms * 1000;
+    portEXIT_CRITICAL(&schedule_lock);
+    if (first) {
+        ESP_LOGI(TAG, "Following wake schedule of " MACSTR ": %u ms every %u ms", MAC2STR(src_mac),
+                 msg.window_ms, msg.period_ms);
+    }
+    // Re-arm at the edge of the window the beacon just opened.
+    esp_timer_stop(wake_timer);
+    esp_timer_start_once(wake_timer, msg.window_ms * 1000 - msg.elapsed_us);
+#endif
+}
@@ -0,0 +1,31 @@
+/**
+ * duty_cycle.h
+ *
+ * Duty-cycled radio for battery nodes. All peers keep the radio on for a
+ * window of CONFIG_DUTY_CYCLE_WINDOW_MS every CONFIG_DUTY_CYCLE_PERIOD_MS and
+ * let it sleep in between. The coordinator (lowest MAC, as in channel.h)
+ * broadcasts a FRAME_TYPE_WAKE_SCHEDULE beacon at the start of every window,
+ * and the other nodes align their windows to it. Frames queued while the radio
+ * sleeps are held by the sender task and go out as a burst when the next
+ * window opens. A node nobody has synchronized yet stays awake.
+ *
+ * Without CONFIG_DUTY_CYCLE the radio is always on and every call is a no-op.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+/** Configures power save and starts the schedule. Call once the sender task runs. */
+esp_err_t duty_cycle_init(void);
+
+/** True if the sender task may start a transmission at now_us. */
+bool duty_cycle_tx_allowed(int64_t now_us);
+
+/** Periodic housekeeping from the main loop: decides whether this node leads the schedule. */
+void duty_cycle_poll(const uint8_t macs[][6], int peer_count);
+
+/** RX worker hook for FRAME_TYPE_WAKE_SCHEDULE messages. */
+void duty_cycle_handle_rx(const uint8_t *src_mac, uint8_t type, const uint8_t *payload, int len);
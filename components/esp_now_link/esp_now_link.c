@@ -0,0 +1,1224 @@
+/**
+ * esp_now_link.c
+ *
+ * Core of the esp_now_link component: Wi-Fi and ESP-NOW bring-up, the peer
+ * table and its liveness timers, the RX worker that opens and dispatches
+ * frames, and the sender task that feeds the TX rings into the send window
+ * of tx_window.c.
+ */
+
+#include <string.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "esp_system.h"
+#include "esp_wifi.h"
+#include "esp_event.h"
+#include "esp_log.h"
+#include "esp_now.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "esp_now_link_priv.h"
+#include "frame.h"
+#include "batch.h"
+#include "peer_table.h"
+#include "link_timing.h"
+#include "rx_path.h"
+#include "esp_random.h"
+#include "benchmark.h"
+#include "bulk.h"
+#include "command.h"
+#include "frame_pool.h"
+#include "discovery.h"
+#include "duty_cycle.h"
+#include "channel.h"
+#include "phy_rate.h"
+#include "hot_log.h"
+#include "mesh.h"
+#include "link_crypto.h"
+#include "spsc_queue.h"
+#include "compress.h"
+#include "reliable.h"
+#include "link_trace.h"
+#include "tx_window.h"
+#include "link_transport.h"
+
+static const char *TAG = "ESP-NOW COMM";
+
+#define PEER_TIMEOUT_MS 10000       // 10 seconds
+#define PEER_KEEPALIVE_IDLE_MS 3000 // Probe a peer after this long without traffic either way
+#define TX_RING_SIZE 16             // Messages producers can queue per lane ahead of the sender task (power of two)
+#define SENDER_TASK_STACK_SIZE 4096
+#define RX_QUEUE_LEN 16             // Received frames that can wait for the RX worker (power of two)
+#define RX_TASK_STACK_SIZE 4096
+#define UPKEEP_TASK_STACK_SIZE 3072
+#define UPKEEP_INTERVAL_MS 1000     // Channel, discovery cache and duty cycle bookkeeping
+
+// Task topology (see "Task topology" in Kconfig): by default the Wi-Fi driver
+// and the upkeep task share core 0, while the sender task, the RX worker
+// and the command task encode, seal, decode and handle frames on core 1.
+// Frames cross cores only as frame_pool indices in lock-free queues.
+#define SENDER_TASK_CORE CONFIG_TX_TASK_CORE
+#define SENDER_TASK_PRIORITY CONFIG_TX_TASK_PRIORITY
+#define RX_TASK_CORE CONFIG_RX_TASK_CORE
+#define RX_TASK_PRIORITY CONFIG_RX_TASK_PRIORITY
+#define UPKEEP_TASK_CORE CONFIG_UPKEEP_TASK_CORE
+#define UPKEEP_TASK_PRIORITY CONFIG_UPKEEP_TASK_PRIORITY
+
+#if CONFIG_LINK_TRACE_DUMP_JSON
+#define TRACE_DUMP_FORMAT LINK_TRACE_FORMAT_JSON
+#else
+#define TRACE_DUMP_FORMAT LINK_TRACE_FORMAT_TEXT
+#endif
+
+static uint8_t broadcast_mac[ESP_NOW_ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static uint8_t my_mac_address[6];    // Global declaration of my_mac_address
+
+// Totals over all peers and the broadcast address.
+static link_counters_t link_counters;
+
+// Shared by rx_task, sender_task and the API calls; every access holds peers_lock.
+static peer_table_t peers;
+static portMUX_TYPE peers_lock = portMUX_INITIALIZER_UNLOCKED;
+static const link_transport_t *const transport = &link_transport_esp_now;
+
+// Locking and randomness for tx_window.c and rx_path.c.
+static void env_lock(void *ctx)
+{
+    portENTER_CRITICAL(&peers_lock);
+}
+
+static void env_unlock(void *ctx)
+{
+    portEXIT_CRITICAL(&peers_lock);
+}
+
+static uint32_t env_random(void *ctx)
+{
+    return esp_random();
+}
+
+// One-shot deadline per peer table index, see on_liveness_timer().
+static esp_timer_handle_t liveness_timers[PEER_TABLE_SIZE];
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    bool success;
+    int64_t done_at_us;
+} tx_done_event_t;
+
+typedef struct {
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    frame_ack_t ack;
+} tx_ack_event_t;
+
+// Window state is owned by sender_task; only the ring indices are shared.
+static tx_window_t tx_window;
+static esp_timer_handle_t batch_timer;
+static QueueHandle_t tx_done_queue;
+static TaskHandle_t sender_task_handle;
+
+// One ring per lane. Producers only advance head, sender_task only tail.
+// Producers on different tasks serialize on producer_lock; the consumer side
+// takes no lock.
+typedef struct {
+    tx_msg_t msgs[TX_RING_SIZE];
+    atomic_uint head;
+    atomic_uint tail;
+    portMUX_TYPE producer_lock;
+} tx_ring_t;
+
+static tx_ring_t tx_rings[TX_LANE_COUNT] = {
+    [TX_LANE_CONTROL] = { .producer_lock = portMUX_INITIALIZER_UNLOCKED },
+    [TX_LANE_BULK] = { .producer_lock = portMUX_INITIALIZER_UNLOCKED },
+};
+static SemaphoreHandle_t tx_space_sem;  // Given by sender_task whenever it frees ring slots
+// tx_ref_wait() blocks on TX_REF_RELEASED_BIT until the bulk ring's tail passes
+// tx_ref_waited, the ticket it waits for (0: nobody waits).
+#define TX_REF_RELEASED_BIT 0x01
+static EventGroupHandle_t tx_ref_events;
+static atomic_uint tx_ref_waited;
+
+// Received frames are copied once into a frame_pool buffer; only its index
+// travels through rx_queue, from the Wi-Fi task (the only producer) to rx_task.
+static spsc_queue_t rx_queue;
+static TaskHandle_t rx_task_handle;
+
+// Flow control: a receiver whose RX slots run low sends each active sender a
+// keepalive with the number of frames it may still send (frame_credit_t), and
+// an unlimited grant once rx_task has caught up. Set from the Wi-Fi task and
+// rx_task, consumed by sender_task.
+static atomic_bool rx_credit_updates_due;  // Some peer has rx_credit_due set
+static atomic_bool tx_credit_granted;      // A peer lifted or raised our limit
+
+#if CONFIG_LINK_RELIABLE
+// End-to-end ACKs: a reliable frame from a peer is acknowledged in the next
+// batch we send it, or in an ACK of its own once ack_timer fires. ACKs from
+// peers travel from rx_task to sender_task through tx_ack_queue.
+static esp_timer_handle_t ack_timer;
+static atomic_bool rx_ack_timer_armed;
+static atomic_bool rx_acks_due;            // ack_timer fired: send the ACKs still owed
+static QueueHandle_t tx_ack_queue;
+#endif
+
+// Replay windows, reliable accounting and message dispatch of received frames,
+// run by rx_task; the credit calls also come from the Wi-Fi and sender tasks.
+static rx_path_t rx_path;
+
+static void wifi_init(void)
+{
+#if !CONFIG_FAST_BOOT
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+#endif
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+#if CONFIG_FAST_BOOT
+    cfg.nvs_enable = 0;  // Everything is set again below, no need to load the last config from flash
+#endif
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(phy_rate_init());
+    ESP_ERROR_CHECK(esp_wifi_start());
+    ESP_ERROR_CHECK(channel_init());
+    atomic_store_explicit(&link_counters.radio_up_us, (unsigned)esp_timer_get_time(), memory_order_relaxed);
+}
+
+static void on_data_sent(const uint8_t *mac_addr, bool delivered)
+{
+    // Runs in the Wi-Fi task: just hand the result to the send window.
+    LINK_TRACE(LINK_TRACE_TX_DONE, delivered);
+    tx_done_event_t event = {
+        .success = delivered,
+        .done_at_us = esp_timer_get_time(),
+    };
+    memcpy(event.mac, mac_addr, ESP_NOW_ETH_ALEN);
+    if (xQueueSend(tx_done_queue, &event, 0) == pdTRUE) {
+        xTaskNotifyGive(sender_task_handle);
+    }
+}
+
+// Frames we can still take in: the shorter of the RX queue and the frame pool.
+static int rx_free_slots(void)
+{
+    int queue_free = RX_QUEUE_LEN - (int)spsc_queue_count(&rx_queue);
+    int pool_free = frame_pool_available();
+    return queue_free < pool_free ? queue_free : pool_free;
+}
+
+// Called for every received frame. Once the free slots drop to the low water
+// mark, the sender gets a credit update (sent by sender_task) before it
+// overruns us and its frames are dropped after the MAC layer acknowledged them.
+static void rx_credit_check(const uint8_t *src_mac)
+{
+    if (rx_path_credit_check(&rx_path, src_mac, rx_free_slots())) {
+        atomic_store_explicit(&rx_credit_updates_due, true, memory_order_release);
+        xTaskNotifyGive(sender_task_handle);
+    }
+}
+
+// Called by rx_task whenever it has drained the RX queue.
+static void rx_credit_recovered(void)
+{
+    if (rx_path_credit_recovered(&rx_path, rx_free_slots())) {
+        atomic_store_explicit(&rx_credit_updates_due, true, memory_order_release);
+        xTaskNotifyGive(sender_task_handle);
+    }
+}
+
+// Runs on sender_task: sends a keepalive with our current credit to every peer
+// that is due one.
+static void tx_send_credit_updates(void)
+{
+    uint8_t macs[PEER_TABLE_SIZE][ESP_NOW_ETH_ALEN];
+    frame_credit_t credit;
+    int count = rx_path_credit_updates(&rx_path, rx_free_slots(), macs, &credit);
+    for (int i = 0; i < count; i++) {
+        if (!send_message(macs[i], FRAME_TYPE_KEEPALIVE, &credit, sizeof(credit), TX_MSG_FLAG_FLUSH)) {
+            // Control ring full: try again on the next wake-up.
+            rx_path_credit_retry(&rx_path, macs[i]);
+            atomic_store_explicit(&rx_credit_updates_due, true, memory_order_release);
+        }
+    }
+}
+
+// A credit update from a peer we send to, carried by its keepalive.
+static void rx_env_credit_received(void *ctx, const uint8_t *mac, uint8_t credits)
+{
+    if (tx_window_credit_grant(&tx_window, mac, credits, esp_timer_get_time())) {
+        atomic_store_explicit(&tx_credit_granted, true, memory_order_release);
+        tx_resume();
+        if (tx_space_sem != NULL) {
+            xSemaphoreGive(tx_space_sem);  // Wakes esp_now_link_send_wait()
+        }
+    }
+}
+
+static void on_data_recv(const link_transport_rx_info_t *info, const uint8_t *data, int data_len)
+{
+    // Runs in the Wi-Fi task: copy the frame out and leave all processing to rx_task.
+    LINK_TRACE(LINK_TRACE_RX_RECV, link_trace_seq(data, data_len));
+    frame_buf_t *buf = NULL;
+    if (data_len <= 0 || data_len > ESP_NOW_MAX_DATA_LEN || (buf = frame_pool_alloc()) == NULL) {
+        LINK_STATS_INC(&link_counters, rx_dropped);
+        rx_credit_check(info->src_mac);
+        return;
+    }
+    LINK_STATS_INC(&link_counters, rx_frames);
+    LINK_STATS_ADD(&link_counters, rx_bytes, data_len);
+
+    memcpy(buf->mac, info->src_mac, ESP_NOW_ETH_ALEN);
+    memcpy(buf->dest_mac, info->dest_mac, ESP_NOW_ETH_ALEN);
+    buf->rssi = info->rssi;
+    buf->rx_at_us = esp_timer_get_time();
+    memcpy(buf->data, data, data_len);
+    buf->len = data_len;
+    uint8_t index = frame_pool_index(buf);
+    if (!spsc_queue_push(&rx_queue, index)) {
+        frame_pool_free(buf);
+        LINK_STATS_INC(&link_counters, rx_dropped);
+    } else {
+        xTaskNotifyGive(rx_task_handle);
+    }
+    rx_credit_check(info->src_mac);
+}
+
+static void log_rx_message(const uint8_t *src_mac, const uint8_t *data, int len, void *arg)
+{
+    HOT_LOGI(HOT_LOG_RX, TAG, "-->Received %d bytes from " MACSTR, len, MAC2STR(src_mac));
+}
+
+// Application messages (FRAME_TYPE_DATA) go here, see esp_now_link_register_rx_cb().
+static esp_now_link_rx_cb_t rx_cb = log_rx_message;
+static void *rx_cb_arg;
+
+static bool tx_forward(const uint8_t *next_hop, frame_buf_t *buf);
+
+#if CONFIG_LINK_RELIABLE
+static void rx_ack_arm(void)
+{
+    if (!atomic_exchange_explicit(&rx_ack_timer_armed, true, memory_order_acq_rel)) {
+        esp_timer_start_once(ack_timer, RELIABLE_ACK_DELAY_US);
+    }
+}
+
+static void rx_env_ack_owed(void *ctx)
+{
+    rx_ack_arm();
+}
+
+static void on_ack_timer(void *arg)
+{
+    atomic_store_explicit(&rx_ack_timer_armed, false, memory_order_release);
+    atomic_store_explicit(&rx_acks_due, true, memory_order_release);
+    tx_resume();
+}
+
+// An ACK record from a peer we send to, applied to the window by sender_task.
+static void rx_env_ack_received(void *ctx, const uint8_t *mac, const frame_ack_t *ack)
+{
+    tx_ack_event_t event;
+    memcpy(event.mac, mac, ESP_NOW_ETH_ALEN);
+    event.ack = *ack;
+    if (xQueueSend(tx_ack_queue, &event, 0) == pdTRUE) {
+        tx_resume();
+    }
+}
+#endif
+
+// Forwards a mesh message that shares its frame with others, so it cannot be
+// handed over like a frame of its own in rx_env_deliver().
+static void rx_mesh_batched(const uint8_t *prev_hop, const uint8_t *payload, int len)
+{
+    uint8_t next_hop[ESP_NOW_ETH_ALEN];
+    mesh_verdict_t verdict = mesh_handle_rx(prev_hop, payload, len, next_hop);
+    if (verdict == MESH_RX_FORWARD) {
+        uint8_t copy[FRAME_MAX_PAYLOAD_LEN];
+        memcpy(copy, payload, len);
+        mesh_prepare_forward(copy);
+        if (send_message(next_hop, FRAME_TYPE_MESH, copy, len, 0)) {
+            return;
+        }
+    }
+    if (verdict != MESH_RX_DONE) {
+        LINK_STATS_INC(&link_counters, fwd_dropped);
+    }
+}
+
+// The messages rx_path.c does not handle itself.
+static void rx_env_message(void *ctx, const frame_buf_t *buf, uint8_t type, const uint8_t *payload, int len)
+{
+    switch (type) {
+    case FRAME_TYPE_DATA:
+        rx_cb(buf->mac, payload, len, rx_cb_arg);
+        break;
+    case FRAME_TYPE_DISCOVERY:
+    case FRAME_TYPE_DISCOVERY_ACK:
+        discovery_handle_rx(buf->mac, type, payload, len);
+        if (len >= (int)sizeof(frame_hello_t)) {
+            mesh_handle_hello(buf->mac, buf->rssi, payload + sizeof(frame_hello_t),
+                              len - sizeof(frame_hello_t));
+        }
+        break;
+    case FRAME_TYPE_CHANNEL_SWITCH:
+        channel_handle_rx(buf->mac, type, payload, len);
+        break;
+    case FRAME_TYPE_WAKE_SCHEDULE:
+        duty_cycle_handle_rx(buf->mac, type, payload, len);
+        break;
+    case FRAME_TYPE_BENCH_PING:
+    case FRAME_TYPE_BENCH_PONG:
+    case FRAME_TYPE_BENCH_FLOOD:
+    case FRAME_TYPE_BENCH_FLOOD_END:
+    case FRAME_TYPE_BENCH_REPORT:
+        benchmark_handle_rx(buf->mac, type, payload, len);
+        break;
+    case FRAME_TYPE_FRAG:
+    case FRAME_TYPE_FRAG_ACK:
+        bulk_handle_rx(buf->mac, type, payload, len);
+        break;
+    case FRAME_TYPE_CMD:
+        command_handle_rx(buf->mac, payload, len);
+        break;
+    case FRAME_TYPE_MESH:
+        rx_mesh_batched(buf->mac, payload, len);
+        break;
+    default:
+        ESP_LOGW(TAG, "Unknown message type %u from " MACSTR, type, MAC2STR(buf->mac));
+        break;
+    }
+}
+
+static void liveness_arm(int index, int64_t delay_ms)
+{
+    esp_timer_stop(liveness_timers[index]);
+    esp_timer_start_once(liveness_timers[index], delay_ms * 1000);
+}
+
+static void register_peer(const uint8_t *mac)
+{
+    esp_err_t ret = transport->add_peer(transport->ctx, mac);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to add peer: %s", esp_err_to_name(ret));
+        return;
+    }
+    ret = phy_rate_apply(mac, phy_rate_initial());
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to set PHY rate for " MACSTR ": %s", MAC2STR(mac), esp_err_to_name(ret));
+    }
+}
+
+void link_session_hello(const uint8_t *mac_addr, frame_hello_t *hello)
+{
+    rx_path_hello(&rx_path, mac_addr, hello);
+}
+
+// Re-adds a peer cached from an earlier boot so messages can go out before it is heard from.
+static void restore_peer(const uint8_t *mac)
+{
+    bool created = false;
+    int index = -1;
+    portENTER_CRITICAL(&peers_lock);
+    peer_t *peer = peer_table_add(&peers, mac, &created);
+    if (peer != NULL) {
+        peer->last_seen_ms = esp_timer_get_time() / 1000;
+        if (created) {
+            phy_rate_state_init(&peer->rate);
+            rx_path_peer_added(&rx_path, peer);
+        }
+        index = peer_table_index(&peers, peer);
+    }
+    portEXIT_CRITICAL(&peers_lock);
+    if (created) {
+        ESP_LOGI(TAG, "Restored cached peer " MACSTR, MAC2STR(mac));
+        register_peer(mac);
+        liveness_arm(index, PEER_KEEPALIVE_IDLE_MS);
+    }
+}
+
+// Records a frame from a unicast source, registering the sender with the driver
+// when it is new. Evicts the least recently seen peer if the table is full.
+static void rx_env_peer_heard(void *ctx, const frame_buf_t *buf)
+{
+    uint8_t evicted_mac[ESP_NOW_ETH_ALEN];
+    bool evicted = false;
+    bool created = false;
+
+    portENTER_CRITICAL(&peers_lock);
+    peer_t *peer = peer_table_add(&peers, buf->mac, &created);
+    if (peer == NULL) {
+        memcpy(evicted_mac, peer_table_oldest(&peers)->mac, ESP_NOW_ETH_ALEN);
+        peer_table_remove(&peers, evicted_mac);
+        evicted = true;
+        peer = peer_table_add(&peers, buf->mac, &created);
+    }
+    peer->last_seen_ms = esp_timer_get_time() / 1000; // Liveness timer picks this up lazily
+    peer->rssi = buf->rssi;
+    if (created) {
+        phy_rate_state_init(&peer->rate);
+        rx_path_peer_added(&rx_path, peer);
+    }
+    int index = peer_table_index(&peers, peer);
+    portEXIT_CRITICAL(&peers_lock);
+
+    if (evicted) {
+        ESP_LOGI(TAG, "Peer table full. Evicting " MACSTR, MAC2STR(evicted_mac));
+        transport->del_peer(transport->ctx, evicted_mac);
+    }
+    if (created) {
+        ESP_LOGI(TAG, "****************");
+        ESP_LOGI(TAG, "PEER FOUND! MAC: " MACSTR, MAC2STR(buf->mac));
+        ESP_LOGI(TAG, "****************");
+
+        register_peer(buf->mac);
+        liveness_arm(index, PEER_KEEPALIVE_IDLE_MS);
+        discovery_peer_found(buf->mac);
+    }
+}
+
+static void rx_env_hello_owed(void *ctx, const uint8_t *mac)
+{
+    discovery_send_ack(mac);
+}
+
+// Hands a validated frame's messages to the application. Returns true if buf
+// was passed on to the sender task and must not be freed.
+static bool rx_env_deliver(void *ctx, frame_buf_t *buf)
+{
+    frame_header_t hdr;
+    const uint8_t *payload;
+    if (!frame_decode(buf->data, buf->len, &hdr, &payload)) {
+        return false;
+    }
+
+    if (hdr.type == FRAME_TYPE_MESH) {
+        // A mesh frame of its own is forwarded in place: only its headers change.
+        uint8_t next_hop[ESP_NOW_ETH_ALEN];
+        mesh_verdict_t verdict = mesh_handle_rx(buf->mac, payload, hdr.payload_len, next_hop);
+        if (verdict == MESH_RX_FORWARD) {
+            mesh_prepare_forward(buf->data + FRAME_HEADER_LEN);
+            if (tx_forward(next_hop, buf)) {
+                return true;
+            }
+        }
+        if (verdict != MESH_RX_DONE) {
+            LINK_STATS_INC(&link_counters, fwd_dropped);
+        }
+    } else if (!rx_path_dispatch(&rx_path, buf)) {
+        ESP_LOGW(TAG, "Dropping malformed batch from " MACSTR, MAC2STR(buf->mac));
+    }
+    return false;
+}
+
+static const rx_path_env_t rx_env = {
+    .peers = &peers,
+    .counters = &link_counters,
+    .own_mac = my_mac_address,
+    .lock = env_lock,
+    .unlock = env_unlock,
+    .random = env_random,
+    .peer_heard = rx_env_peer_heard,
+    .hello_owed = rx_env_hello_owed,
+#if CONFIG_LINK_RELIABLE
+    .ack_owed = rx_env_ack_owed,
+    .ack_received = rx_env_ack_received,
+#endif
+    .credit_received = rx_env_credit_received,
+    .deliver = rx_env_deliver,
+    .message = rx_env_message,
+};
+
+#if CONFIG_RX_REORDER
+static TickType_t rx_reorder_wait(void)
+{
+    int64_t deadline_us = rx_path_next_us(&rx_path);
+    int64_t remaining_us = deadline_us - esp_timer_get_time();
+    if (remaining_us <= 0) {
+        return 0;
+    }
+    TickType_t wait = pdMS_TO_TICKS((remaining_us + 999) / 1000);
+    return wait > 0 ? wait : 1;
+}
+#endif
+
+static void rx_task(void *arg)
+{
+    unsigned reported_drops = 0;
+    while (1) {
+        uint8_t index;
+        while (spsc_queue_pop(&rx_queue, &index)) {
+#if CONFIG_LINK_TRACE
+            uint16_t seq = link_trace_seq(frame_pool_at(index)->data, frame_pool_at(index)->len);
+            LINK_TRACE(LINK_TRACE_RX_DEQUEUE, seq);
+#endif
+            frame_buf_t *buf = frame_pool_at(index);
+            if (!rx_path_receive(&rx_path, buf, esp_timer_get_time())) {
+                frame_pool_free(buf);
+            }
+            LINK_TRACE(LINK_TRACE_RX_HANDLED, seq);
+        }
+        rx_path_expire(&rx_path, esp_timer_get_time());
+        rx_credit_recovered();
+
+        unsigned drops = atomic_load_explicit(&link_counters.rx_dropped, memory_order_relaxed);
+        if (drops != reported_drops) {
+            ESP_LOGW(TAG, "Frame pool or RX queue full, %u frame(s) dropped", drops - reported_drops);
+            reported_drops = drops;
+        }
+
+#if CONFIG_RX_REORDER
+        ulTaskNotifyTake(pdTRUE, rx_reorder_wait());
+#else
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+#endif
+    }
+}
+
+static esp_err_t init_rx_queue(void)
+{
+    spsc_queue_init(&rx_queue, RX_QUEUE_LEN);
+
+    if (xTaskCreatePinnedToCore(rx_task, "esp_now_rx", RX_TASK_STACK_SIZE, NULL,
+                                RX_TASK_PRIORITY, &rx_task_handle, RX_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create RX task");
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t init_esp_now(void)
+{
+    esp_err_t ret = transport->init(transport->ctx, on_data_sent, on_data_recv);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Error initializing ESP-NOW");
+        return ret;
+    }
+
+    // Add broadcast address as a peer
+    ret = transport->add_peer(transport->ctx, broadcast_mac);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to add broadcast peer");
+        return ret;
+    }
+    ret = phy_rate_apply(broadcast_mac, phy_rate_broadcast());
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set broadcast PHY rate: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    return ESP_OK;
+}
+
+static bool remove_peer(const uint8_t *mac_addr)
+{
+    portENTER_CRITICAL(&peers_lock);
+    peer_t *peer = peer_table_find(&peers, mac_addr);
+    int index = peer != NULL ? peer_table_index(&peers, peer) : -1;
+    if (peer != NULL) {
+        peer_table_remove(&peers, mac_addr);
+    }
+    bool none_left = peers.count == 0;
+    portEXIT_CRITICAL(&peers_lock);
+    if (index < 0) {
+        return false;
+    }
+    esp_timer_stop(liveness_timers[index]);
+    transport->del_peer(transport->ctx, mac_addr);
+    if (none_left) {
+        ESP_LOGI(TAG, "All peers lost. Restarting discovery burst.");
+        discovery_restart();
+    }
+    return true;
+}
+
+int esp_now_link_get_peers(uint8_t macs[][ESP_NOW_ETH_ALEN], int max)
+{
+    int count = 0;
+    portENTER_CRITICAL(&peers_lock);
+    for (int i = 0; i < PEER_TABLE_SIZE && count < max; i++) {
+        const peer_t *peer = peer_table_at(&peers, i);
+        if (peer != NULL) {
+            memcpy(macs[count++], peer->mac, ESP_NOW_ETH_ALEN);
+        }
+    }
+    portEXIT_CRITICAL(&peers_lock);
+    return count;
+}
+
+// Outcome of the application's messages, see esp_now_link_register_tx_cb().
+static esp_now_link_tx_cb_t tx_cb;
+static void *tx_cb_arg;
+
+// Bumps `field` in the global counters and in mac_addr's peer entry, if any.
+#define COUNT_LINK_EVENT(mac_addr, field) do {                      \
+        LINK_STATS_INC(&link_counters, field);                      \
+        portENTER_CRITICAL(&peers_lock);                            \
+        peer_t *peer_ = peer_table_find(&peers, (mac_addr));        \
+        if (peer_ != NULL) {                                        \
+            LINK_STATS_INC(&peer_->counters, field);                \
+        }                                                           \
+        portEXIT_CRITICAL(&peers_lock);                             \
+    } while (0)
+
+static bool tx_env_allowed(void *ctx, int64_t now_us)
+{
+    return duty_cycle_tx_allowed(now_us);
+}
+
+// Rate adaptation: a new rung takes effect through esp_now_set_peer_rate_config().
+static void tx_env_attempt_done(void *ctx, const uint8_t *mac, bool delivered)
+{
+    int new_rate = -1;
+    portENTER_CRITICAL(&peers_lock);
+    peer_t *peer = peer_table_find(&peers, mac);
+    if (peer != NULL && phy_rate_on_result(&peer->rate, delivered)) {
+        new_rate = peer->rate.index;
+    }
+    portEXIT_CRITICAL(&peers_lock);
+
+    if (new_rate >= 0) {
+        ESP_LOGI(TAG, "PHY rate for " MACSTR " now %s", MAC2STR(mac), phy_rate_name(new_rate));
+        phy_rate_apply(mac, new_rate);
+    }
+}
+
+static bool tx_env_peer_failed(void *ctx, const uint8_t *mac)
+{
+    return remove_peer(mac);
+}
+
+static void tx_env_finished(void *ctx, const uint8_t *mac, uint32_t first_id, uint32_t last_id, bool delivered)
+{
+    if (tx_cb != NULL) {
+        tx_cb(mac, first_id, last_id, delivered, tx_cb_arg);
+    }
+}
+
+static const tx_window_env_t tx_env = {
+    .transport = &link_transport_esp_now,
+    .peers = &peers,
+    .counters = &link_counters,
+    .own_mac = my_mac_address,
+    .lock = env_lock,
+    .unlock = env_unlock,
+    .random = env_random,
+    .tx_allowed = tx_env_allowed,
+    .attempt_done = tx_env_attempt_done,
+    .peer_failed = tx_env_peer_failed,
+    .finished = tx_env_finished,
+};
+
+// Moves queued messages from one lane's ring into batches. Returns true if any
+// ring slot was freed.
+static bool tx_ring_drain(tx_lane_t lane, int64_t now_us)
+{
+    tx_ring_t *ring = &tx_rings[lane];
+    unsigned start = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    unsigned tail = start;
+    while (tail != head) {
+        const tx_msg_t *msg = &ring->msgs[tail % TX_RING_SIZE];
+        if (!tx_window_append(&tx_window, msg, lane, now_us)) {
+            break;
+        }
+        if (msg->type != 0) {
+            COUNT_LINK_EVENT(msg->mac, tx_queued);
+        }
+        tail++;
+    }
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    unsigned waited = atomic_load_explicit(&tx_ref_waited, memory_order_acquire);
+    if (lane == TX_LANE_BULK && waited != 0 && (int)(tail - waited) >= 0 &&
+        atomic_compare_exchange_strong(&tx_ref_waited, &waited, 0)) {
+        xEventGroupSetBits(tx_ref_events, TX_REF_RELEASED_BIT);
+    }
+    return tail != start;
+}
+
+// Drain the control ring, then the bulk ring, close the batches that are due
+// and arm batch_timer for the next deadline.
+static void tx_window_fill(int64_t now_us)
+{
+    bool freed = tx_ring_drain(TX_LANE_CONTROL, now_us);
+    freed |= tx_ring_drain(TX_LANE_BULK, now_us);
+    if (freed) {
+        xSemaphoreGive(tx_space_sem);
+    }
+
+    int64_t next_flush_us = tx_window_flush(&tx_window, now_us);
+    esp_timer_stop(batch_timer);
+    if (next_flush_us >= 0) {
+        esp_timer_start_once(batch_timer, next_flush_us - now_us);
+    }
+}
+
+static void on_batch_timer(void *arg)
+{
+    xTaskNotifyGive(sender_task_handle);
+}
+
+void tx_resume(void)
+{
+    if (sender_task_handle != NULL) {
+        xTaskNotifyGive(sender_task_handle);
+    }
+}
+
+// Time until the earliest retransmission or send report deadline of the
+// window. Open batches are woken by batch_timer, which has microsecond resolution.
+static TickType_t tx_window_next_wait(int64_t now_us)
+{
+    int64_t next_us = tx_window_next_us(&tx_window, now_us);
+    if (next_us < 0) {
+        return portMAX_DELAY;
+    }
+    // Round up so the task never wakes just before the deadline.
+    int64_t remaining_ms = next_us > now_us ? (next_us - now_us + 999) / 1000 : 0;
+    TickType_t wait = pdMS_TO_TICKS(remaining_ms);
+    return wait > 0 ? wait : 1;
+}
+
+// Owns the send window: drains the TX rings into it, hands it send reports
+// and ACKs, and sleeps until its next deadline.
+static void sender_task(void *arg)
+{
+    while (1) {
+        tx_done_event_t event;
+        while (xQueueReceive(tx_done_queue, &event, 0) == pdTRUE) {
+            tx_window_sent(&tx_window, event.mac, event.success, event.done_at_us);
+        }
+
+        int64_t now_us = esp_timer_get_time();
+#if CONFIG_LINK_RELIABLE
+        tx_ack_event_t ack_event;
+        while (xQueueReceive(tx_ack_queue, &ack_event, 0) == pdTRUE) {
+            tx_window_ack(&tx_window, ack_event.mac, &ack_event.ack);
+        }
+        if (atomic_exchange_explicit(&rx_acks_due, false, memory_order_acquire) &&
+            !tx_window_send_acks(&tx_window, now_us)) {
+            rx_ack_arm();  // Window full: try again after another delay
+        }
+#endif
+
+        if (atomic_exchange_explicit(&rx_credit_updates_due, false, memory_order_acquire)) {
+            tx_send_credit_updates();
+        }
+        if (atomic_exchange_explicit(&tx_credit_granted, false, memory_order_acquire)) {
+            tx_window_credit_resume(&tx_window, now_us);
+        }
+        tx_window_fill(now_us);
+        tx_window_service(&tx_window, now_us);
+
+        ulTaskNotifyTake(pdTRUE, tx_window_next_wait(esp_timer_get_time()));
+    }
+}
+
+// ticket receives the message's position in the ring, for tx_ref_wait(), and
+// msg_id the ID of a DATA message. The ID is taken under the producer lock, so
+// a peer's IDs follow ring order.
+static bool tx_ring_push(tx_lane_t lane, const uint8_t *mac_addr, uint8_t type, const void *payload, int len,
+                         const void *ref, int ref_len, uint8_t flags, uint32_t *ticket, uint32_t *msg_id)
+{
+    tx_ring_t *ring = &tx_rings[lane];
+    portENTER_CRITICAL(&ring->producer_lock);
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= TX_RING_SIZE) {
+        portEXIT_CRITICAL(&ring->producer_lock);
+        return false;
+    }
+
+    tx_msg_t *msg = &ring->msgs[head % TX_RING_SIZE];
+    memcpy(msg->mac, mac_addr, ESP_NOW_ETH_ALEN);
+    msg->type = type;
+    msg->flags = flags;
+    msg->len = len;
+    if (len > 0) {
+        memcpy(msg->data, payload, len);
+    }
+    msg->ref = ref;
+    msg->ref_len = ref_len;
+    msg->frame = NULL;
+    msg->id = type == FRAME_TYPE_DATA ? tx_window_next_msg_id(&tx_window, mac_addr) : 0;
+    uint32_t id = msg->id;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    portEXIT_CRITICAL(&ring->producer_lock);
+
+    if (ticket != NULL) {
+        *ticket = head + 1;
+    }
+    if (msg_id != NULL) {
+        *msg_id = id;
+    }
+    tx_resume();
+    return true;
+}
+
+// Queues a received mesh frame for next_hop. The payload stays where it is in
+// buf, which passes to the sender task unless the bulk ring is full.
+static bool tx_forward(const uint8_t *next_hop, frame_buf_t *buf)
+{
+    frame_header_t hdr;
+    memcpy(&hdr, buf->data, FRAME_HEADER_LEN);
+    tx_ring_t *ring = &tx_rings[TX_LANE_BULK];
+    portENTER_CRITICAL(&ring->producer_lock);
+    unsigned head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail >= TX_RING_SIZE) {
+        portEXIT_CRITICAL(&ring->producer_lock);
+        return false;
+    }
+
+    tx_msg_t *msg = &ring->msgs[head % TX_RING_SIZE];
+    memcpy(msg->mac, next_hop, ESP_NOW_ETH_ALEN);
+    msg->type = FRAME_TYPE_MESH;
+    msg->flags = 0;
+    msg->len = hdr.payload_len;
+    msg->ref = NULL;
+    msg->ref_len = 0;
+    msg->frame = buf;
+    msg->id = 0;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    portEXIT_CRITICAL(&ring->producer_lock);
+    tx_resume();
+    return true;
+}
+
+static bool tx_ring_push_wait(tx_lane_t lane, const uint8_t *mac_addr, uint8_t type, const void *payload, int len,
+                              const void *ref, int ref_len, uint8_t flags, TickType_t timeout, uint32_t *ticket)
+{
+    TickType_t start = xTaskGetTickCount();
+    while (!tx_ring_push(lane, mac_addr, type, payload, len, ref, ref_len, flags, ticket, NULL)) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout || xSemaphoreTake(tx_space_sem, timeout - elapsed) != pdTRUE) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Delivery failures after the lane's last attempt are reported through
+// the send window in the sender task (see tx_window.h).
+bool send_message(const uint8_t *mac_addr, frame_type_t type, const void *payload, int len, uint8_t flags)
+{
+    if (len < 0 || len > FRAME_MAX_PAYLOAD_LEN) {
+        return false;
+    }
+    return tx_ring_push(tx_lane_for(type), mac_addr, type, payload, len, NULL, 0, flags, NULL, NULL);
+}
+
+bool send_message_wait(const uint8_t *mac_addr, frame_type_t type, const void *payload, int len, uint8_t flags,
+                       TickType_t timeout)
+{
+    if (len < 0 || len > FRAME_MAX_PAYLOAD_LEN) {
+        return false;
+    }
+    return tx_ring_push_wait(tx_lane_for(type), mac_addr, type, payload, len, NULL, 0, flags, timeout, NULL);
+}
+
+_Static_assert(ESP_NOW_LINK_FLAG_FLUSH == TX_MSG_FLAG_FLUSH, "public flags map onto TX message flags");
+_Static_assert(ESP_NOW_LINK_MAX_PEERS == PEER_TABLE_SIZE, "public peer limit matches the peer table");
+
+esp_err_t esp_now_link_send_id(const uint8_t *peer_mac, const void *data, int len, uint8_t flags, uint32_t *msg_id)
+{
+    if (len < 0 || len > ESP_NOW_LINK_MAX_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (!tx_window_credit_available(&tx_window, peer_mac, esp_timer_get_time())) {
+        return ESP_ERR_NOW_LINK_NO_CREDIT;
+    }
+    bool queued = tx_ring_push(tx_lane_for(FRAME_TYPE_DATA), peer_mac, FRAME_TYPE_DATA, data, len, NULL, 0, flags, NULL,
+                               msg_id);
+    return queued ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_now_link_send(const uint8_t *peer_mac, const void *data, int len, uint8_t flags)
+{
+    return esp_now_link_send_id(peer_mac, data, len, flags, NULL);
+}
+
+esp_err_t esp_now_link_send_wait(const uint8_t *peer_mac, const void *data, int len, uint8_t flags,
+                                 TickType_t timeout)
+{
+    if (len < 0 || len > ESP_NOW_LINK_MAX_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    // Wait for credit first, so the message does not sit in the ring behind a stalled peer.
+    TickType_t start = xTaskGetTickCount();
+    TickType_t probe_ticks = pdMS_TO_TICKS(TX_CREDIT_PROBE_US / 1000);
+    while (!tx_window_credit_available(&tx_window, peer_mac, esp_timer_get_time())) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout) {
+            return ESP_ERR_NOW_LINK_NO_CREDIT;
+        }
+        TickType_t wait = timeout - elapsed;
+        xSemaphoreTake(tx_space_sem, wait < probe_ticks ? wait : (probe_ticks > 0 ? probe_ticks : 1));
+    }
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    if (elapsed >= timeout) {
+        elapsed = timeout;
+    }
+    return send_message_wait(peer_mac, FRAME_TYPE_DATA, data, len, flags, timeout - elapsed) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+void esp_now_link_register_rx_cb(esp_now_link_rx_cb_t cb, void *arg)
+{
+    rx_cb_arg = arg;
+    rx_cb = (cb != NULL) ? cb : log_rx_message;
+}
+
+void esp_now_link_register_tx_cb(esp_now_link_tx_cb_t cb, void *arg)
+{
+    tx_cb_arg = arg;
+    tx_cb = cb;
+}
+
+bool send_message_ref(const uint8_t *mac_addr, frame_type_t type, const void *header, int header_len,
+                      const void *data, int data_len, TickType_t timeout, uint32_t *ticket)
+{
+    if (header_len < 0 || data_len <= 0 || header_len + data_len > FRAME_MAX_PAYLOAD_LEN) {
+        return false;
+    }
+    // Tickets count positions in the bulk ring, so referenced messages always use it.
+    return tx_ring_push_wait(TX_LANE_BULK, mac_addr, type, header, header_len, data, data_len, 0, timeout, ticket);
+}
+
+static bool tx_ref_released(uint32_t ticket)
+{
+    unsigned tail = atomic_load_explicit(&tx_rings[TX_LANE_BULK].tail, memory_order_acquire);
+    return (int)(tail - ticket) >= 0;
+}
+
+void tx_ref_wait(uint32_t ticket)
+{
+    // Publish the ticket before checking, so a drain in between still sets the bit.
+    xEventGroupClearBits(tx_ref_events, TX_REF_RELEASED_BIT);
+    atomic_store_explicit(&tx_ref_waited, ticket, memory_order_release);
+    while (!tx_ref_released(ticket)) {
+        xEventGroupWaitBits(tx_ref_events, TX_REF_RELEASED_BIT, pdTRUE, pdFALSE, portMAX_DELAY);
+    }
+    atomic_store_explicit(&tx_ref_waited, 0, memory_order_relaxed);
+}
+
+bool flush_messages(const uint8_t *mac_addr)
+{
+    // A flush closes the batch of the lane it travels in, so send one down each.
+    bool queued = tx_ring_push(TX_LANE_CONTROL, mac_addr, 0, NULL, 0, NULL, 0, 0, NULL, NULL);
+    return tx_ring_push(TX_LANE_BULK, mac_addr, 0, NULL, 0, NULL, 0, 0, NULL, NULL) && queued;
+}
+
+bool esp_now_link_get_stats(const uint8_t *mac_addr, link_stats_t *stats)
+{
+    if (mac_addr == NULL) {
+        link_stats_snapshot(&link_counters, stats);
+        return true;
+    }
+    portENTER_CRITICAL(&peers_lock);
+    const peer_t *peer = peer_table_find(&peers, mac_addr);
+    if (peer != NULL) {
+        link_stats_snapshot(&peer->counters, stats);
+    }
+    portEXIT_CRITICAL(&peers_lock);
+    return peer != NULL;
+}
+
+static void dump_stats(const uint8_t macs[][ESP_NOW_ETH_ALEN], int peer_count)
+{
+    char line[640];
+    link_stats_t stats;
+
+    esp_now_link_get_stats(NULL, &stats);
+    link_stats_format(&stats, line, sizeof(line));
+    ESP_LOGI(TAG, "STATS all %s", line);
+    ESP_LOGI(TAG, "STATS pool free=%d low_water=%d size=%d", frame_pool_available(), frame_pool_low_water(), FRAME_POOL_SIZE);
+
+    for (int i = 0; i < peer_count; i++) {
+        if (esp_now_link_get_stats(macs[i], &stats)) {
+            link_stats_format(&stats, line, sizeof(line));
+            ESP_LOGI(TAG, "STATS " MACSTR " %s", MAC2STR(macs[i]), line);
+        }
+    }
+}
+
+// Prints the boot metric once the first frame has gone out. Returns true once it has.
+static bool report_boot_time(void)
+{
+    link_stats_t stats;
+    esp_now_link_get_stats(NULL, &stats);
+    if (stats.first_tx_us == 0) {
+        return false;
+    }
+    printf("BOOT,radio_up_us=%lu,first_tx_us=%lu\n", (unsigned long)stats.radio_up_us, (unsigned long)stats.first_tx_us);
+    return true;
+}
+
+// Slow-path bookkeeping off the hot paths: saving the
+// peer cache, channel and duty cycle coordination, and the periodic stats dump.
+static void upkeep_task(void *arg)
+{
+    uint8_t macs[PEER_TABLE_SIZE][ESP_NOW_ETH_ALEN];
+    bool boot_reported = false;
+    int64_t next_stats_us = esp_timer_get_time() + CONFIG_STATS_DUMP_INTERVAL_S * 1000000LL;
+#if CONFIG_LINK_TRACE
+    int64_t next_trace_us = esp_timer_get_time() + CONFIG_LINK_TRACE_DUMP_INTERVAL_S * 1000000LL;
+#endif
+
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(UPKEEP_INTERVAL_MS));
+
+        int peer_count = esp_now_link_get_peers(macs, PEER_TABLE_SIZE);
+        discovery_save_cache();
+        channel_poll(macs, peer_count);
+        duty_cycle_poll(macs, peer_count);
+
+        if (!boot_reported) {
+            boot_reported = report_boot_time();
+        }
+
+        if (CONFIG_STATS_DUMP_INTERVAL_S > 0 && esp_timer_get_time() >= next_stats_us) {
+            dump_stats(macs, peer_count);
+            next_stats_us += CONFIG_STATS_DUMP_INTERVAL_S * 1000000LL;
+        }
+#if CONFIG_LINK_TRACE
+        if (CONFIG_LINK_TRACE_DUMP_INTERVAL_S > 0 && esp_timer_get_time() >= next_trace_us) {
+            link_trace_dump(TRACE_DUMP_FORMAT);
+            next_trace_us += CONFIG_LINK_TRACE_DUMP_INTERVAL_S * 1000000LL;
+        }
+#endif
+    }
+}
+
+// Fires at a peer's keepalive or eviction deadline. RX does not re-arm the timer
+// per frame, it only bumps last_seen_ms; the timer re-arms itself for whatever
+// is left of the idle period, so a busy link costs one timer event per period.
+static void on_liveness_timer(void *arg)
+{
+    int index = (int)(intptr_t)arg;
+    uint8_t mac[ESP_NOW_ETH_ALEN];
+    int64_t idle_ms = 0;
+
+    portENTER_CRITICAL(&peers_lock);
+    const peer_t *peer = peer_table_at(&peers, index);
+    if (peer != NULL) {
+        memcpy(mac, peer->mac, ESP_NOW_ETH_ALEN);
+        idle_ms = esp_timer_get_time() / 1000 - peer->last_seen_ms;
+    }
+    portEXIT_CRITICAL(&peers_lock);
+    if (peer == NULL) {
+        return;
+    }
+
+    if (idle_ms >= PEER_TIMEOUT_MS) {
+        ESP_LOGW(TAG, "Peer " MACSTR " timed out. Removing peer.", MAC2STR(mac));
+        remove_peer(mac);
+    } else if (idle_ms >= PEER_KEEPALIVE_IDLE_MS) {
+        frame_credit_t credit = { .credits = rx_path_credit_value(rx_free_slots(), 1) };
+        send_message(mac, FRAME_TYPE_KEEPALIVE, &credit, sizeof(credit), TX_MSG_FLAG_FLUSH);
+        int64_t left_ms = PEER_TIMEOUT_MS - idle_ms;
+        liveness_arm(index, left_ms < PEER_KEEPALIVE_IDLE_MS ? left_ms : PEER_KEEPALIVE_IDLE_MS);
+    } else {
+        liveness_arm(index, PEER_KEEPALIVE_IDLE_MS - idle_ms);
+    }
+}
+
+static esp_err_t init_liveness_timers(void)
+{
+    for (int i = 0; i < PEER_TABLE_SIZE; i++) {
+        const esp_timer_create_args_t timer_args = {
+            .callback = on_liveness_timer,
+            .arg = (void *)(intptr_t)i,
+            .name = "peer_liveness",
+        };
+        esp_err_t ret = esp_timer_create(&timer_args, &liveness_timers[i]);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_now_link_init(const esp_now_link_config_t *config)
+{
+    static bool started;
+    if (started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    started = true;
+    ESP_LOGI(TAG, "Initializing...");
+
+    esp_read_mac(my_mac_address, ESP_MAC_WIFI_STA);
+    hot_log_init();
+    frame_pool_init();
+    peer_table_init(&peers);
+    ESP_ERROR_CHECK(init_liveness_timers());
+    tx_window_init(&tx_window, &tx_env);
+    rx_path_init(&rx_path, &rx_env);
+    ESP_ERROR_CHECK(bulk_init());
+    ESP_ERROR_CHECK(command_init());
+    ESP_ERROR_CHECK(mesh_init());
+    ESP_ERROR_CHECK(discovery_init(config != NULL ? config->peer_notify_task : NULL));
+    // The RX worker may acknowledge frames as soon as it starts.
+#if CONFIG_LINK_RELIABLE
+    tx_ack_queue = xQueueCreate(TX_WINDOW_SIZE, sizeof(tx_ack_event_t));
+    if (tx_ack_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create ACK queue");
+        return ESP_ERR_NO_MEM;
+    }
+    const esp_timer_create_args_t ack_timer_args = {
+        .callback = on_ack_timer,
+        .name = "ack_delay",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&ack_timer_args, &ack_timer));
+#endif
+
+    // The send callback and the RX worker hand work to the sender task from the
+    // moment the transport is up, so it has to exist first.
+    tx_done_queue = xQueueCreate(TX_WINDOW_SIZE, sizeof(tx_done_event_t));
+    tx_space_sem = xSemaphoreCreateBinary();
+    tx_ref_events = xEventGroupCreate();
+    if (tx_done_queue == NULL || tx_space_sem == NULL || tx_ref_events == NULL) {
+        ESP_LOGE(TAG, "Failed to create send queue");
+        return ESP_ERR_NO_MEM;
+    }
+
+    const esp_timer_create_args_t batch_timer_args = {
+        .callback = on_batch_timer,
+        .name = "batch_flush",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&batch_timer_args, &batch_timer));
+
+    if (xTaskCreatePinnedToCore(sender_task, "esp_now_tx", SENDER_TASK_STACK_SIZE, NULL,
+                                SENDER_TASK_PRIORITY, &sender_task_handle, SENDER_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create sender task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    wifi_init();
+    ESP_ERROR_CHECK(init_rx_queue());
+    ESP_ERROR_CHECK(init_esp_now());
+
+    ESP_ERROR_CHECK(duty_cycle_init());
+
+    if (xTaskCreatePinnedToCore(upkeep_task, "link_upkeep", UPKEEP_TASK_STACK_SIZE, NULL, UPKEEP_TASK_PRIORITY,
+                                NULL, UPKEEP_TASK_CORE) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create upkeep task");
+        return ESP_ERR_NO_MEM;
+    }
+
+    char my_mac_str[18];
+    snprintf(my_mac_str, sizeof(my_mac_str), MACSTR, MAC2STR(my_mac_address));
+    ESP_LOGI(TAG, "-----------------------------------------------");
+    ESP_LOGI(TAG, "My MAC Address: %s", my_mac_str);
+    ESP_LOGI(TAG, "-----------------------------------------------");
+
+    uint8_t cached[PEER_TABLE_SIZE][ESP_NOW_ETH_ALEN];
+    int cached_count = discovery_cached_peers(cached, PEER_TABLE_SIZE);
+    for (int i = 0; i < cached_count; i++) {
+        restore_peer(cached[i]);
+    }
+    discovery_start();
+    return ESP_OK;
+}
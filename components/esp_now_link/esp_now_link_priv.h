@@ -0,0 +1,58 @@
+/**
+ * esp_now_link_priv.h
+ *
+ * Internal send API of the ESP-NOW link for the other modules of the component.
+ * Messages are queued for the sender task, which batches, transmits and retries
+ * them. Applications use esp_now_link.h instead.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_now_link.h"
+#include "frame.h"
+#include "link_stats.h"
+#include "tx_window.h"
+
+/**
+ * Queues a message without blocking. Messages to the same destination are
+ * coalesced into one frame until it is full, the batch deadline passes or the
+ * message carries TX_MSG_FLAG_FLUSH. Returns false if the TX ring is full.
+ */
+bool send_message(const uint8_t *mac_addr, frame_type_t type, const void *payload, int len, uint8_t flags);
+
+/** Like send_message(), but waits up to timeout ticks for room in the TX ring. */
+bool send_message_wait(const uint8_t *mac_addr, frame_type_t type, const void *payload, int len, uint8_t flags,
+                       TickType_t timeout);
+
+/**
+ * Queues a message whose payload is header followed by data_len bytes of data.
+ * data is not copied into the TX ring: the sender task reads it in place when it
+ * builds the frame, so it must stay valid until tx_ref_wait(*ticket) has
+ * returned. The message always gets a frame of its own. Waits up to timeout ticks for
+ * room in the TX ring.
+ */
+bool send_message_ref(const uint8_t *mac_addr, frame_type_t type, const void *header, int header_len,
+                      const void *data, int data_len, TickType_t timeout, uint32_t *ticket);
+
+/**
+ * Blocks until the sender task is done reading the data of the message behind
+ * ticket. Only one task may wait at a time; bulk_send() serialises its callers.
+ */
+void tx_ref_wait(uint32_t ticket);
+
+/**
+ * Fills in the session nonces of a HELLO or HELLO-ACK to mac_addr (see
+ * link_crypto.h). Both stay 0 without CONFIG_LINK_ENCRYPT or for a MAC that
+ * is not a peer, such as the broadcast address.
+ */
+void link_session_hello(const uint8_t *mac_addr, frame_hello_t *hello);
+
+/** Sends whatever is batched for mac_addr without waiting for the deadline. */
+bool flush_messages(const uint8_t *mac_addr);
+
+/** Wakes the sender task to transmit frames held while the radio was asleep. */
+void tx_resume(void);
+
@@ -0,0 +1,85 @@
+/**
+ * frame.c
+ *
+ * Encoding and decoding of the binary ESP-NOW frame format (see frame.h).
+ */
+
+#include <string.h>
+#include "frame.h"
+
+int frame_write_header(uint8_t *buf, frame_type_t type, uint8_t flags, uint16_t seq, int payload_len)
+{
+    frame_header_t hdr = {
+        .version = FRAME_VERSION,
+        .type = (uint8_t)type,
+        .flags = flags,
+        .payload_len = (uint8_t)payload_len,
+        .seq = seq,
+    };
+    memcpy(buf, &hdr, FRAME_HEADER_LEN);
+    return FRAME_HEADER_LEN + payload_len;
+}
+
+int frame_encode(uint8_t *buf, int buf_len, frame_type_t type, uint8_t flags, uint16_t seq,
+                 const void *payload, int payload_len)
+{
+    if (payload_len < 0 || payload_len > FRAME_MAX_PAYLOAD_LEN || FRAME_HEADER_LEN + payload_len > buf_len) {
+        return 0;
+    }
+
+    if (payload_len > 0) {
+        memcpy(buf + FRAME_HEADER_LEN, payload, payload_len);
+    }
+    return frame_write_header(buf, type, flags, seq, payload_len);
+}
+
+bool frame_decode(const uint8_t *buf, int len, frame_header_t *hdr, const uint8_t **payload)
+{
+    if (len < FRAME_HEADER_LEN) {
+        return false;
+    }
+    memcpy(hdr, buf, FRAME_HEADER_LEN);
+    if (hdr->version != FRAME_VERSION || FRAME_HEADER_LEN + hdr->payload_len > len) {
+        return false;
+    }
+    *payload = buf + FRAME_HEADER_LEN;
+    return true;
+}
+
+int frame_encode_data(uint8_t *buf, int buf_len, uint16_t seq, const frame_data_t *data)
+{
+    return frame_encode(buf, buf_len, FRAME_TYPE_DATA, 0, seq, data, sizeof(*data));
+}
+
+bool frame_decode_data(const uint8_t *payload, int len, frame_data_t *data)
+{
+    if (len != (int)sizeof(*data)) {
+        return false;
+    }
+    memcpy(data, payload, sizeof(*data));
+    return true;
+}
+
+int frame_encode_cmd(uint8_t *buf, int buf_len, const frame_cmd_t *cmd, const uint8_t *args, int args_len)
+{
+    int len = (int)sizeof(*cmd) + args_len;
+    if (args_len < 0 || len > FRAME_MAX_PAYLOAD_LEN || len > buf_len) {
+        return 0;
+    }
+    memcpy(buf, cmd, sizeof(*cmd));
+    if (args_len > 0) {
+        memcpy(buf + sizeof(*cmd), args, args_len);
+    }
+    return len;
+}
+
+bool frame_decode_cmd(const uint8_t *payload, int len, frame_cmd_t *cmd, const uint8_t **args, int *args_len)
+{
+    if (len < (int)sizeof(*cmd)) {
+        return false;
+    }
+    memcpy(cmd, payload, sizeof(*cmd));
+    *args = payload + sizeof(*cmd);
+    *args_len = len - (int)sizeof(*cmd);
+    return true;
+}
@@ -0,0 +1,93 @@
+/**
+ * frame_pool.c
+ *
+ * Lock-free frame buffer pool (see frame_pool.h).
+ *
+ * Free buffers form a singly linked stack through next[]. head packs the index
+ * of the top buffer in its low 16 bits and a tag in the high 16 bits that every
+ * push and pop increments, so a pop that read a stale next[] entry while another
+ * core popped and pushed the same buffer fails its compare-and-swap.
+ */
+
+#include <stdatomic.h>
+#include "frame_pool.h"
+
+#define POOL_NIL 0xFFFF
+
+_Static_assert(FRAME_POOL_SIZE > 0 && FRAME_POOL_SIZE < POOL_NIL, "FRAME_POOL_SIZE must fit a 16-bit index");
+
+// Plain .bss: internal DRAM on the ESP32 unless explicitly placed in PSRAM.
+static frame_buf_t pool[FRAME_POOL_SIZE];
+static atomic_uint_least16_t next[FRAME_POOL_SIZE];
+static atomic_uint head;
+static atomic_int available;
+static atomic_int low_water;
+
+static inline unsigned pack(unsigned tag, unsigned index)
+{
+    return (tag << 16) | index;
+}
+
+void frame_pool_init(void)
+{
+    for (int i = 0; i < FRAME_POOL_SIZE; i++) {
+        atomic_store_explicit(&next[i], i + 1 < FRAME_POOL_SIZE ? i + 1 : POOL_NIL, memory_order_relaxed);
+    }
+    atomic_store_explicit(&available, FRAME_POOL_SIZE, memory_order_relaxed);
+    atomic_store_explicit(&low_water, FRAME_POOL_SIZE, memory_order_relaxed);
+    atomic_store_explicit(&head, pack(0, 0), memory_order_release);
+}
+
+frame_buf_t *frame_pool_alloc(void)
+{
+    unsigned old = atomic_load_explicit(&head, memory_order_acquire);
+    unsigned index;
+    do {
+        index = old & 0xFFFF;
+        if (index == POOL_NIL) {
+            return NULL;
+        }
+        unsigned new_head = pack((old >> 16) + 1, atomic_load_explicit(&next[index], memory_order_relaxed));
+        if (atomic_compare_exchange_weak_explicit(&head, &old, new_head, memory_order_acquire, memory_order_acquire)) {
+            break;
+        }
+    } while (1);
+
+    int left = atomic_fetch_sub_explicit(&available, 1, memory_order_relaxed) - 1;
+    int low = atomic_load_explicit(&low_water, memory_order_relaxed);
+    while (left < low && !atomic_compare_exchange_weak_explicit(&low_water, &low, left, memory_order_relaxed,
+                                                                memory_order_relaxed)) {
+    }
+    return &pool[index];
+}
+
+void frame_pool_free(frame_buf_t *buf)
+{
+    unsigned index = (unsigned)(buf - pool);
+    unsigned old = atomic_load_explicit(&head, memory_order_relaxed);
+    do {
+        atomic_store_explicit(&next[index], old & 0xFFFF, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&head, &old, pack((old >> 16) + 1, index),
+                                                    memory_order_release, memory_order_relaxed));
+    atomic_fetch_add_explicit(&available, 1, memory_order_relaxed);
+}
+
+int frame_pool_index(const frame_buf_t *buf)
+{
+    return (int)(buf - pool);
+}
+
+frame_buf_t *frame_pool_at(int index)
+{
+    return &pool[index];
+}
+
+int frame_pool_available(void)
+{
+    return atomic_load_explicit(&available, memory_order_relaxed);
+}
+
+int frame_pool_low_water(void)
+{
+    return atomic_load_explicit(&low_water, memory_order_relaxed);
+}
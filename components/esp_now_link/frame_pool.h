@@ -0,0 +1,40 @@
+/**
+ * frame_pool.h
+ *
+ * Fixed pool of frame buffers shared by the TX window and the RX queue, reserved
+ * statically so the per-packet path never touches the heap. Allocation and
+ * release are lock-free (a Treiber stack with an ABA tag) and O(1), so they are
+ * safe from the Wi-Fi task callbacks as well as from any FreeRTOS task.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "frame.h"
+#include "sdkconfig.h"
+
+#define FRAME_POOL_SIZE CONFIG_FRAME_POOL_SIZE
+
+typedef struct {
+    uint8_t mac[6];                 // Source on RX, destination on TX
+    uint8_t dest_mac[6];            // RX only: the address the frame was sent to
+    int8_t rssi;                    // RX only
+    int64_t rx_at_us;               // RX only: when the Wi-Fi task received it
+    int len;
+    uint8_t data[FRAME_MAX_LEN];
+} frame_buf_t;
+
+void frame_pool_init(void);
+
+/** Returns a buffer, or NULL if all FRAME_POOL_SIZE are in use. */
+frame_buf_t *frame_pool_alloc(void);
+
+void frame_pool_free(frame_buf_t *buf);
+
+/** Index of buf in the pool, for short handles; frame_pool_at() reverses it. */
+int frame_pool_index(const frame_buf_t *buf);
+frame_buf_t *frame_pool_at(int index);
+
+/** Buffers currently free, and the fewest that were free since frame_pool_init(). */
+int frame_pool_available(void);
+int frame_pool_low_water(void);
@@ -0,0 +1,51 @@
+/**
+ * hot_log.c
+ *
+ * Once-per-second summary of hot-path log events (see hot_log.h).
+ */
+
+#include "esp_timer.h"
+#include "hot_log.h"
+
+#if CONFIG_HOT_PATH_LOG_SUMMARY
+
+static const char *TAG = "HOT PATH";
+
+#define HOT_LOG_SUMMARY_PERIOD_US 1000000
+
+atomic_uint hot_log_counts[HOT_LOG_EVENT_COUNT];
+
+static void on_summary_timer(void *arg)
+{
+    unsigned counts[HOT_LOG_EVENT_COUNT];
+    unsigned total = 0;
+    for (int i = 0; i < HOT_LOG_EVENT_COUNT; i++) {
+        counts[i] = atomic_exchange_explicit(&hot_log_counts[i], 0, memory_order_relaxed);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return;
+    }
+    ESP_LOGI(TAG, "last 1s: sent=%u failed=%u timeout=%u queue_err=%u received=%u",
+             counts[HOT_LOG_TX_SENT], counts[HOT_LOG_TX_FAILED], counts[HOT_LOG_TX_TIMEOUT],
+             counts[HOT_LOG_TX_QUEUE_ERROR], counts[HOT_LOG_RX]);
+}
+
+void hot_log_init(void)
+{
+    const esp_timer_create_args_t args = {
+        .callback = on_summary_timer,
+        .name = "hot_log",
+    };
+    esp_timer_handle_t timer;
+    ESP_ERROR_CHECK(esp_timer_create(&args, &timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(timer, HOT_LOG_SUMMARY_PERIOD_US));
+}
+
+#else
+
+void hot_log_init(void)
+{
+}
+
+#endif
@@ -0,0 +1,56 @@
+/**
+ * hot_log.h
+ *
+ * Logging for per-packet events on the TX and RX paths. CONFIG_HOT_PATH_LOG picks
+ * at compile time whether these log every packet, 1 of every N packets per call
+ * site, only a once-per-second summary of how often each event fired, or nothing.
+ * In the "none" setting the macros compile to nothing and their arguments are
+ * not evaluated.
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+typedef enum {
+    HOT_LOG_TX_SENT,                // Frame acknowledged by the peer's MAC layer
+    HOT_LOG_TX_FAILED,              // Send callback reported failure for one attempt
+    HOT_LOG_TX_TIMEOUT,             // No send callback within the RTT-derived timeout
+    HOT_LOG_TX_QUEUE_ERROR,         // esp_now_send() refused the frame
+    HOT_LOG_RX,                     // Message delivered by the RX worker
+    HOT_LOG_EVENT_COUNT,
+} hot_log_event_t;
+
+#if CONFIG_HOT_PATH_LOG_ALL
+
+#define HOT_LOG(level, event, tag, fmt, ...) ESP_LOG_LEVEL_LOCAL(level, tag, fmt, ##__VA_ARGS__)
+
+#elif CONFIG_HOT_PATH_LOG_SAMPLED
+
+#define HOT_LOG(level, event, tag, fmt, ...) do {                                       \
+        static uint32_t hot_log_count_;                                                 \
+        if (hot_log_count_++ % CONFIG_HOT_PATH_LOG_SAMPLE_N == 0) {                     \
+            ESP_LOG_LEVEL_LOCAL(level, tag, fmt " [1/%d]", ##__VA_ARGS__, CONFIG_HOT_PATH_LOG_SAMPLE_N); \
+        }                                                                               \
+    } while (0)
+
+#elif CONFIG_HOT_PATH_LOG_SUMMARY
+
+extern atomic_uint hot_log_counts[HOT_LOG_EVENT_COUNT];
+#define HOT_LOG(level, event, tag, fmt, ...) \
+    atomic_fetch_add_explicit(&hot_log_counts[event], 1, memory_order_relaxed)
+
+#else
+
+#define HOT_LOG(level, event, tag, fmt, ...) do { } while (0)
+
+#endif
+
+#define HOT_LOGI(event, tag, fmt, ...) HOT_LOG(ESP_LOG_INFO, event, tag, fmt, ##__VA_ARGS__)
+#define HOT_LOGW(event, tag, fmt, ...) HOT_LOG(ESP_LOG_WARN, event, tag, fmt, ##__VA_ARGS__)
+
+/** Starts the once-per-second summary in CONFIG_HOT_PATH_LOG_SUMMARY builds; no-op otherwise. */
+void hot_log_init(void);
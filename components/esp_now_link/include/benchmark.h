@@ -0,0 +1,16 @@
+/**
+ * benchmark.h
+ *
+ * Link benchmark selected with CONFIG_BENCHMARK_MODE: ping-pong RTT, one-way
+ * flood and a sweep of both across frame lengths.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+/** Runs the tests enabled in menuconfig against peer_mac and prints "BENCH,..." lines. */
+void benchmark_run(const uint8_t *peer_mac);
+
+/** RX worker hook for FRAME_TYPE_BENCH_* messages. Every node answers pings and floods. */
+void benchmark_handle_rx(const uint8_t *src_mac, uint8_t type, const uint8_t *payload, int len);
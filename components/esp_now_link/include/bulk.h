@@ -0,0 +1,35 @@
+/**
+ * bulk.h
+ *
+ * Transfers of buffers larger than one ESP-NOW frame. The sender splits the
+ * buffer into FRAME_TYPE_FRAG fragments that are read in place from the caller's
+ * buffer; the receiver reassembles them per peer and transfer ID and answers with
+ * a selective acknowledgement so only missing fragments are sent again.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#define BULK_MAX_FRAGMENTS 64       // One bit each in the acknowledgement bitmap
+
+/** Called on the RX worker with a completed transfer. data is only valid during the call. */
+typedef void (*bulk_recv_cb_t)(const uint8_t *src_mac, const uint8_t *data, size_t len);
+
+esp_err_t bulk_init(void);
+
+/**
+ * Sends len bytes to a unicast peer and blocks until the peer has all of them.
+ * data is not copied and must not change until the call returns. Returns
+ * ESP_ERR_TIMEOUT if the transfer did not complete within timeout_ms.
+ */
+esp_err_t bulk_send(const uint8_t *dest_mac, const void *data, size_t len, uint32_t timeout_ms);
+
+/** Replaces the default handler, which only logs completed transfers. */
+void bulk_set_recv_cb(bulk_recv_cb_t cb);
+
+/** RX worker hook for FRAME_TYPE_FRAG and FRAME_TYPE_FRAG_ACK messages. */
+void bulk_handle_rx(const uint8_t *src_mac, uint8_t type, const uint8_t *payload, int len);
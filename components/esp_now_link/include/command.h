@@ -0,0 +1,71 @@
+/**
+ * command.h
+ *
+ * Remote commands carried in FRAME_TYPE_CMD messages. Handlers register against
+ * an 8-bit opcode and run either inline on the RX worker or deferred on the
+ * command task. A command sent with command_call() carries a correlation ID;
+ * the handler's reply comes back with the same ID and wakes the caller.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+#include "frame.h"
+
+#define COMMAND_MAX_HANDLERS 16
+#define COMMAND_MAX_ARGS_LEN (FRAME_MAX_PAYLOAD_LEN - (int)sizeof(frame_cmd_t))
+#define COMMAND_MAX_REPLY_LEN (COMMAND_MAX_ARGS_LEN - 1) // One byte goes to the status
+
+#define COMMAND_OPCODE_ECHO 0x01    // Built in: replies with its arguments
+
+typedef enum {
+    COMMAND_OK = 0,
+    COMMAND_ERR_UNKNOWN_OPCODE,
+    COMMAND_ERR_INVALID_ARGS,
+    COMMAND_ERR_BUSY,               // The command task's queue was full
+    COMMAND_ERR_FAILED,
+} command_status_t;
+
+typedef enum {
+    COMMAND_RUN_INLINE,             // On the RX worker: must be short and must not block
+    COMMAND_RUN_DEFERRED,           // On the command task, may block
+} command_mode_t;
+
+typedef struct {
+    const uint8_t *src_mac;
+    uint8_t opcode;
+    uint16_t corr_id;               // 0 if the sender does not wait for a reply
+    const uint8_t *args;            // View into the received frame, valid during the call
+    int args_len;
+} command_request_t;
+
+typedef void (*command_handler_t)(const command_request_t *req, void *arg);
+
+esp_err_t command_init(void);
+
+/** Registers handler for opcode, replacing any earlier one. */
+esp_err_t command_register(uint8_t opcode, command_handler_t handler, void *arg, command_mode_t mode);
+
+/**
+ * Answers req. Does nothing if the sender is not waiting for a reply, so
+ * handlers can call it unconditionally. At most one reply per request.
+ */
+esp_err_t command_reply(const command_request_t *req, command_status_t status, const void *data, int len);
+
+/** Sends a command without waiting for a reply. */
+esp_err_t command_send(const uint8_t *dest_mac, uint8_t opcode, const void *args, int args_len, TickType_t timeout);
+
+/**
+ * Sends a command and blocks until its reply arrives. Up to reply_cap reply
+ * bytes are copied into reply and their count stored in reply_len. Returns
+ * ESP_ERR_TIMEOUT if no reply came within timeout, ESP_ERR_NO_MEM if too many
+ * calls are already waiting.
+ */
+esp_err_t command_call(const uint8_t *dest_mac, uint8_t opcode, const void *args, int args_len,
+                       command_status_t *status, void *reply, int reply_cap, int *reply_len, TickType_t timeout);
+
+/** RX worker hook for FRAME_TYPE_CMD messages. */
+void command_handle_rx(const uint8_t *src_mac, const uint8_t *payload, int len);
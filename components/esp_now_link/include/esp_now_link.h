@@ -0,0 +1,99 @@
+/**
+ * esp_now_link.h
+ *
+ * Public API of the esp_now_link component: batched, retried and optionally
+ * encrypted ESP-NOW messaging between ESP32 nodes that find each other on
+ * their own. esp_now_link_init() brings up Wi-Fi and ESP-NOW and starts the
+ * link tasks (see "ESP-NOW link" in menuconfig); the application then sends
+ * with esp_now_link_send() and receives through esp_now_link_register_rx_cb().
+ *
+ * The component owns the Wi-Fi driver. NVS must be initialized first: the
+ * channel and the peer cache are kept there. bulk.h, command.h and mesh.h add
+ * large transfers, remote commands and multi-hop delivery on the same link.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "frame.h"
+#include "link_stats.h"
+
+#define ESP_NOW_LINK_MAX_LEN FRAME_MAX_PAYLOAD_LEN // Largest message for esp_now_link_send()
+#define ESP_NOW_LINK_FLAG_FLUSH 0x01 // Send the peer's batch right after this message
+#define ESP_NOW_LINK_MAX_PEERS 19    // ESP-NOW's peer limit minus the broadcast peer
+#define ESP_ERR_NOW_LINK_NO_CREDIT ESP_ERR_NOT_FINISHED // The peer asked us to hold off, see esp_now_link_send()
+
+typedef struct {
+    TaskHandle_t peer_notify_task;  // Gets a task notification whenever a new peer is found, may be NULL
+} esp_now_link_config_t;
+
+#define ESP_NOW_LINK_CONFIG_DEFAULT() { .peer_notify_task = NULL }
+
+/**
+ * Called on the RX worker with every application message. data is only valid
+ * during the call, and the callback must not block.
+ */
+typedef void (*esp_now_link_rx_cb_t)(const uint8_t *src_mac, const uint8_t *data, int len, void *arg);
+
+/**
+ * Called on the sender task when the frame that carried messages to peer_mac
+ * is done with. IDs, as returned by esp_now_link_send_id(), count up by one per
+ * peer, so the frame held exactly the messages to peer_mac from first_id to
+ * last_id. They wrap: count them as (uint32_t)(last_id - first_id) + 1, which
+ * holds when first_id > last_id too. delivered is true if
+ * the peer acknowledged the frame: end to end with CONFIG_LINK_RELIABLE, else
+ * by its MAC ACK (always for broadcasts). The callback must not block.
+ */
+typedef void (*esp_now_link_tx_cb_t)(const uint8_t *peer_mac, uint32_t first_id, uint32_t last_id, bool delivered,
+                                     void *arg);
+
+/**
+ * Starts Wi-Fi, ESP-NOW and the link tasks, restores cached peers and starts
+ * discovery. Returns ESP_ERR_INVALID_STATE if the link is already running.
+ */
+esp_err_t esp_now_link_init(const esp_now_link_config_t *config);
+
+/** Replaces the default callback, which only logs. Call before esp_now_link_init(). */
+void esp_now_link_register_rx_cb(esp_now_link_rx_cb_t cb, void *arg);
+
+/** Reports the outcome of sent messages to cb, NULL for none (the default). Call before esp_now_link_init(). */
+void esp_now_link_register_tx_cb(esp_now_link_tx_cb_t cb, void *arg);
+
+/**
+ * Queues len bytes for peer_mac, or for every node in range when it is the
+ * broadcast address, without blocking. Messages to the same peer share frames
+ * until ESP_NOW_LINK_FLAG_FLUSH or a short deadline. Returns ESP_ERR_NO_MEM if
+ * the TX queue is full, ESP_ERR_NOW_LINK_NO_CREDIT if the peer has asked us to
+ * wait until its receive queue drains, and ESP_ERR_INVALID_SIZE if len is above
+ * ESP_NOW_LINK_MAX_LEN. Both of the first two mean "try again later".
+ */
+esp_err_t esp_now_link_send(const uint8_t *peer_mac, const void *data, int len, uint8_t flags);
+
+/**
+ * Like esp_now_link_send(), and stores the message's ID in msg_id when it was
+ * queued. Each peer has its own IDs, counting up from 1 and wrapping; they
+ * start over if the peer is removed and found again. Broadcasts, and messages
+ * to a MAC that is not a peer, share one count. See esp_now_link_tx_cb_t.
+ */
+esp_err_t esp_now_link_send_id(const uint8_t *peer_mac, const void *data, int len, uint8_t flags, uint32_t *msg_id);
+
+/**
+ * Like esp_now_link_send(), but waits up to timeout ticks for the peer's credit
+ * and for room in the TX queue. Returns ESP_ERR_NOW_LINK_NO_CREDIT if the credit
+ * did not come in time, and ESP_ERR_TIMEOUT if the TX queue stayed full.
+ */
+esp_err_t esp_now_link_send_wait(const uint8_t *peer_mac, const void *data, int len, uint8_t flags,
+                                 TickType_t timeout);
+
+/** Copies the MACs of all known peers into macs and returns how many there are. */
+int esp_now_link_get_peers(uint8_t macs[][6], int max);
+
+/**
+ * Snapshot of the link counters for peer_mac, or the totals over all peers when
+ * peer_mac is NULL. Returns false if the peer is unknown.
+ */
+bool esp_now_link_get_stats(const uint8_t *peer_mac, link_stats_t *stats);
@@ -0,0 +1,140 @@
+/**
+ * frame.h
+ *
+ * Binary frame format used on the ESP-NOW link. Every frame starts with a packed
+ * frame_header_t followed by a typed payload. Multi-byte fields are little-endian.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+#define FRAME_VERSION 1
+#define FRAME_MAX_LEN 250           // ESP_NOW_MAX_DATA_LEN
+#define FRAME_HEADER_LEN ((int)sizeof(frame_header_t))
+#define FRAME_SEAL_OVERHEAD 10      // Counter high half and AES-CCM tag of a sealed frame, see link_crypto.h
+#if CONFIG_LINK_ENCRYPT
+#define FRAME_CRYPTO_OVERHEAD FRAME_SEAL_OVERHEAD
+#else
+#define FRAME_CRYPTO_OVERHEAD 0
+#endif
+#if CONFIG_LINK_RELIABLE
+#define FRAME_RELIABLE_OVERHEAD ((int)sizeof(frame_rel_t))
+#else
+#define FRAME_RELIABLE_OVERHEAD 0
+#endif
+#define FRAME_MAX_PAYLOAD_LEN (FRAME_MAX_LEN - FRAME_HEADER_LEN - FRAME_CRYPTO_OVERHEAD - FRAME_RELIABLE_OVERHEAD)
+#define FRAME_MAX_PLAIN_LEN (FRAME_HEADER_LEN + FRAME_MAX_PAYLOAD_LEN) // Longest frame before sealing
+
+#define FRAME_FLAG_ENCRYPTED 0x01   // Payload is sealed with the session key of the link
+#define FRAME_FLAG_DELTA 0x02       // Payload is delta-coded against an earlier frame, see compress.h
+#define FRAME_FLAG_LZ 0x04          // Payload is LZ-compressed, see compress.h
+#define FRAME_FLAG_COMPRESSED (FRAME_FLAG_DELTA | FRAME_FLAG_LZ)
+#define FRAME_FLAG_RELIABLE 0x08    // Payload starts with frame_rel_t and is acknowledged end to end, see reliable.h
+
+typedef enum {
+    FRAME_TYPE_DATA = 1,            // Application message from esp_now_link_send()
+    FRAME_TYPE_DISCOVERY = 2,       // HELLO beacon (frame_hello_t), see discovery.h
+    FRAME_TYPE_CMD = 3,             // frame_cmd_t followed by argument bytes, see command.h
+    FRAME_TYPE_BATCH = 4,           // Several small messages, see batch.h
+    FRAME_TYPE_BENCH_PING = 5,      // Benchmark messages, see benchmark.c
+    FRAME_TYPE_BENCH_PONG = 6,
+    FRAME_TYPE_BENCH_FLOOD = 7,
+    FRAME_TYPE_BENCH_FLOOD_END = 8,
+    FRAME_TYPE_BENCH_REPORT = 9,
+    FRAME_TYPE_FRAG = 10,           // Bulk transfer fragment, see bulk.c
+    FRAME_TYPE_FRAG_ACK = 11,       // Selective acknowledgement of a bulk transfer
+    FRAME_TYPE_DISCOVERY_ACK = 12,  // HELLO-ACK (frame_hello_t), unicast reply to a HELLO
+    FRAME_TYPE_KEEPALIVE = 13,      // Probe whose MAC ACK proves liveness, also carries RX credit (frame_credit_t)
+    FRAME_TYPE_CHANNEL_SWITCH = 14, // Coordinated move to another Wi-Fi channel, see channel.c
+    FRAME_TYPE_WAKE_SCHEDULE = 15,  // Wake window beacon of a duty-cycled network, see duty_cycle.c
+    FRAME_TYPE_MESH = 16,           // frame_mesh_t followed by data for a node further away, see mesh.h
+    FRAME_TYPE_ACK = 17,            // End-to-end acknowledgement of reliable frames (frame_ack_t), see reliable.h
+} frame_type_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t version;
+    uint8_t type;                   // frame_type_t
+    uint8_t flags;                  // FRAME_FLAG_*
+    uint8_t payload_len;
+    uint16_t seq;
+} frame_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t node_id;               // Last two bytes of the sender's STA MAC
+    uint32_t counter;
+} frame_data_t;
+
+#define FRAME_CMD_FLAG_RESPONSE 0x01 // Reply to the command with the same corr_id; args start with its status
+
+typedef struct __attribute__((packed)) {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t corr_id;               // Matches a reply to its request, 0 if no reply is wanted
+} frame_cmd_t;
+
+#define FRAME_CREDIT_UNLIMITED 0xFF // The receiver keeps up: send freely
+
+typedef struct __attribute__((packed)) {
+    uint16_t rseq;                  // Per-peer number of the reliable frame
+} frame_rel_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t cum;                   // Every reliable frame up to and including cum was received
+    uint32_t sack;                  // Bit n set: cum + 1 + n was received too
+} frame_ack_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t credits;                // Frames the peer may still send us, or FRAME_CREDIT_UNLIMITED
+} frame_credit_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t boot_id;               // Random per boot, tells peers our sequence numbers restarted
+    uint64_t nonce;                 // Our session nonce for the receiver (link_crypto.h), 0 if broadcast or unencrypted
+    uint64_t peer_nonce;            // The receiver's session nonce ours is bound to, 0 if none
+} frame_hello_t;                    // With CONFIG_MESH followed by frame_route_t entries
+
+typedef struct __attribute__((packed)) {
+    uint8_t dest[6];
+    uint8_t hops;                   // From the advertising node
+    uint8_t quality;                // Weakest link on the path, 0..255
+} frame_route_t;
+
+typedef struct __attribute__((packed)) {
+    uint8_t origin[6];
+    uint8_t dest[6];                // Broadcast address for a flood
+    uint16_t msg_id;                // Per origin, for the duplicate cache
+    uint8_t ttl;                    // Hops left; the message is not forwarded once it reaches 1
+    uint8_t hops;                   // Hops taken so far
+} frame_mesh_t;
+
+_Static_assert(sizeof(frame_header_t) == 6, "frame_header_t must stay packed");
+
+/**
+ * Writes a header and payload into buf. Returns the encoded length, or 0 if the
+ * payload does not fit in buf_len or in a single ESP-NOW frame.
+ */
+int frame_encode(uint8_t *buf, int buf_len, frame_type_t type, uint8_t flags, uint16_t seq,
+                 const void *payload, int payload_len);
+
+/**
+ * Writes only the header, for payloads already built in place after it.
+ * Returns the total frame length.
+ */
+int frame_write_header(uint8_t *buf, frame_type_t type, uint8_t flags, uint16_t seq, int payload_len);
+
+/**
+ * Validates version and lengths of a received frame. On success fills hdr and
+ * points payload into buf (no copy).
+ */
+bool frame_decode(const uint8_t *buf, int len, frame_header_t *hdr, const uint8_t **payload);
+
+int frame_encode_data(uint8_t *buf, int buf_len, uint16_t seq, const frame_data_t *data);
+bool frame_decode_data(const uint8_t *payload, int len, frame_data_t *data);
+
+/** Writes cmd followed by args into buf as a CMD payload. Returns its length, or 0 if it does not fit. */
+int frame_encode_cmd(uint8_t *buf, int buf_len, const frame_cmd_t *cmd, const uint8_t *args, int args_len);
+bool frame_decode_cmd(const uint8_t *payload, int len, frame_cmd_t *cmd, const uint8_t **args, int *args_len);
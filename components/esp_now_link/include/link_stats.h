@@ -0,0 +1,85 @@
+/**
+ * link_stats.h
+ *
+ * Link statistics counters. The global set and the one in every peer_t entry are
+ * bumped with relaxed atomics from the send window, the send/receive callbacks and
+ * the RX worker; readers take a plain snapshot.
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#define LINK_STATS_RETRY_BUCKETS 5  // Acked on attempt 1..4, the last bucket counts 5 or more
+
+typedef struct {
+    atomic_uint tx_queued;          // Messages taken from the TX ring
+    atomic_uint tx_acked;           // Frames acknowledged by the peer's MAC layer
+    atomic_uint tx_failed;          // Frames dropped after the last retry
+    atomic_uint tx_superseded;      // Bulk frames discarded while retrying to make room for newer ones
+    atomic_uint tx_attempts[LINK_STATS_RETRY_BUCKETS];  // Acked frames by attempts needed
+    atomic_uint cb_timeouts;        // Attempts with no send callback in time
+    atomic_uint tx_credit_waits;    // Bulk frames held back because the peer ran out of RX credit
+    atomic_uint tx_compressed;      // Frames sent shorter thanks to CONFIG_FRAME_COMPRESS
+    atomic_uint tx_bytes_saved;     // Sum of the bytes compression took off those frames
+    atomic_uint tx_e2e_acked;       // Reliable frames acknowledged by the peer's link layer, see CONFIG_LINK_RELIABLE
+    atomic_uint tx_e2e_failed;      // Reliable frames given up on without that acknowledgement
+    atomic_uint rx_frames;
+    atomic_uint rx_bytes;
+    atomic_uint rx_duplicates;
+    atomic_uint rx_out_of_order;
+    atomic_uint rx_dropped;         // No free RX slot (global counters only)
+    atomic_uint rx_rejected;        // Failed authentication, or plaintext where a sealed frame was required
+    atomic_uint rx_throttled;       // Credit limits sent because our RX queue was filling up
+    atomic_uint rx_decode_failed;   // Compressed frames that could not be expanded, e.g. delta reference lost (global counters only)
+    atomic_uint rx_acks_sent;       // Acknowledgements sent in frames of their own
+    atomic_uint rx_acks_piggybacked; // Acknowledgements that rode along with our own batches
+    atomic_uint fwd_frames;         // Mesh frames relayed for other nodes and acked by the next hop
+    atomic_uint fwd_dropped;        // Mesh frames not relayed: TTL used up, no route or no room
+    atomic_uint fwd_latency_us;     // Sum over fwd_frames of the time from reception to the next hop's ack
+    atomic_uint radio_up_us;        // When Wi-Fi was up, from application start (global counters only)
+    atomic_uint first_tx_us;        // When the first frame went out, 0 before that (global counters only)
+} link_counters_t;
+
+typedef struct {
+    uint32_t tx_queued;
+    uint32_t tx_acked;
+    uint32_t tx_failed;
+    uint32_t tx_superseded;
+    uint32_t tx_attempts[LINK_STATS_RETRY_BUCKETS];
+    uint32_t cb_timeouts;
+    uint32_t tx_credit_waits;
+    uint32_t tx_compressed;
+    uint32_t tx_bytes_saved;
+    uint32_t tx_e2e_acked;
+    uint32_t tx_e2e_failed;
+    uint32_t rx_frames;
+    uint32_t rx_bytes;
+    uint32_t rx_duplicates;
+    uint32_t rx_out_of_order;
+    uint32_t rx_dropped;
+    uint32_t rx_rejected;
+    uint32_t rx_throttled;
+    uint32_t rx_decode_failed;
+    uint32_t rx_acks_sent;
+    uint32_t rx_acks_piggybacked;
+    uint32_t fwd_frames;
+    uint32_t fwd_dropped;
+    uint32_t fwd_latency_us;
+    uint32_t radio_up_us;
+    uint32_t first_tx_us;
+} link_stats_t;
+
+#define LINK_STATS_INC(counters, field) \
+    atomic_fetch_add_explicit(&(counters)->field, 1, memory_order_relaxed)
+#define LINK_STATS_ADD(counters, field, n) \
+    atomic_fetch_add_explicit(&(counters)->field, (n), memory_order_relaxed)
+
+/** Counts an acknowledged frame in tx_acked and the attempts histogram. */
+void link_stats_acked(link_counters_t *counters, int attempts);
+
+void link_stats_snapshot(const link_counters_t *counters, link_stats_t *stats);
+
+/** Formats stats as space separated key=value pairs. Returns the length written. */
+int link_stats_format(const link_stats_t *stats, char *buf, int buf_len);
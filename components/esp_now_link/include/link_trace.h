@@ -0,0 +1,60 @@
+/**
+ * link_trace.h
+ *
+ * Cycle-stamped tracepoints on the TX and RX hot paths (CONFIG_LINK_TRACE).
+ * Each tracepoint writes one entry, the CPU cycle count, core, event and frame
+ * sequence number, into a lock-free ring in RAM. Nothing is formatted or
+ * printed on the hot path. link_trace_dump() prints the ring afterwards. With
+ * the option off the macro compiles to nothing and its arguments are not
+ * evaluated.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "sdkconfig.h"
+#include "frame.h"
+
+typedef enum {
+    LINK_TRACE_TX_SEND,             // Frame handed to esp_now_send()
+    LINK_TRACE_TX_DONE,             // Send callback, arg is 1 if the MAC ACK came
+    LINK_TRACE_RX_RECV,             // Receive callback in the Wi-Fi task
+    LINK_TRACE_RX_DEQUEUE,          // Frame taken from the RX queue by the RX worker
+    LINK_TRACE_RX_HANDLED,          // RX worker done with the frame, handlers included
+    LINK_TRACE_EVENT_COUNT,
+} link_trace_event_t;
+
+typedef enum {
+    LINK_TRACE_FORMAT_TEXT,         // One "TRACE,..." line per entry
+    LINK_TRACE_FORMAT_JSON,         // Trace Event Format, opens in Perfetto and chrome://tracing
+} link_trace_format_t;
+
+/** Sequence number of a frame for its tracepoints; the header is never sealed. */
+static inline uint16_t link_trace_seq(const uint8_t *data, int len)
+{
+    uint16_t seq = 0;
+    if (len >= FRAME_HEADER_LEN) {
+        memcpy(&seq, data + offsetof(frame_header_t, seq), sizeof(seq));
+    }
+    return seq;
+}
+
+#if CONFIG_LINK_TRACE
+
+/** Records event with arg, normally the sequence number of the frame concerned. Safe from any task. */
+void link_trace_point(link_trace_event_t event, uint16_t arg);
+#define LINK_TRACE(event, arg) link_trace_point((event), (arg))
+
+#else
+
+#define LINK_TRACE(event, arg) do { } while (0)
+
+#endif
+
+/**
+ * Prints the entries in the ring, oldest first, to the console. Tracing goes on
+ * meanwhile; entries overwritten during the dump are skipped. No-op without
+ * CONFIG_LINK_TRACE.
+ */
+void link_trace_dump(link_trace_format_t format);
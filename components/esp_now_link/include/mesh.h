@@ -0,0 +1,60 @@
+/**
+ * mesh.h
+ *
+ * Multi-hop forwarding on top of the peer table. Every node appends the
+ * destinations it can reach, with hop count and path quality, to its HELLOs;
+ * neighbours turn those into a small distance-vector routing table. Mesh
+ * messages (FRAME_TYPE_MESH) carry their origin, final destination and a TTL.
+ * Relays forward them from the RX worker by handing the received frame buffer
+ * to the sender task, and a cache of recently seen messages stops floods sent
+ * to the broadcast address from circulating.
+ *
+ * Without CONFIG_MESH nothing is advertised and received mesh messages are
+ * ignored.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "frame.h"
+
+#define MESH_MAX_PAYLOAD_LEN (FRAME_MAX_PAYLOAD_LEN - (int)sizeof(frame_mesh_t))
+
+typedef enum {
+    MESH_RX_DONE,                   // Consumed here, or a duplicate
+    MESH_RX_FORWARD,                // Send on to the returned next hop
+    MESH_RX_DROP,                   // TTL used up or no route: counted in fwd_dropped
+} mesh_verdict_t;
+
+/** Called on the RX worker for every mesh message addressed to us or flooded. */
+typedef void (*mesh_recv_cb_t)(const uint8_t *origin_mac, const uint8_t *data, int len, int hops);
+
+esp_err_t mesh_init(void);
+
+/**
+ * Sends len bytes to dest_mac, which may be several hops away or the broadcast
+ * address for a flood. Returns ESP_ERR_NOT_FOUND if there is no route and
+ * ESP_FAIL if the TX ring is full.
+ */
+esp_err_t mesh_send(const uint8_t *dest_mac, const void *data, int len);
+
+/** Replaces the default handler, which only logs received messages. */
+void mesh_set_recv_cb(mesh_recv_cb_t cb);
+
+/** Writes the route advertisement appended to our HELLOs into buf. Returns its length. */
+int mesh_write_routes(uint8_t *buf, int buf_len);
+
+/** RX worker hook for the route advertisement after the frame_hello_t of a HELLO or HELLO-ACK. */
+void mesh_handle_hello(const uint8_t *src_mac, int8_t rssi, const uint8_t *routes, int len);
+
+/**
+ * RX worker hook for FRAME_TYPE_MESH messages from prev_hop. Delivers the
+ * message if it is for us and decides whether it travels on. On
+ * MESH_RX_FORWARD next_hop is filled in and the caller must apply
+ * mesh_prepare_forward() to the payload before sending it.
+ */
+mesh_verdict_t mesh_handle_rx(const uint8_t *prev_hop, const uint8_t *payload, int len, uint8_t next_hop[6]);
+
+/** Counts the hop in a mesh payload about to be forwarded. */
+void mesh_prepare_forward(uint8_t *payload);
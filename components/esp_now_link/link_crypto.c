@@ -0,0 +1,128 @@
+/**
+ * link_crypto.c
+ *
+ * Session key derivation and AES-CCM frame sealing (see link_crypto.h).
+ */
+
+#include <string.h>
+#include "mbedtls/md.h"
+#include "sdkconfig.h"
+#include "frame.h"
+#include "link_crypto.h"
+
+#if CONFIG_LINK_ENCRYPT
+
+#define NONCE_LEN 13                // CCM with a 2-byte length field
+#define KEY_LABEL "esp-now-link v2"
+
+_Static_assert(FRAME_SEAL_OVERHEAD == 2 + LINK_CRYPTO_TAG_LEN, "FRAME_SEAL_OVERHEAD must match the sealed trailer");
+
+void link_crypto_ctx_init(link_crypto_ctx_t *ctx)
+{
+    mbedtls_ccm_init(&ctx->ccm);
+    ctx->keyed = false;
+}
+
+esp_err_t link_crypto_derive(const uint8_t *mac_a, uint64_t nonce_a, const uint8_t *mac_b, uint64_t nonce_b,
+                             uint8_t key[LINK_CRYPTO_KEY_LEN])
+{
+    if (memcmp(mac_a, mac_b, 6) > 0) {
+        const uint8_t *mac = mac_a;
+        uint64_t nonce = nonce_a;
+        mac_a = mac_b;
+        nonce_a = nonce_b;
+        mac_b = mac;
+        nonce_b = nonce;
+    }
+    uint8_t input[sizeof(KEY_LABEL) - 1 + 2 * (6 + 8)];
+    uint8_t *p = input;
+    memcpy(p, KEY_LABEL, sizeof(KEY_LABEL) - 1);
+    p += sizeof(KEY_LABEL) - 1;
+    memcpy(p, mac_a, 6);
+    memcpy(p + 6, &nonce_a, 8);
+    memcpy(p + 14, mac_b, 6);
+    memcpy(p + 20, &nonce_b, 8);
+
+    uint8_t digest[32];
+    const char *psk = CONFIG_LINK_PSK;
+    if (mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), (const uint8_t *)psk, strlen(psk),
+                        input, sizeof(input), digest) != 0) {
+        return ESP_FAIL;
+    }
+    memcpy(key, digest, LINK_CRYPTO_KEY_LEN);
+    return ESP_OK;
+}
+
+static bool load_key(link_crypto_ctx_t *ctx, const uint8_t *key)
+{
+    if (ctx->keyed && memcmp(ctx->key, key, LINK_CRYPTO_KEY_LEN) == 0) {
+        return true;
+    }
+    ctx->keyed = mbedtls_ccm_setkey(&ctx->ccm, MBEDTLS_CIPHER_ID_AES, key, LINK_CRYPTO_KEY_LEN * 8) == 0;
+    memcpy(ctx->key, key, LINK_CRYPTO_KEY_LEN);
+    return ctx->keyed;
+}
+
+static void build_nonce(uint8_t nonce[NONCE_LEN], const uint8_t *src_mac, uint16_t counter_hi, uint16_t seq)
+{
+    memset(nonce, 0, NONCE_LEN);
+    memcpy(nonce, src_mac, 6);
+    memcpy(nonce + 6, &counter_hi, 2);
+    memcpy(nonce + 8, &seq, 2);
+}
+
+int link_crypto_seal(link_crypto_ctx_t *ctx, const uint8_t *key, const uint8_t *src_mac,
+                     uint8_t *frame, int len, uint16_t counter_hi)
+{
+    int plain_len = len - FRAME_HEADER_LEN;
+    if (plain_len < 0 || len + FRAME_SEAL_OVERHEAD > FRAME_MAX_LEN || !load_key(ctx, key)) {
+        return 0;
+    }
+    frame_header_t hdr;
+    memcpy(&hdr, frame, FRAME_HEADER_LEN);
+    hdr.flags |= FRAME_FLAG_ENCRYPTED;
+    hdr.payload_len = (uint8_t)(plain_len + FRAME_SEAL_OVERHEAD);
+    memcpy(frame, &hdr, FRAME_HEADER_LEN);
+
+    uint8_t nonce[NONCE_LEN];
+    build_nonce(nonce, src_mac, counter_hi, hdr.seq);
+    uint8_t *trailer = frame + len;
+    memcpy(trailer, &counter_hi, 2);
+    uint8_t *payload = frame + FRAME_HEADER_LEN;
+    if (mbedtls_ccm_encrypt_and_tag(&ctx->ccm, plain_len, nonce, NONCE_LEN, frame, FRAME_HEADER_LEN,
+                                    payload, payload, trailer + 2, LINK_CRYPTO_TAG_LEN) != 0) {
+        return 0;
+    }
+    return len + FRAME_SEAL_OVERHEAD;
+}
+
+bool link_crypto_open(link_crypto_ctx_t *ctx, const uint8_t *key, const uint8_t *src_mac,
+                      uint8_t *frame, int *len, uint16_t *counter_hi)
+{
+    frame_header_t hdr;
+    if (*len < FRAME_HEADER_LEN) {
+        return false;
+    }
+    memcpy(&hdr, frame, FRAME_HEADER_LEN);
+    if (hdr.payload_len < FRAME_SEAL_OVERHEAD || FRAME_HEADER_LEN + hdr.payload_len > *len || !load_key(ctx, key)) {
+        return false;
+    }
+    int plain_len = hdr.payload_len - FRAME_SEAL_OVERHEAD;
+    const uint8_t *trailer = frame + FRAME_HEADER_LEN + plain_len;
+    memcpy(counter_hi, trailer, 2);
+
+    uint8_t nonce[NONCE_LEN];
+    build_nonce(nonce, src_mac, *counter_hi, hdr.seq);
+    uint8_t *payload = frame + FRAME_HEADER_LEN;
+    if (mbedtls_ccm_auth_decrypt(&ctx->ccm, plain_len, nonce, NONCE_LEN, frame, FRAME_HEADER_LEN,
+                                 payload, payload, trailer + 2, LINK_CRYPTO_TAG_LEN) != 0) {
+        return false;
+    }
+    hdr.flags &= ~FRAME_FLAG_ENCRYPTED;
+    hdr.payload_len = (uint8_t)plain_len;
+    memcpy(frame, &hdr, FRAME_HEADER_LEN);
+    *len = FRAME_HEADER_LEN + plain_len;
+    return true;
+}
+
+#endif
@@ -0,0 +1,61 @@
+/**
+ * link_crypto.h
+ *
+ * AES-CCM sealing of unicast frames with per-peer session keys. A session key
+ * is HMAC-SHA256 of CONFIG_LINK_PSK over both MACs and one random 64-bit
+ * session nonce from each side. A node picks a new nonce whenever it adds the
+ * peer to its table, sends it in unicast HELLOs and HELLO-ACKs along with the
+ * peer's nonce it is bound to, and binds it to the first nonce of the peer's
+ * that echoes it back. A bound nonce never binds another one: when the peer
+ * comes with a different nonce, ours is replaced too. Every binding is a new
+ * key, so the sender's frame counter, which only starts over with a new peer
+ * entry, never repeats under a key, and the receiver resets its replay state
+ * only for a key it has not used before. mbedtls runs AES and SHA on the
+ * hardware accelerators.
+ *
+ * A sealed frame keeps its header in clear as associated data and appends the
+ * high half of the sender's 32-bit frame counter and an 8-byte tag:
+ *
+ *     header | ciphertext | counter_hi (2) | tag (8)
+ *
+ * The nonce is the sender's MAC and the full counter, so the two directions of
+ * a link never share one even though they share the key.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "mbedtls/ccm.h"
+#include "esp_err.h"
+
+#define LINK_CRYPTO_KEY_LEN 16
+#define LINK_CRYPTO_TAG_LEN 8
+
+typedef struct {
+    mbedtls_ccm_context ccm;
+    uint8_t key[LINK_CRYPTO_KEY_LEN]; // Key currently loaded into ccm
+    bool keyed;
+} link_crypto_ctx_t;
+
+/** One context per task that seals or opens frames. */
+void link_crypto_ctx_init(link_crypto_ctx_t *ctx);
+
+/** Derives the session key for a link. Gives the same key whichever side is a. */
+esp_err_t link_crypto_derive(const uint8_t *mac_a, uint64_t nonce_a, const uint8_t *mac_b, uint64_t nonce_b,
+                             uint8_t key[LINK_CRYPTO_KEY_LEN]);
+
+/**
+ * Seals the len-byte plain frame in place, in a buffer of FRAME_MAX_LEN bytes,
+ * and sets FRAME_FLAG_ENCRYPTED. counter_hi and the header's seq form the
+ * frame counter. Returns the sealed length, or 0 if it does not fit.
+ */
+int link_crypto_seal(link_crypto_ctx_t *ctx, const uint8_t *key, const uint8_t *src_mac,
+                     uint8_t *frame, int len, uint16_t counter_hi);
+
+/**
+ * Authenticates and decrypts a sealed frame in place, leaving a plain frame of
+ * *len bytes. Returns false, with the frame unusable, if authentication fails.
+ */
+bool link_crypto_open(link_crypto_ctx_t *ctx, const uint8_t *key, const uint8_t *src_mac,
+                      uint8_t *frame, int *len, uint16_t *counter_hi);
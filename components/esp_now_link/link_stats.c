@@ -0,0 +1,81 @@
+/**
+ * link_stats.c
+ *
+ * Snapshot and formatting of link statistics (see link_stats.h).
+ */
+
+#include <stdio.h>
+#include "link_stats.h"
+
+void link_stats_acked(link_counters_t *counters, int attempts)
+{
+    int bucket = attempts - 1;
+    if (bucket < 0) {
+        bucket = 0;
+    } else if (bucket >= LINK_STATS_RETRY_BUCKETS) {
+        bucket = LINK_STATS_RETRY_BUCKETS - 1;
+    }
+    LINK_STATS_INC(counters, tx_acked);
+    LINK_STATS_INC(counters, tx_attempts[bucket]);
+}
+
+#define LOAD(field) atomic_load_explicit(&counters->field, memory_order_relaxed)
+
+void link_stats_snapshot(const link_counters_t *counters, link_stats_t *stats)
+{
+    stats->tx_queued = LOAD(tx_queued);
+    stats->tx_acked = LOAD(tx_acked);
+    stats->tx_failed = LOAD(tx_failed);
+    stats->tx_superseded = LOAD(tx_superseded);
+    for (int i = 0; i < LINK_STATS_RETRY_BUCKETS; i++) {
+        stats->tx_attempts[i] = LOAD(tx_attempts[i]);
+    }
+    stats->cb_timeouts = LOAD(cb_timeouts);
+    stats->tx_credit_waits = LOAD(tx_credit_waits);
+    stats->tx_compressed = LOAD(tx_compressed);
+    stats->tx_bytes_saved = LOAD(tx_bytes_saved);
+    stats->tx_e2e_acked = LOAD(tx_e2e_acked);
+    stats->tx_e2e_failed = LOAD(tx_e2e_failed);
+    stats->rx_frames = LOAD(rx_frames);
+    stats->rx_bytes = LOAD(rx_bytes);
+    stats->rx_duplicates = LOAD(rx_duplicates);
+    stats->rx_out_of_order = LOAD(rx_out_of_order);
+    stats->rx_dropped = LOAD(rx_dropped);
+    stats->rx_rejected = LOAD(rx_rejected);
+    stats->rx_throttled = LOAD(rx_throttled);
+    stats->rx_decode_failed = LOAD(rx_decode_failed);
+    stats->rx_acks_sent = LOAD(rx_acks_sent);
+    stats->rx_acks_piggybacked = LOAD(rx_acks_piggybacked);
+    stats->fwd_frames = LOAD(fwd_frames);
+    stats->fwd_dropped = LOAD(fwd_dropped);
+    stats->fwd_latency_us = LOAD(fwd_latency_us);
+    stats->radio_up_us = LOAD(radio_up_us);
+    stats->first_tx_us = LOAD(first_tx_us);
+}
+
+int link_stats_format(const link_stats_t *stats, char *buf, int buf_len)
+{
+    int len = snprintf(buf, buf_len,
+                       "tx_queued=%lu tx_acked=%lu tx_failed=%lu tx_superseded=%lu cb_timeouts=%lu "
+                       "tx_credit_waits=%lu tx_compressed=%lu tx_saved=%lu e2e_acked=%lu e2e_failed=%lu "
+                       "rx_frames=%lu rx_bytes=%lu rx_dup=%lu rx_ooo=%lu rx_dropped=%lu rx_rejected=%lu "
+                       "rx_throttled=%lu rx_decode_failed=%lu acks_sent=%lu acks_piggybacked=%lu "
+                       "fwd=%lu fwd_dropped=%lu fwd_avg_us=%lu attempts=",
+                       (unsigned long)stats->tx_queued, (unsigned long)stats->tx_acked,
+                       (unsigned long)stats->tx_failed, (unsigned long)stats->tx_superseded,
+                       (unsigned long)stats->cb_timeouts,
+                       (unsigned long)stats->tx_credit_waits,
+                       (unsigned long)stats->tx_compressed, (unsigned long)stats->tx_bytes_saved,
+                       (unsigned long)stats->tx_e2e_acked, (unsigned long)stats->tx_e2e_failed,
+                       (unsigned long)stats->rx_frames, (unsigned long)stats->rx_bytes,
+                       (unsigned long)stats->rx_duplicates, (unsigned long)stats->rx_out_of_order,
+                       (unsigned long)stats->rx_dropped, (unsigned long)stats->rx_rejected,
+                       (unsigned long)stats->rx_throttled, (unsigned long)stats->rx_decode_failed,
+                       (unsigned long)stats->rx_acks_sent, (unsigned long)stats->rx_acks_piggybacked,
+                       (unsigned long)stats->fwd_frames, (unsigned long)stats->fwd_dropped,
+                       (unsigned long)(stats->fwd_frames > 0 ? stats->fwd_latency_us / stats->fwd_frames : 0));
+    for (int i = 0; i < LINK_STATS_RETRY_BUCKETS && len > 0 && len < buf_len; i++) {
+        len += snprintf(buf + len, buf_len - len, i == 0 ? "%lu" : "/%lu", (unsigned long)stats->tx_attempts[i]);
+    }
+    return len;
+}
@@ -0,0 +1,68 @@
+/**
+ * link_timing.c
+ *
+ * RTT estimation and retry timing (see link_timing.h).
+ */
+
+#include "link_timing.h"
+
+void link_timing_init(link_timing_t *timing)
+{
+    timing->srtt_us = 0;
+    timing->rttvar_us = 0;
+    timing->rtt_valid = false;
+    timing->failures = 0;
+}
+
+void link_timing_sample(link_timing_t *timing, int32_t rtt_us)
+{
+    if (rtt_us < 0) {
+        rtt_us = 0;
+    }
+    if (!timing->rtt_valid) {
+        timing->srtt_us = rtt_us;
+        timing->rttvar_us = rtt_us / 2;
+        timing->rtt_valid = true;
+    } else {
+        int32_t err = timing->srtt_us - rtt_us;
+        if (err < 0) {
+            err = -err;
+        }
+        timing->rttvar_us += (err - timing->rttvar_us) / 4;
+        timing->srtt_us += (rtt_us - timing->srtt_us) / 8;
+    }
+    timing->failures = 0;
+}
+
+void link_timing_failed(link_timing_t *timing)
+{
+    if (timing->failures < UINT8_MAX) {
+        timing->failures++;
+    }
+}
+
+static uint8_t backoff_shift(const link_timing_t *timing)
+{
+    return timing->failures < LINK_BACKOFF_MAX_SHIFT ? timing->failures : LINK_BACKOFF_MAX_SHIFT;
+}
+
+uint32_t link_timing_timeout_us(const link_timing_t *timing)
+{
+    uint64_t rto = timing->rtt_valid ? (uint64_t)timing->srtt_us + 4 * (uint64_t)timing->rttvar_us
+                                     : LINK_RTO_INITIAL_US;
+    if (rto < LINK_RTO_MIN_US) {
+        rto = LINK_RTO_MIN_US;
+    }
+    rto <<= backoff_shift(timing);
+    return rto > LINK_RTO_MAX_US ? LINK_RTO_MAX_US : (uint32_t)rto;
+}
+
+uint32_t link_timing_backoff_us(const link_timing_t *timing, uint32_t base_us, uint32_t rnd)
+{
+    uint64_t delay = (uint64_t)base_us << (timing->failures > 0 ? backoff_shift(timing) - 1 : 0);
+    if (delay > LINK_BACKOFF_MAX_US) {
+        delay = LINK_BACKOFF_MAX_US;
+    }
+    // delay * [0.5, 1.5): spreads out retries from nodes that failed together.
+    return (uint32_t)(delay / 2 + (delay * (rnd & 0xFFFF)) / 0x10000);
+}
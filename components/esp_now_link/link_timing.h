@@ -0,0 +1,42 @@
+/**
+ * link_timing.h
+ *
+ * Per-link send timing: smoothed RTT and RTT variance (RFC 6298 style) measured
+ * from esp_now_send() to the send callback, and the callback timeout and jittered
+ * exponential retry backoff derived from them.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LINK_RTO_INITIAL_US 100000  // Callback timeout until the first RTT sample
+#define LINK_RTO_MIN_US 10000       // One FreeRTOS tick at CONFIG_FREERTOS_HZ=100
+#define LINK_RTO_MAX_US 1000000
+#define LINK_BACKOFF_MAX_US 500000
+#define LINK_BACKOFF_MAX_SHIFT 6    // Stop doubling after this many consecutive failures
+
+typedef struct {
+    int32_t srtt_us;
+    int32_t rttvar_us;
+    bool rtt_valid;
+    uint8_t failures;               // Consecutive failed attempts, reset on success
+} link_timing_t;
+
+void link_timing_init(link_timing_t *timing);
+
+/** Feeds one RTT measurement of a successful attempt and clears the failure streak. */
+void link_timing_sample(link_timing_t *timing, int32_t rtt_us);
+
+/** Records a failed or timed-out attempt. */
+void link_timing_failed(link_timing_t *timing);
+
+/** Time to wait for a send callback, backed off while attempts keep timing out. */
+uint32_t link_timing_timeout_us(const link_timing_t *timing);
+
+/**
+ * Delay before the next retry: base_us doubled per consecutive failure, capped at
+ * LINK_BACKOFF_MAX_US, then scaled by a random factor in [0.5, 1.5) taken from rnd.
+ */
+uint32_t link_timing_backoff_us(const link_timing_t *timing, uint32_t base_us, uint32_t rnd);
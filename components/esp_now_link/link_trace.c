@@ -0,0 +1,144 @@
+/**
+ * link_trace.c
+ *
+ * Tracepoint ring and its console export (see link_trace.h).
+ */
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_cpu.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+#include "link_trace.h"
+
+#if CONFIG_LINK_TRACE
+
+#define TRACE_RING_SIZE CONFIG_LINK_TRACE_RING_SIZE
+#define TRACE_ANCHOR_CYCLES (1u << 30) // Re-pair a core's cycle count with esp_timer this often, 4.5 s at 240 MHz
+
+_Static_assert((TRACE_RING_SIZE & (TRACE_RING_SIZE - 1)) == 0, "CONFIG_LINK_TRACE_RING_SIZE must be a power of two");
+
+typedef struct {
+    atomic_uint stamp;              // Ring index + 1 once written, 0 while being written
+    uint32_t cycles;
+    uint16_t arg;
+    uint8_t event;                  // link_trace_event_t
+    uint8_t core;
+} trace_entry_t;
+
+// The cycle counters of the two cores do not run in step, so each core pairs
+// its own with esp_timer now and then. The dump puts the entries of both cores
+// on one time line through these pairs.
+typedef struct {
+    uint32_t cycles;
+    int64_t us;
+    bool valid;
+} trace_anchor_t;
+
+// Writers claim an index with one atomic add and never wait for each other.
+static trace_entry_t trace_ring[TRACE_RING_SIZE];
+static atomic_uint trace_head;
+static trace_anchor_t trace_anchors[portNUM_PROCESSORS];
+static portMUX_TYPE trace_anchor_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *const trace_event_names[LINK_TRACE_EVENT_COUNT] = {
+    [LINK_TRACE_TX_SEND] = "tx_send",
+    [LINK_TRACE_TX_DONE] = "tx_done",
+    [LINK_TRACE_RX_RECV] = "rx_recv",
+    [LINK_TRACE_RX_DEQUEUE] = "rx_dequeue",
+    [LINK_TRACE_RX_HANDLED] = "rx_handled",
+};
+
+static void trace_anchor_refresh(void)
+{
+    portENTER_CRITICAL(&trace_anchor_lock);
+    trace_anchor_t *anchor = &trace_anchors[esp_cpu_get_core_id()];
+    anchor->cycles = esp_cpu_get_cycle_count();
+    anchor->us = esp_timer_get_time();
+    anchor->valid = true;
+    portEXIT_CRITICAL(&trace_anchor_lock);
+}
+
+void link_trace_point(link_trace_event_t event, uint16_t arg)
+{
+    uint32_t cycles = esp_cpu_get_cycle_count();
+    int core = esp_cpu_get_core_id();
+    unsigned index = atomic_fetch_add_explicit(&trace_head, 1, memory_order_relaxed);
+    trace_entry_t *entry = &trace_ring[index % TRACE_RING_SIZE];
+
+    atomic_store_explicit(&entry->stamp, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    entry->cycles = cycles;
+    entry->arg = arg;
+    entry->event = (uint8_t)event;
+    entry->core = (uint8_t)core;
+    atomic_store_explicit(&entry->stamp, index + 1, memory_order_release);
+
+    const trace_anchor_t *anchor = &trace_anchors[core];
+    if (!anchor->valid || cycles - anchor->cycles >= TRACE_ANCHOR_CYCLES) {
+        trace_anchor_refresh();
+    }
+}
+
+void link_trace_dump(link_trace_format_t format)
+{
+    trace_anchor_t anchors[portNUM_PROCESSORS];
+    portENTER_CRITICAL(&trace_anchor_lock);
+    memcpy(anchors, trace_anchors, sizeof(anchors));
+    portEXIT_CRITICAL(&trace_anchor_lock);
+    int ticks_per_us = (int)esp_rom_get_cpu_ticks_per_us();
+
+    unsigned head = atomic_load_explicit(&trace_head, memory_order_acquire);
+    unsigned start = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    if (format == LINK_TRACE_FORMAT_JSON) {
+        printf("{\"traceEvents\":[\n");
+    } else {
+        printf("TRACE,begin,entries=%u,cpu_mhz=%d\n", head - start, ticks_per_us);
+    }
+
+    bool first = true;
+    for (unsigned index = start; index != head; index++) {
+        const trace_entry_t *slot = &trace_ring[index % TRACE_RING_SIZE];
+        unsigned stamp = atomic_load_explicit(&slot->stamp, memory_order_acquire);
+        uint32_t cycles = slot->cycles;
+        uint16_t arg = slot->arg;
+        uint8_t event = slot->event;
+        uint8_t core = slot->core;
+        atomic_thread_fence(memory_order_acquire);
+        if (stamp != index + 1 || atomic_load_explicit(&slot->stamp, memory_order_relaxed) != stamp ||
+            event >= LINK_TRACE_EVENT_COUNT || core >= portNUM_PROCESSORS) {
+            continue;  // Overwritten, or still being written
+        }
+        // Entries more than 2^31 cycles from their core's anchor (about 9 s) get wrong times.
+        const trace_anchor_t *anchor = &anchors[core];
+        int64_t us = anchor->valid && ticks_per_us > 0 ?
+                     anchor->us + (int32_t)(cycles - anchor->cycles) / ticks_per_us : 0;
+
+        if (format == LINK_TRACE_FORMAT_JSON) {
+            printf("%s{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%lld,\"pid\":1,\"tid\":%u,"
+                   "\"args\":{\"seq\":%u,\"cycles\":%lu}}\n",
+                   first ? "" : ",", trace_event_names[event], (long long)us, core, arg, (unsigned long)cycles);
+        } else {
+            printf("TRACE,%u,%u,%s,%u,%lu,%lld\n", index, core, trace_event_names[event], arg,
+                   (unsigned long)cycles, (long long)us);
+        }
+        first = false;
+    }
+
+    if (format == LINK_TRACE_FORMAT_JSON) {
+        printf("]}\n");
+    } else {
+        printf("TRACE,end\n");
+    }
+}
+
+#else
+
+void link_trace_dump(link_trace_format_t format)
+{
+}
+
+#endif
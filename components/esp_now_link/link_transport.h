@@ -0,0 +1,51 @@
+/**
+ * link_transport.h
+ *
+ * The frame transport under the link: peer registration, sending with a
+ * link-layer delivery report, and receiving. esp_now_link.c reaches the radio
+ * only through this interface. link_transport_esp_now is the real one; the
+ * host harness in host/ plugs a simulated channel in its place, so the framing,
+ * windowing and acknowledgement code can be measured without boards. Nothing
+ * here depends on FreeRTOS or ESP-NOW headers.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#define LINK_TRANSPORT_MAC_LEN 6    // Same as ESP_NOW_ETH_ALEN
+#define LINK_TRANSPORT_MAX_LEN 250  // Same as ESP_NOW_MAX_DATA_LEN
+
+typedef struct {
+    const uint8_t *src_mac;
+    const uint8_t *dest_mac;        // Our MAC or the broadcast address
+    int8_t rssi;
+} link_transport_rx_info_t;
+
+/** Link-layer report for one send. Runs in the transport's context and must not block. */
+typedef void (*link_transport_sent_cb_t)(const uint8_t *mac, bool delivered);
+
+/** One received frame. data is only valid during the call, which must not block. */
+typedef void (*link_transport_recv_cb_t)(const link_transport_rx_info_t *info, const uint8_t *data, int len);
+
+typedef struct {
+    /** Brings the transport up and sets the callbacks. The radio must already be running. */
+    esp_err_t (*init)(void *ctx, link_transport_sent_cb_t sent_cb, link_transport_recv_cb_t recv_cb);
+
+    /** Registers a peer, the broadcast address included. Returns ESP_OK if it already is. */
+    esp_err_t (*add_peer)(void *ctx, const uint8_t *mac);
+
+    esp_err_t (*del_peer)(void *ctx, const uint8_t *mac);
+
+    /**
+     * Queues one frame of up to LINK_TRANSPORT_MAX_LEN bytes; sent_cb follows
+     * unless an error is returned. ESP_ERR_NOT_FOUND means mac is not registered.
+     */
+    esp_err_t (*send)(void *ctx, const uint8_t *mac, const uint8_t *data, int len);
+
+    void *ctx;                      // Passed to every operation
+} link_transport_t;
+
+extern const link_transport_t link_transport_esp_now;
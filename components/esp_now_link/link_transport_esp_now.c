@@ -0,0 +1,76 @@
+/**
+ * link_transport_esp_now.c
+ *
+ * The ESP-NOW transport (see link_transport.h). PHY rates and the wake window
+ * are still set by phy_rate.c and duty_cycle.c, since they configure the radio
+ * rather than move frames.
+ */
+
+#include <string.h>
+#include "esp_now.h"
+#include "link_transport.h"
+
+_Static_assert(LINK_TRANSPORT_MAC_LEN == ESP_NOW_ETH_ALEN, "MAC length differs from ESP-NOW's");
+_Static_assert(LINK_TRANSPORT_MAX_LEN == ESP_NOW_MAX_DATA_LEN, "Frame length differs from ESP-NOW's");
+
+// ESP-NOW takes plain function pointers, so the link's callbacks live here.
+static link_transport_sent_cb_t sent_cb;
+static link_transport_recv_cb_t recv_cb;
+
+static void esp_now_sent(const uint8_t *mac_addr, esp_now_send_status_t status)
+{
+    sent_cb(mac_addr, status == ESP_NOW_SEND_SUCCESS);
+}
+
+static void esp_now_recv(const esp_now_recv_info_t *esp_now_info, const uint8_t *data, int data_len)
+{
+    link_transport_rx_info_t info = {
+        .src_mac = esp_now_info->src_addr,
+        .dest_mac = esp_now_info->des_addr,
+        .rssi = esp_now_info->rx_ctrl->rssi,
+    };
+    recv_cb(&info, data, data_len);
+}
+
+static esp_err_t esp_now_transport_init(void *ctx, link_transport_sent_cb_t on_sent, link_transport_recv_cb_t on_recv)
+{
+    esp_err_t ret = esp_now_init();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    sent_cb = on_sent;
+    recv_cb = on_recv;
+    esp_now_register_send_cb(esp_now_sent);
+    esp_now_register_recv_cb(esp_now_recv);
+    return ESP_OK;
+}
+
+static esp_err_t esp_now_transport_add_peer(void *ctx, const uint8_t *mac)
+{
+    esp_now_peer_info_t peer_info = {
+        .channel = 0,               // Follow the home channel, see channel.c
+        .encrypt = false,
+    };
+    memcpy(peer_info.peer_addr, mac, ESP_NOW_ETH_ALEN);
+    esp_err_t ret = esp_now_add_peer(&peer_info);
+    return ret == ESP_ERR_ESPNOW_EXIST ? ESP_OK : ret;
+}
+
+static esp_err_t esp_now_transport_del_peer(void *ctx, const uint8_t *mac)
+{
+    return esp_now_del_peer(mac);
+}
+
+static esp_err_t esp_now_transport_send(void *ctx, const uint8_t *mac, const uint8_t *data, int len)
+{
+    esp_err_t ret = esp_now_send(mac, data, len);
+    return ret == ESP_ERR_ESPNOW_NOT_FOUND ? ESP_ERR_NOT_FOUND : ret;
+}
+
+const link_transport_t link_transport_esp_now = {
+    .init = esp_now_transport_init,
+    .add_peer = esp_now_transport_add_peer,
+    .del_peer = esp_now_transport_del_peer,
+    .send = esp_now_transport_send,
+    .ctx = NULL,
+};
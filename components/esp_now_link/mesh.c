@@ -0,0 +1,285 @@
+/**
+ * mesh.c
+ *
+ * Route table, route advertisements and mesh message handling (see mesh.h).
+ *
+ * A route is replaced by one with fewer hops, by a clearly better path with
+ * the same hop count, or when it has not been refreshed by a HELLO for
+ * MESH_ROUTE_TIMEOUT_MS. Advertisements are bounded by CONFIG_MESH_MAX_HOPS, so
+ * a route that loops back through us can only count up to that before it
+ * stops being advertised and expires.
+ */
+
+#include <stdatomic.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include "mesh.h"
+#include "esp_now_link_priv.h"
+
+#if CONFIG_MESH
+
+static const char *TAG = "MESH";
+
+#define MESH_ROUTE_TABLE_SIZE 16
+#define MESH_ROUTE_TIMEOUT_MS 15000 // Three steady HELLO periods
+#define MESH_QUALITY_HYSTERESIS 32  // Better quality needed to move an equal-hop route
+#define MESH_DUP_CACHE_SIZE 32      // Recently seen (origin, msg_id) pairs
+#define MESH_RSSI_FLOOR -100        // Link quality 0
+#define MESH_RSSI_CEIL -40          // Link quality 255
+
+typedef struct {
+    bool used;
+    uint8_t dest[6];
+    uint8_t next_hop[6];
+    uint8_t hops;
+    uint8_t quality;
+    int64_t updated_ms;
+} mesh_route_t;
+
+typedef struct {
+    uint8_t origin[6];
+    uint16_t msg_id;
+} mesh_seen_t;
+
+static const uint8_t broadcast_mac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+static uint8_t my_mac[6];
+static atomic_uint next_msg_id;
+static mesh_recv_cb_t recv_cb;
+
+// Written by the RX worker, read by senders in mesh_send().
+static mesh_route_t routes[MESH_ROUTE_TABLE_SIZE];
+static portMUX_TYPE routes_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// Only touched by the RX worker.
+static mesh_seen_t seen[MESH_DUP_CACHE_SIZE];
+static int seen_next;
+
+static void log_message(const uint8_t *origin_mac, const uint8_t *data, int len, int hops)
+{
+    ESP_LOGI(TAG, "Received %d bytes from " MACSTR " over %d hop(s)", len, MAC2STR(origin_mac), hops);
+}
+
+static uint8_t link_quality(int8_t rssi)
+{
+    if (rssi <= MESH_RSSI_FLOOR) {
+        return 0;
+    }
+    if (rssi >= MESH_RSSI_CEIL) {
+        return 255;
+    }
+    return (rssi - MESH_RSSI_FLOOR) * 255 / (MESH_RSSI_CEIL - MESH_RSSI_FLOOR);
+}
+
+static bool route_live(const mesh_route_t *route, int64_t now_ms)
+{
+    return route->used && now_ms - route->updated_ms < MESH_ROUTE_TIMEOUT_MS;
+}
+
+// Caller holds routes_lock.
+static mesh_route_t *route_find(const uint8_t *dest, int64_t now_ms)
+{
+    for (int i = 0; i < MESH_ROUTE_TABLE_SIZE; i++) {
+        if (route_live(&routes[i], now_ms) && memcmp(routes[i].dest, dest, 6) == 0) {
+            return &routes[i];
+        }
+    }
+    return NULL;
+}
+
+// Caller holds routes_lock. Takes a free or expired entry, else the longest route.
+static mesh_route_t *route_victim(int64_t now_ms)
+{
+    mesh_route_t *victim = &routes[0];
+    for (int i = 0; i < MESH_ROUTE_TABLE_SIZE; i++) {
+        if (!route_live(&routes[i], now_ms)) {
+            return &routes[i];
+        }
+        if (routes[i].hops > victim->hops) {
+            victim = &routes[i];
+        }
+    }
+    return victim;
+}
+
+static void route_learn(const uint8_t *dest, const uint8_t *next_hop, int hops, uint8_t quality, int64_t now_ms)
+{
+    if (memcmp(dest, my_mac, 6) == 0 || hops > CONFIG_MESH_MAX_HOPS) {
+        return;
+    }
+    portENTER_CRITICAL(&routes_lock);
+    mesh_route_t *route = route_find(dest, now_ms);
+    bool replace = route == NULL || memcmp(route->next_hop, next_hop, 6) == 0 || hops < route->hops ||
+                   (hops == route->hops && quality > route->quality + MESH_QUALITY_HYSTERESIS);
+    if (route == NULL) {
+        route = route_victim(now_ms);
+        replace = !route_live(route, now_ms) || hops < route->hops;
+    }
+    if (replace) {
+        route->used = true;
+        memcpy(route->dest, dest, 6);
+        memcpy(route->next_hop, next_hop, 6);
+        route->hops = hops;
+        route->quality = quality;
+        route->updated_ms = now_ms;
+    }
+    portEXIT_CRITICAL(&routes_lock);
+}
+
+static bool route_next_hop(const uint8_t *dest, uint8_t next_hop[6])
+{
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    portENTER_CRITICAL(&routes_lock);
+    const mesh_route_t *route = route_find(dest, now_ms);
+    if (route != NULL) {
+        memcpy(next_hop, route->next_hop, 6);
+    }
+    portEXIT_CRITICAL(&routes_lock);
+    return route != NULL;
+}
+
+// Returns true if the message was seen before, and remembers it otherwise.
+static bool seen_before(const frame_mesh_t *hdr)
+{
+    for (int i = 0; i < MESH_DUP_CACHE_SIZE; i++) {
+        if (seen[i].msg_id == hdr->msg_id && memcmp(seen[i].origin, hdr->origin, 6) == 0) {
+            return true;
+        }
+    }
+    memcpy(seen[seen_next].origin, hdr->origin, 6);
+    seen[seen_next].msg_id = hdr->msg_id;
+    seen_next = (seen_next + 1) % MESH_DUP_CACHE_SIZE;
+    return false;
+}
+
+#endif // CONFIG_MESH
+
+esp_err_t mesh_init(void)
+{
+#if CONFIG_MESH
+    esp_read_mac(my_mac, ESP_MAC_WIFI_STA);
+    atomic_store(&next_msg_id, esp_random());
+    recv_cb = log_message;
+#endif
+    return ESP_OK;
+}
+
+void mesh_set_recv_cb(mesh_recv_cb_t cb)
+{
+#if CONFIG_MESH
+    recv_cb = cb != NULL ? cb : log_message;
+#endif
+}
+
+esp_err_t mesh_send(const uint8_t *dest_mac, const void *data, int len)
+{
+#if CONFIG_MESH
+    if (len < 0 || len > MESH_MAX_PAYLOAD_LEN) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t next_hop[6];
+    if (memcmp(dest_mac, broadcast_mac, 6) == 0) {
+        memcpy(next_hop, broadcast_mac, 6);
+    } else if (!route_next_hop(dest_mac, next_hop)) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    uint8_t payload[FRAME_MAX_PAYLOAD_LEN];
+    frame_mesh_t hdr = {
+        .msg_id = (uint16_t)atomic_fetch_add(&next_msg_id, 1),
+        .ttl = CONFIG_MESH_MAX_HOPS,
+    };
+    memcpy(hdr.origin, my_mac, 6);
+    memcpy(hdr.dest, dest_mac, 6);
+    memcpy(payload, &hdr, sizeof(hdr));
+    if (len > 0) {
+        memcpy(payload + sizeof(hdr), data, len);
+    }
+    return send_message(next_hop, FRAME_TYPE_MESH, payload, sizeof(hdr) + len, 0) ? ESP_OK : ESP_FAIL;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+int mesh_write_routes(uint8_t *buf, int buf_len)
+{
+#if CONFIG_MESH
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    int len = 0;
+    portENTER_CRITICAL(&routes_lock);
+    for (int i = 0; i < MESH_ROUTE_TABLE_SIZE && len + (int)sizeof(frame_route_t) <= buf_len; i++) {
+        const mesh_route_t *route = &routes[i];
+        if (!route_live(route, now_ms) || route->hops >= CONFIG_MESH_MAX_HOPS) {
+            continue;
+        }
+        frame_route_t entry = { .hops = route->hops, .quality = route->quality };
+        memcpy(entry.dest, route->dest, 6);
+        memcpy(buf + len, &entry, sizeof(entry));
+        len += sizeof(entry);
+    }
+    portEXIT_CRITICAL(&routes_lock);
+    return len;
+#else
+    return 0;
+#endif
+}
+
+void mesh_handle_hello(const uint8_t *src_mac, int8_t rssi, const uint8_t *payload, int len)
+{
+#if CONFIG_MESH
+    int64_t now_ms = esp_timer_get_time() / 1000;
+    uint8_t quality = link_quality(rssi);
+    route_learn(src_mac, src_mac, 1, quality, now_ms);
+    for (int offset = 0; offset + (int)sizeof(frame_route_t) <= len; offset += sizeof(frame_route_t)) {
+        frame_route_t entry;
+        memcpy(&entry, payload + offset, sizeof(entry));
+        route_learn(entry.dest, src_mac, entry.hops + 1, entry.quality < quality ? entry.quality : quality, now_ms);
+    }
+#endif
+}
+
+mesh_verdict_t mesh_handle_rx(const uint8_t *prev_hop, const uint8_t *payload, int len, uint8_t next_hop[6])
+{
+#if CONFIG_MESH
+    frame_mesh_t hdr;
+    if (len < (int)sizeof(hdr)) {
+        return MESH_RX_DONE;
+    }
+    memcpy(&hdr, payload, sizeof(hdr));
+    if (memcmp(hdr.origin, my_mac, 6) == 0 || seen_before(&hdr)) {
+        return MESH_RX_DONE;        // Our own flood coming back, or a copy over another path
+    }
+    bool flood = memcmp(hdr.dest, broadcast_mac, 6) == 0;
+    bool for_us = memcmp(hdr.dest, my_mac, 6) == 0;
+    if (flood || for_us) {
+        recv_cb(hdr.origin, payload + sizeof(hdr), len - sizeof(hdr), hdr.hops + 1);
+    }
+    if (for_us) {
+        return MESH_RX_DONE;
+    }
+    if (hdr.ttl <= 1) {
+        return MESH_RX_DROP;
+    }
+    if (flood) {
+        memcpy(next_hop, broadcast_mac, 6);
+    } else if (!route_next_hop(hdr.dest, next_hop) || memcmp(next_hop, prev_hop, 6) == 0) {
+        ESP_LOGD(TAG, "No route to " MACSTR, MAC2STR(hdr.dest));
+        return MESH_RX_DROP;
+    }
+    return MESH_RX_FORWARD;
+#else
+    return MESH_RX_DONE;
+#endif
+}
+
+void mesh_prepare_forward(uint8_t *payload)
+{
+    frame_mesh_t *hdr = (frame_mesh_t *)payload;
+    hdr->ttl--;
+    hdr->hops++;
+}
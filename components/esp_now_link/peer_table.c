@@ -0,0 +1,103 @@
+/**
+ * peer_table.c
+ *
+ * Hash-indexed peer table (see peer_table.h).
+ */
+
+#include <string.h>
+#include "peer_table.h"
+
+static unsigned peer_hash(const uint8_t *mac)
+{
+    // The vendor OUI is shared between boards, so mix in the device-specific bytes only.
+    return (mac[5] ^ (mac[4] << 3) ^ (mac[3] << 5)) & (PEER_TABLE_BUCKETS - 1);
+}
+
+void peer_table_init(peer_table_t *table)
+{
+    memset(table, 0, sizeof(*table));
+    memset(table->buckets, -1, sizeof(table->buckets));
+    for (int i = 0; i < PEER_TABLE_SIZE; i++) {
+        table->next[i] = (i + 1 < PEER_TABLE_SIZE) ? i + 1 : -1;
+    }
+    table->free_head = 0;
+}
+
+peer_t *peer_table_find(peer_table_t *table, const uint8_t *mac)
+{
+    for (int i = table->buckets[peer_hash(mac)]; i >= 0; i = table->next[i]) {
+        if (memcmp(table->peers[i].mac, mac, PEER_MAC_LEN) == 0) {
+            return &table->peers[i];
+        }
+    }
+    return NULL;
+}
+
+peer_t *peer_table_add(peer_table_t *table, const uint8_t *mac, bool *created)
+{
+    *created = false;
+    peer_t *peer = peer_table_find(table, mac);
+    if (peer != NULL) {
+        return peer;
+    }
+    if (table->free_head < 0) {
+        return NULL;
+    }
+
+    int index = table->free_head;
+    table->free_head = table->next[index];
+
+    unsigned bucket = peer_hash(mac);
+    table->next[index] = table->buckets[bucket];
+    table->buckets[bucket] = index;
+    table->used[index] = true;
+    table->count++;
+
+    peer = &table->peers[index];
+    memset(peer, 0, sizeof(*peer));
+    memcpy(peer->mac, mac, PEER_MAC_LEN);
+    *created = true;
+    return peer;
+}
+
+bool peer_table_remove(peer_table_t *table, const uint8_t *mac)
+{
+    int8_t *link = &table->buckets[peer_hash(mac)];
+    while (*link >= 0) {
+        int index = *link;
+        if (memcmp(table->peers[index].mac, mac, PEER_MAC_LEN) == 0) {
+            *link = table->next[index];
+            table->next[index] = table->free_head;
+            table->free_head = index;
+            table->used[index] = false;
+            table->count--;
+            return true;
+        }
+        link = &table->next[index];
+    }
+    return false;
+}
+
+peer_t *peer_table_oldest(peer_table_t *table)
+{
+    peer_t *oldest = NULL;
+    for (int i = 0; i < PEER_TABLE_SIZE; i++) {
+        if (table->used[i] && (oldest == NULL || table->peers[i].last_seen_ms < oldest->last_seen_ms)) {
+            oldest = &table->peers[i];
+        }
+    }
+    return oldest;
+}
+
+peer_t *peer_table_at(peer_table_t *table, int index)
+{
+    if (index < 0 || index >= PEER_TABLE_SIZE || !table->used[index]) {
+        return NULL;
+    }
+    return &table->peers[index];
+}
+
+int peer_table_index(const peer_table_t *table, const peer_t *peer)
+{
+    return (int)(peer - table->peers);
+}
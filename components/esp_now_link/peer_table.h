@@ -0,0 +1,86 @@
+/**
+ * peer_table.h
+ *
+ * Fixed-size table of known peers keyed by MAC address. Lookups go through a
+ * small chained hash index so the RX path finds a peer in constant time.
+ * The table does no locking; callers serialize access.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "link_timing.h"
+#include "link_stats.h"
+#include "replay_window.h"
+#include "phy_rate.h"
+#include "compress.h"
+#include "reliable.h"
+
+#define PEER_MAC_LEN 6
+#define PEER_TABLE_SIZE 19          // ESP_NOW_MAX_TOTAL_PEER_NUM minus the broadcast peer
+#define PEER_TABLE_BUCKETS 32       // Hash buckets (power of two)
+
+typedef struct {
+    uint8_t mac[PEER_MAC_LEN];
+    int64_t last_seen_ms;           // Last frame received from, or delivered to, the peer
+    uint32_t tx_seq;                // Counter of the next frame sent to the peer; the low half is its seq
+    uint32_t tx_msg_id;             // ID of the last DATA message queued to the peer, see tx_window_next_msg_id()
+    replay_window_t rx_window;      // Unicast frames received from the peer
+    replay_window_t rx_bcast_window; // Its broadcasts, which have their own sequence
+    uint16_t rx_next_seq;           // Next unicast sequence number to deliver in order
+    bool rx_next_valid;
+    uint32_t boot_id;               // From the peer's last HELLO, 0 if none seen yet
+    uint64_t session_nonce;         // Ours for the peer, see link_crypto.h; new with the entry and whenever the peer's changes
+    uint64_t peer_nonce;            // The peer's, bound to session_nonce; 0 until the handshake is done
+    uint8_t session_key[16];        // Derived from both nonces once bound
+    bool key_valid;
+    uint32_t rx_counter_top;        // Highest frame counter authenticated from the peer
+    bool rx_counter_valid;
+    int8_t rssi;                    // RSSI of the last received frame
+    phy_rate_state_t rate;          // Rung used for frames sent to the peer
+    bool tx_limited;                // The peer asked us to slow down: only tx_credits more bulk frames
+    uint8_t tx_credits;
+    int64_t tx_limited_at_us;       // Last grant while limited, for the probe timeout
+    bool rx_credit_due;             // The peer sent to us while our RX queue was filling up
+    bool rx_credit_owed;            // We limited the peer and owe it an unlimited grant
+    link_timing_t timing;
+    link_counters_t counters;
+#if CONFIG_FRAME_COMPRESS
+    compress_history_t delta_tx;    // Keyframes sent to the peer
+    compress_history_t delta_rx;    // Keyframes received from it
+#endif
+#if CONFIG_LINK_RELIABLE
+    uint16_t tx_rseq;               // Number of the last reliable frame sent to the peer, 0 before the first
+    reliable_rx_t rel_rx;           // Reliable frames received from it
+    bool rel_ack_owed;              // It sent reliable frames since our last acknowledgement
+#endif
+} peer_t;
+
+typedef struct {
+    peer_t peers[PEER_TABLE_SIZE];
+    bool used[PEER_TABLE_SIZE];
+    int8_t next[PEER_TABLE_SIZE];   // Next entry in the same bucket, or in the free list
+    int8_t buckets[PEER_TABLE_BUCKETS];
+    int8_t free_head;
+    int count;
+} peer_table_t;
+
+void peer_table_init(peer_table_t *table);
+
+/** Returns the peer for mac, or NULL if it is unknown. */
+peer_t *peer_table_find(peer_table_t *table, const uint8_t *mac);
+
+/** Returns the existing entry for mac or a new zeroed one; NULL if the table is full. */
+peer_t *peer_table_add(peer_table_t *table, const uint8_t *mac, bool *created);
+
+bool peer_table_remove(peer_table_t *table, const uint8_t *mac);
+
+/** Returns the peer with the oldest last_seen_ms, or NULL if the table is empty. */
+peer_t *peer_table_oldest(peer_table_t *table);
+
+/** Iteration helper: returns the entry at index, or NULL if that slot is unused. */
+peer_t *peer_table_at(peer_table_t *table, int index);
+
+/** Index of an entry, stable for as long as the peer stays in the table. */
+int peer_table_index(const peer_table_t *table, const peer_t *peer);
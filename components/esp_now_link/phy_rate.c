@@ -0,0 +1,145 @@
+/**
+ * phy_rate.c
+ *
+ * PHY rate ladder and per-peer rate adaptation (see phy_rate.h).
+ */
+
+#include "esp_now.h"
+#include "esp_wifi.h"
+#include "sdkconfig.h"
+#include "phy_rate.h"
+
+#define RATE_DOWN_AFTER 2           // Consecutive failures before stepping down
+#define RATE_UP_AFTER_MIN 10        // Successes before the first probe upward
+#define RATE_UP_AFTER_MAX 160       // Cap for the doubling after failed probes
+
+typedef struct {
+    wifi_phy_mode_t phymode;
+    wifi_phy_rate_t rate;
+    const char *name;
+} phy_rate_rung_t;
+
+static const phy_rate_rung_t rungs[] = {
+#if CONFIG_PHY_LONG_RANGE
+    { WIFI_PHY_MODE_LR, WIFI_PHY_RATE_LORA_250K, "LR-250K" },
+    { WIFI_PHY_MODE_LR, WIFI_PHY_RATE_LORA_500K, "LR-500K" },
+#endif
+    { WIFI_PHY_MODE_11B, WIFI_PHY_RATE_1M_L, "1M" },
+    { WIFI_PHY_MODE_11B, WIFI_PHY_RATE_2M_L, "2M" },
+    { WIFI_PHY_MODE_11G, WIFI_PHY_RATE_6M, "6M" },
+    { WIFI_PHY_MODE_11G, WIFI_PHY_RATE_12M, "12M" },
+    { WIFI_PHY_MODE_11G, WIFI_PHY_RATE_24M, "24M" },
+    { WIFI_PHY_MODE_HT20, WIFI_PHY_RATE_MCS3_LGI, "MCS3" },
+    { WIFI_PHY_MODE_HT20, WIFI_PHY_RATE_MCS5_LGI, "MCS5" },
+    { WIFI_PHY_MODE_HT20, WIFI_PHY_RATE_MCS7_LGI, "MCS7" },
+};
+
+#define RUNG_COUNT ((int)(sizeof(rungs) / sizeof(rungs[0])))
+
+#if CONFIG_PHY_RATE_LR_250K
+#define CONFIGURED_RATE WIFI_PHY_RATE_LORA_250K
+#elif CONFIG_PHY_RATE_LR_500K
+#define CONFIGURED_RATE WIFI_PHY_RATE_LORA_500K
+#elif CONFIG_PHY_RATE_2M
+#define CONFIGURED_RATE WIFI_PHY_RATE_2M_L
+#elif CONFIG_PHY_RATE_6M || CONFIG_PHY_RATE_AUTO
+#define CONFIGURED_RATE WIFI_PHY_RATE_6M  // Where adaptation starts
+#elif CONFIG_PHY_RATE_12M
+#define CONFIGURED_RATE WIFI_PHY_RATE_12M
+#elif CONFIG_PHY_RATE_24M
+#define CONFIGURED_RATE WIFI_PHY_RATE_24M
+#elif CONFIG_PHY_RATE_MCS3
+#define CONFIGURED_RATE WIFI_PHY_RATE_MCS3_LGI
+#elif CONFIG_PHY_RATE_MCS5
+#define CONFIGURED_RATE WIFI_PHY_RATE_MCS5_LGI
+#elif CONFIG_PHY_RATE_MCS7
+#define CONFIGURED_RATE WIFI_PHY_RATE_MCS7_LGI
+#else
+#define CONFIGURED_RATE WIFI_PHY_RATE_1M_L
+#endif
+
+esp_err_t phy_rate_init(void)
+{
+#if CONFIG_PHY_LONG_RANGE
+    return esp_wifi_set_protocol(WIFI_IF_STA, WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N | WIFI_PROTOCOL_LR);
+#else
+    return ESP_OK;
+#endif
+}
+
+int phy_rate_initial(void)
+{
+    for (int i = 0; i < RUNG_COUNT; i++) {
+        if (rungs[i].rate == CONFIGURED_RATE) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+int phy_rate_broadcast(void)
+{
+#if CONFIG_PHY_RATE_AUTO
+    return 0;
+#else
+    return phy_rate_initial();
+#endif
+}
+
+const char *phy_rate_name(int index)
+{
+    return index >= 0 && index < RUNG_COUNT ? rungs[index].name : "?";
+}
+
+esp_err_t phy_rate_apply(const uint8_t *mac, int index)
+{
+    esp_now_rate_config_t config = {
+        .phymode = rungs[index].phymode,
+        .rate = rungs[index].rate,
+        .ersu = false,
+        .dcm = false,
+    };
+    return esp_now_set_peer_rate_config(mac, &config);
+}
+
+void phy_rate_state_init(phy_rate_state_t *state)
+{
+    state->index = phy_rate_initial();
+    state->successes = 0;
+    state->failures = 0;
+    state->up_after = RATE_UP_AFTER_MIN;
+    state->probing = false;
+}
+
+bool phy_rate_on_result(phy_rate_state_t *state, bool delivered)
+{
+#if CONFIG_PHY_RATE_AUTO
+    if (delivered) {
+        state->failures = 0;
+        state->probing = false;
+        if (++state->successes >= state->up_after && state->index + 1 < RUNG_COUNT) {
+            state->index++;
+            state->successes = 0;
+            state->probing = true;
+            return true;
+        }
+        return false;
+    }
+
+    state->successes = 0;
+    if (state->probing) {
+        // The faster rung failed straight away: go back and probe less often.
+        state->index--;
+        state->probing = false;
+        state->up_after = state->up_after * 2 < RATE_UP_AFTER_MAX ? state->up_after * 2 : RATE_UP_AFTER_MAX;
+        return true;
+    }
+    if (++state->failures >= RATE_DOWN_AFTER && state->index > 0) {
+        state->index--;
+        state->failures = 0;
+        state->up_after = RATE_UP_AFTER_MIN;
+        return true;
+    }
+#endif
+    return false;
+}
@@ -0,0 +1,48 @@
+/**
+ * phy_rate.h
+ *
+ * PHY rate selection for ESP-NOW frames. Rates form a ladder from the most
+ * robust (LR or 1 Mbps 802.11b) to the fastest 802.11n MCS. With
+ * CONFIG_PHY_RATE_AUTO each peer climbs and descends the ladder on its own,
+ * following AARF: step down after repeated failures, probe one rung up after a
+ * run of successes, and wait longer before the next probe when one fails.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+typedef struct {
+    uint8_t index;                  // Current rung of the ladder
+    uint8_t successes;              // Consecutive delivered attempts at this rung
+    uint8_t failures;               // Consecutive failed attempts at this rung
+    uint8_t up_after;               // Successes needed before probing the next rung
+    bool probing;                   // No attempt has succeeded since stepping up
+} phy_rate_state_t;
+
+/** Enables the LR protocol when configured. Call before esp_wifi_start(). */
+esp_err_t phy_rate_init(void);
+
+void phy_rate_state_init(phy_rate_state_t *state);
+
+/**
+ * Feeds the result of one transmission attempt. Returns true if the peer should
+ * move to a different rung, already stored in state->index.
+ */
+bool phy_rate_on_result(phy_rate_state_t *state, bool delivered);
+
+/** Applies a rung to a registered ESP-NOW peer, the broadcast address included. */
+esp_err_t phy_rate_apply(const uint8_t *mac, int index);
+
+/** Rung new peers and broadcasts start on. */
+int phy_rate_initial(void);
+
+/**
+ * Rung for broadcasts. Auto mode keeps them on the most robust rung since a
+ * broadcast gets no link-layer ACK to adapt on.
+ */
+int phy_rate_broadcast(void);
+
+const char *phy_rate_name(int index);
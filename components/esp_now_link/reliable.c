@@ -0,0 +1,65 @@
+/**
+ * reliable.c
+ *
+ * Cumulative and selective acknowledgement state (see reliable.h).
+ */
+
+#include "reliable.h"
+
+void reliable_rx_init(reliable_rx_t *rx)
+{
+    rx->cum = 0;
+    rx->sack = 0;
+}
+
+// Folds the leading run of received frames into cum.
+static void reliable_rx_advance(reliable_rx_t *rx)
+{
+    while (rx->sack & 1) {
+        rx->cum++;
+        rx->sack >>= 1;
+    }
+}
+
+reliable_result_t reliable_rx_check(reliable_rx_t *rx, uint16_t rseq)
+{
+    int ahead = (int16_t)(rseq - rx->cum);
+    if (ahead <= -RELIABLE_RESYNC_GAP) {
+        rx->cum = rseq - 1;
+        rx->sack = 0;
+        ahead = 1;
+    } else if (ahead <= 0) {
+        return RELIABLE_DUPLICATE;
+    } else if (ahead > RELIABLE_SACK_BITS) {
+        int shift = ahead - RELIABLE_SACK_BITS;
+        rx->sack = shift >= RELIABLE_SACK_BITS ? 0 : rx->sack >> shift;
+        rx->cum += shift;
+        ahead = RELIABLE_SACK_BITS;
+    }
+
+    uint32_t bit = (uint32_t)1 << (ahead - 1);
+    if (rx->sack & bit) {
+        return RELIABLE_DUPLICATE;
+    }
+    rx->sack |= bit;
+    reliable_rx_advance(rx);
+    return RELIABLE_NEW;
+}
+
+void reliable_rx_ack(const reliable_rx_t *rx, frame_ack_t *ack)
+{
+    ack->cum = rx->cum;
+    ack->sack = rx->sack;
+}
+
+bool reliable_acked(const frame_ack_t *ack, uint16_t last_rseq, uint16_t rseq)
+{
+    if ((int16_t)(last_rseq - ack->cum) < 0) {
+        return false;
+    }
+    int ahead = (int16_t)(rseq - ack->cum);
+    if (ahead <= 0) {
+        return true;
+    }
+    return ahead <= RELIABLE_SACK_BITS && (ack->sack & ((uint32_t)1 << (ahead - 1)));
+}
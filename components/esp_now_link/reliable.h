@@ -0,0 +1,47 @@
+/**
+ * reliable.h
+ *
+ * End-to-end acknowledgement state of CONFIG_LINK_RELIABLE. Every reliable
+ * frame to a peer carries the next number of a dense per-peer sequence
+ * (frame_rel_t), and the receiver answers with the highest number up to which
+ * it holds everything plus a bitmap of the RELIABLE_SACK_BITS after it
+ * (frame_ack_t), as with TCP's cumulative and selective ACKs (RFC 2018).
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "frame.h"
+
+#define RELIABLE_SACK_BITS 32       // Reliable frames a sender may have outstanding to one peer
+#define RELIABLE_RESYNC_GAP 1024    // A frame this far behind means the sender restarted
+
+typedef enum {
+    RELIABLE_NEW,
+    RELIABLE_DUPLICATE,             // Already received: acknowledge again, do not deliver
+} reliable_result_t;
+
+typedef struct {
+    uint16_t cum;                   // Everything up to and including cum was received
+    uint32_t sack;                  // Bit n set: cum + 1 + n was received
+} reliable_rx_t;
+
+/** Resets the receive state to expect the first frame of a new sender, numbered 1. A zeroed one is the same. */
+void reliable_rx_init(reliable_rx_t *rx);
+
+/**
+ * Classifies rseq and, unless it is a duplicate, marks it as received. A frame
+ * beyond the bitmap moves the window up to it: the sender has given up on the
+ * frames that drop out below.
+ */
+reliable_result_t reliable_rx_check(reliable_rx_t *rx, uint16_t rseq);
+
+/** Fills the acknowledgement for the current state. */
+void reliable_rx_ack(const reliable_rx_t *rx, frame_ack_t *ack);
+
+/**
+ * Sender side: whether ack covers rseq. last_rseq is the number of the newest
+ * frame sent; acks ahead of it answer an earlier boot of ours and cover nothing.
+ */
+bool reliable_acked(const frame_ack_t *ack, uint16_t last_rseq, uint16_t rseq);
@@ -0,0 +1,60 @@
+/**
+ * replay_window.c
+ *
+ * Anti-replay bitmap window (see replay_window.h).
+ */
+
+#include "replay_window.h"
+
+void replay_window_init(replay_window_t *window)
+{
+    window->top = 0;
+    window->bitmap = 0;
+    window->valid = false;
+}
+
+static void replay_window_reset(replay_window_t *window, uint16_t seq)
+{
+    window->top = seq;
+    window->bitmap = 1;
+    window->valid = true;
+}
+
+replay_result_t replay_window_check(replay_window_t *window, uint16_t seq)
+{
+    if (!window->valid) {
+        replay_window_reset(window, seq);
+        return REPLAY_NEW;
+    }
+
+    int16_t diff = (int16_t)(seq - window->top);
+    if (diff > 0) {
+        window->bitmap = (diff >= REPLAY_WINDOW_BITS) ? 1 : (window->bitmap << diff) | 1;
+        window->top = seq;
+        return REPLAY_NEW;
+    }
+
+    int offset = -diff;
+    if (offset >= REPLAY_RESYNC_GAP) {
+        // Far behind anything a retry could produce: the sender rebooted and restarted its sequence.
+        replay_window_reset(window, seq);
+        return REPLAY_NEW;
+    }
+    if (offset >= REPLAY_WINDOW_BITS) {
+        return REPLAY_DUPLICATE;
+    }
+    uint64_t bit = (uint64_t)1 << offset;
+    if (window->bitmap & bit) {
+        return REPLAY_DUPLICATE;
+    }
+    window->bitmap |= bit;
+    return REPLAY_NEW_OUT_OF_ORDER;
+}
+
+void replay_window_forget(replay_window_t *window, uint16_t seq)
+{
+    int offset = -(int16_t)(seq - window->top);
+    if (window->valid && offset >= 0 && offset < REPLAY_WINDOW_BITS) {
+        window->bitmap &= ~((uint64_t)1 << offset);
+    }
+}
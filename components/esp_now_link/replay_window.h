@@ -0,0 +1,39 @@
+/**
+ * replay_window.h
+ *
+ * Sliding-window duplicate detection over 16-bit frame sequence numbers, in the
+ * style of the IPsec anti-replay window (RFC 4303, 3.4.3). The window tracks the
+ * highest sequence number seen plus a bitmap of the REPLAY_WINDOW_BITS below it,
+ * so each check is O(1).
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define REPLAY_WINDOW_BITS 64
+#define REPLAY_RESYNC_GAP 1024      // A frame this far behind means the sender restarted
+
+typedef enum {
+    REPLAY_NEW,                     // Highest sequence number so far
+    REPLAY_NEW_OUT_OF_ORDER,        // Not seen before, but behind the highest
+    REPLAY_DUPLICATE,               // Already seen, or too old to tell
+} replay_result_t;
+
+typedef struct {
+    uint16_t top;                   // Highest sequence number accepted
+    uint64_t bitmap;                // Bit n set: top - n was accepted
+    bool valid;
+} replay_window_t;
+
+void replay_window_init(replay_window_t *window);
+
+/** Classifies seq and, unless it is a duplicate, marks it as seen. */
+replay_result_t replay_window_check(replay_window_t *window, uint16_t seq);
+
+/**
+ * Unmarks seq, accepted by replay_window_check() for a frame that could not be
+ * processed, so that a retransmission of it is taken as new.
+ */
+void replay_window_forget(replay_window_t *window, uint16_t seq);
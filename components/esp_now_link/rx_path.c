@@ -0,0 +1,669 @@
+/**
+ * rx_path.c
+ *
+ * Receive path of the link (see rx_path.h).
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "rx_path.h"
+#include "batch.h"
+#include "compress.h"
+#include "reliable.h"
+#include "replay_window.h"
+#include "tx_window.h"
+
+static const char *TAG = "ESP-NOW RX";
+
+static const uint8_t broadcast_mac[PEER_MAC_LEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+typedef enum {
+    RX_DROP,                        // Duplicate of a frame already delivered
+    RX_DELIVER,
+    RX_HOLD,                        // Ahead of a gap in the peer's sequence
+} rx_verdict_t;
+
+typedef struct {
+    rx_path_t *rx;
+    const frame_buf_t *buf;
+} rx_msg_ctx_t;
+
+static void env_lock(const rx_path_t *rx)
+{
+    rx->env->lock(rx->env->ctx);
+}
+
+static void env_unlock(const rx_path_t *rx)
+{
+    rx->env->unlock(rx->env->ctx);
+}
+
+static peer_t *env_peer(const rx_path_t *rx, const uint8_t *mac_addr)
+{
+    return peer_table_find(rx->env->peers, mac_addr);
+}
+
+static bool is_broadcast(const uint8_t *mac)
+{
+    return memcmp(mac, broadcast_mac, PEER_MAC_LEN) == 0;
+}
+
+void rx_path_init(rx_path_t *rx, const rx_path_env_t *env)
+{
+    memset(rx, 0, sizeof(*rx));
+    rx->env = env;
+    atomic_init(&rx->credit_owed_any, false);
+#if CONFIG_RX_REORDER
+    rx_reorder_init(&rx->reorder, CONFIG_RX_REORDER_DEPTH);
+#endif
+#if CONFIG_LINK_ENCRYPT
+    link_crypto_ctx_init(&rx->crypto);
+#endif
+}
+
+// Forgets what the peer's unicast frames told us so far: their sequence and
+// counter, its keyframes and its reliable frames. Under CONFIG_LINK_ENCRYPT
+// this happens only when a new key is bound, so frames recorded under an
+// earlier key can never pass the fresh windows.
+static void rx_session_reset(peer_t *peer)
+{
+    replay_window_init(&peer->rx_window);
+    peer->rx_next_valid = false;
+    peer->rx_counter_valid = false;
+#if CONFIG_FRAME_COMPRESS
+    // It lost the keyframes we sent before, and ours from it are stale.
+    compress_history_init(&peer->delta_tx);
+    compress_history_init(&peer->delta_rx);
+#endif
+#if CONFIG_LINK_RELIABLE
+    reliable_rx_init(&peer->rel_rx);
+    peer->rel_ack_owed = false;
+#endif
+}
+
+#if CONFIG_LINK_ENCRYPT
+// Rejects an authenticated frame whose 32-bit counter is older than the replay
+// window, which the 16-bit seq alone cannot tell once it has wrapped.
+static bool rx_counter_check(peer_t *peer, uint32_t counter)
+{
+    int32_t diff = (int32_t)(counter - peer->rx_counter_top);
+    if (peer->rx_counter_valid && diff <= -REPLAY_WINDOW_BITS) {
+        return false;
+    }
+    if (!peer->rx_counter_valid || diff > 0) {
+        peer->rx_counter_top = counter;
+        peer->rx_counter_valid = true;
+    }
+    return true;
+}
+
+// Gives the peer a session nonce of ours that no key was derived from yet.
+static void session_restart(rx_path_t *rx, peer_t *peer)
+{
+    uint64_t nonce = (uint64_t)rx->env->random(rx->env->ctx) << 32 | rx->env->random(rx->env->ctx);
+    peer->session_nonce = nonce | 1; // 0 means "none"
+    peer->peer_nonce = 0;
+    peer->key_valid = false;
+}
+
+// Runs the nonce handshake of link_crypto.h for a unicast HELLO or HELLO-ACK.
+// Our nonce binds the peer's only while it is unbound, and only to a peer that
+// is unbound too or already bound to ours. Returns true if the peer needs a
+// HELLO-ACK to finish its side.
+static bool session_hello(rx_path_t *rx, peer_t *peer, const frame_hello_t *hello)
+{
+    if (hello->nonce == 0) {
+        return false;               // The peer has no entry for us yet; our answer will create it
+    }
+    if (hello->nonce == peer->peer_nonce) {
+        return hello->peer_nonce != peer->session_nonce;
+    }
+    if (peer->peer_nonce != 0) {
+        session_restart(rx, peer);  // The peer has a new nonce; ours is spent on its old one
+    }
+    if (hello->peer_nonce != 0 && hello->peer_nonce != peer->session_nonce) {
+        return true;                // It is bound to a nonce of ours that is gone and must move on
+    }
+    peer->peer_nonce = hello->nonce;
+    rx_session_reset(peer);
+    return hello->peer_nonce == 0;
+}
+
+// Runs the key derivation outside the env lock, since the SHA accelerator may block.
+static void derive_session_key(rx_path_t *rx, const uint8_t *mac, uint64_t session_nonce, uint64_t peer_nonce)
+{
+    uint8_t key[LINK_CRYPTO_KEY_LEN];
+    if (link_crypto_derive(rx->env->own_mac, session_nonce, mac, peer_nonce, key) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to derive session key for " MACSTR, MAC2STR(mac));
+        return;
+    }
+    env_lock(rx);
+    peer_t *peer = env_peer(rx, mac);
+    if (peer != NULL && peer->session_nonce == session_nonce && peer->peer_nonce == peer_nonce) {
+        memcpy(peer->session_key, key, sizeof(key));
+        peer->key_valid = true;
+    }
+    env_unlock(rx);
+    ESP_LOGI(TAG, "Session key ready for " MACSTR, MAC2STR(mac));
+}
+
+// Authenticates and decrypts a sealed frame in place. Unsealed frames are only
+// accepted for the types the TX side always sends in clear, as frames of their own.
+static bool rx_unseal(rx_path_t *rx, frame_buf_t *buf, frame_header_t *hdr, int32_t *counter_hi)
+{
+    if (!(hdr->flags & FRAME_FLAG_ENCRYPTED)) {
+        *counter_hi = -1;
+        return tx_sent_in_clear(hdr->type);
+    }
+    uint8_t key[LINK_CRYPTO_KEY_LEN];
+    bool keyed = false;
+    env_lock(rx);
+    const peer_t *peer = env_peer(rx, buf->mac);
+    if (peer != NULL && peer->key_valid) {
+        memcpy(key, peer->session_key, sizeof(key));
+        keyed = true;
+    }
+    env_unlock(rx);
+
+    int len = buf->len;
+    uint16_t hi;
+    if (!keyed || !link_crypto_open(&rx->crypto, key, buf->mac, buf->data, &len, &hi)) {
+        return false;
+    }
+    buf->len = len;
+    memcpy(hdr, buf->data, FRAME_HEADER_LEN);
+    *counter_hi = hi;
+    return true;
+}
+#endif
+
+void rx_path_peer_added(rx_path_t *rx, peer_t *peer)
+{
+#if CONFIG_LINK_ENCRYPT
+    session_restart(rx, peer);
+#endif
+}
+
+void rx_path_hello(rx_path_t *rx, const uint8_t *mac, frame_hello_t *hello)
+{
+    hello->nonce = 0;
+    hello->peer_nonce = 0;
+#if CONFIG_LINK_ENCRYPT
+    env_lock(rx);
+    peer_t *peer = env_peer(rx, mac);
+    if (peer != NULL) {
+        hello->nonce = peer->session_nonce;
+        hello->peer_nonce = peer->peer_nonce;
+    }
+    env_unlock(rx);
+#endif
+}
+
+#if CONFIG_RX_REORDER
+// Decides whether a new unicast frame is next in line. Called with the env lock held.
+static rx_verdict_t rx_order_check(peer_t *peer, uint16_t seq)
+{
+    int16_t ahead = (int16_t)(seq - peer->rx_next_seq);
+    if (!peer->rx_next_valid || ahead == 0 || -ahead >= REPLAY_RESYNC_GAP) {
+        peer->rx_next_seq = seq + 1;
+        peer->rx_next_valid = true;
+        return RX_DELIVER;
+    }
+    // Frames behind rx_next_seq arrived after their gap was given up on: deliver them late.
+    return ahead > 0 ? RX_HOLD : RX_DELIVER;
+}
+
+// Moves the peer's in-order position past seq, never backwards.
+static void rx_order_advance(rx_path_t *rx, const uint8_t *mac, uint16_t seq)
+{
+    env_lock(rx);
+    peer_t *peer = env_peer(rx, mac);
+    if (peer != NULL && (!peer->rx_next_valid || (int16_t)(seq + 1 - peer->rx_next_seq) > 0)) {
+        peer->rx_next_seq = seq + 1;
+        peer->rx_next_valid = true;
+    }
+    env_unlock(rx);
+}
+
+static bool rx_order_next(rx_path_t *rx, const uint8_t *mac, uint16_t *seq)
+{
+    env_lock(rx);
+    peer_t *peer = env_peer(rx, mac);
+    bool valid = peer != NULL && peer->rx_next_valid;
+    if (valid) {
+        *seq = peer->rx_next_seq;
+    }
+    env_unlock(rx);
+    return valid;
+}
+#endif
+
+// Records a frame from a unicast source in its peer's entry. Duplicates are
+// detected per sequence space: the peer's unicast frames and its broadcasts
+// are numbered independently. A HELLO with a new boot ID resets both, or under
+// CONFIG_LINK_ENCRYPT only the broadcast one: the HELLO is in clear, so the
+// sealed unicast state starts over only with a new key. counter_hi is the high
+// half of the frame counter of a sealed frame, -1 for a plain one.
+static rx_verdict_t rx_peer_check(rx_path_t *rx, const frame_buf_t *buf, const frame_header_t *hdr,
+                                  const uint8_t *payload, int32_t counter_hi)
+{
+    uint16_t seq = hdr->seq;
+    bool broadcast = is_broadcast(buf->dest_mac);
+    bool answer = false;
+    rx_verdict_t verdict = RX_DELIVER;
+
+    env_lock(rx);
+    peer_t *peer = env_peer(rx, buf->mac);
+    if (peer == NULL) {
+        env_unlock(rx);
+        return RX_DROP;
+    }
+    LINK_STATS_INC(&peer->counters, rx_frames);
+    LINK_STATS_ADD(&peer->counters, rx_bytes, buf->len);
+    if ((hdr->type == FRAME_TYPE_DISCOVERY || hdr->type == FRAME_TYPE_DISCOVERY_ACK) &&
+        hdr->payload_len >= sizeof(frame_hello_t)) {
+        frame_hello_t hello;
+        memcpy(&hello, payload, sizeof(hello));
+        if (hello.boot_id != peer->boot_id) {
+            // The peer restarted and numbers its frames from 0 again.
+            replay_window_init(&peer->rx_bcast_window);
+            peer->boot_id = hello.boot_id;
+#if !CONFIG_LINK_ENCRYPT
+            rx_session_reset(peer);
+#endif
+        }
+#if CONFIG_LINK_ENCRYPT
+        if (!broadcast) {
+            answer = session_hello(rx, peer, &hello) && hdr->type == FRAME_TYPE_DISCOVERY_ACK;
+        }
+#endif
+    }
+#if CONFIG_LINK_ENCRYPT
+    bool fresh = counter_hi < 0 || broadcast || rx_counter_check(peer, ((uint32_t)counter_hi << 16) | seq);
+#else
+    bool fresh = true;
+#endif
+    replay_window_t *window = broadcast ? &peer->rx_bcast_window : &peer->rx_window;
+    switch (fresh ? replay_window_check(window, seq) : REPLAY_DUPLICATE) {
+    case REPLAY_DUPLICATE:
+        LINK_STATS_INC(&peer->counters, rx_duplicates);
+        LINK_STATS_INC(rx->env->counters, rx_duplicates);
+        verdict = RX_DROP;
+        break;
+    case REPLAY_NEW_OUT_OF_ORDER:
+        LINK_STATS_INC(&peer->counters, rx_out_of_order);
+        LINK_STATS_INC(rx->env->counters, rx_out_of_order);
+        break;
+    case REPLAY_NEW:
+        break;
+    }
+#if CONFIG_RX_REORDER
+    if (verdict == RX_DELIVER && !broadcast) {
+        verdict = rx_order_check(peer, seq);
+    }
+#endif
+#if CONFIG_LINK_ENCRYPT
+    uint64_t session_nonce = peer->session_nonce;
+    uint64_t peer_nonce = peer->peer_nonce;
+    bool rekey = peer_nonce != 0 && !peer->key_valid;
+#endif
+    env_unlock(rx);
+
+#if CONFIG_LINK_ENCRYPT
+    if (rekey) {
+        derive_session_key(rx, buf->mac, session_nonce, peer_nonce);
+    }
+#endif
+    if (answer && rx->env->hello_owed != NULL) {
+        rx->env->hello_owed(rx->env->ctx, buf->mac); // A HELLO is answered by whoever handles its message
+    }
+    return verdict;
+}
+
+// Takes back rx_peer_check()'s record of a frame that was not delivered, so
+// that a retry of it is not dropped as a duplicate.
+static void rx_replay_forget(rx_path_t *rx, const frame_buf_t *buf, uint16_t seq)
+{
+    bool broadcast = is_broadcast(buf->dest_mac);
+    env_lock(rx);
+    peer_t *peer = env_peer(rx, buf->mac);
+    if (peer != NULL) {
+        replay_window_forget(broadcast ? &peer->rx_bcast_window : &peer->rx_window, seq);
+    }
+    env_unlock(rx);
+}
+
+#if CONFIG_FRAME_COMPRESS
+// Undoes tx_slot_compress() in tx_window.c in place, so everything after sees a plain frame.
+// Unicast DATA frames sent in full are kept as references for later deltas.
+static bool rx_expand(rx_path_t *rx, frame_buf_t *buf, frame_header_t *hdr)
+{
+    uint8_t *payload = buf->data + FRAME_HEADER_LEN;
+    bool unicast = !is_broadcast(buf->dest_mac);
+    if (!(hdr->flags & FRAME_FLAG_COMPRESSED)) {
+        if (hdr->type == FRAME_TYPE_DATA && unicast && hdr->payload_len <= CONFIG_FRAME_COMPRESS_DELTA_MAX_LEN) {
+            env_lock(rx);
+            peer_t *peer = env_peer(rx, buf->mac);
+            if (peer != NULL) {
+                compress_history_put(&peer->delta_rx, hdr->seq, payload, hdr->payload_len);
+            }
+            env_unlock(rx);
+        }
+        return true;
+    }
+
+    uint8_t plain[FRAME_MAX_PAYLOAD_LEN];
+    int len = 0;
+    if (hdr->flags & FRAME_FLAG_DELTA) {
+        if (hdr->type != FRAME_TYPE_DATA || !unicast || hdr->payload_len < 1) {
+            return false;
+        }
+        compress_ref_t ref;
+        bool found = false;
+        env_lock(rx);
+        peer_t *peer = env_peer(rx, buf->mac);
+        const compress_ref_t *match = peer != NULL ? compress_history_find(&peer->delta_rx, hdr->seq - payload[0]) : NULL;
+        if (match != NULL) {
+            ref = *match;
+            found = true;
+        }
+        env_unlock(rx);
+        if (found) {
+            len = compress_delta_decode(ref.data, ref.len, payload + 1, hdr->payload_len - 1, plain, sizeof(plain));
+        }
+    } else {
+        len = compress_lz_decode(payload, hdr->payload_len, plain, sizeof(plain));
+    }
+    if (len <= 0) {
+        return false;
+    }
+    memcpy(payload, plain, len);
+    buf->len = frame_write_header(buf->data, hdr->type, hdr->flags & ~FRAME_FLAG_COMPRESSED, hdr->seq, len);
+    memcpy(hdr, buf->data, FRAME_HEADER_LEN);
+    return true;
+}
+#endif
+
+#if CONFIG_LINK_RELIABLE
+// Records that mac is owed an ACK, sent within RELIABLE_ACK_DELAY_US.
+static void rx_ack_owe(rx_path_t *rx, const uint8_t *mac)
+{
+    env_lock(rx);
+    peer_t *peer = env_peer(rx, mac);
+    if (peer != NULL) {
+        peer->rel_ack_owed = true;
+    }
+    env_unlock(rx);
+    rx->env->ack_owed(rx->env->ctx);
+}
+
+// Records a reliable frame for the next ACK to its sender and strips its
+// frame_rel_t in place. Returns false for a copy that was delivered before.
+static bool rx_reliable_accept(rx_path_t *rx, frame_buf_t *buf, frame_header_t *hdr)
+{
+    uint8_t *payload = buf->data + FRAME_HEADER_LEN;
+    frame_rel_t rel;
+    if (hdr->payload_len < sizeof(rel)) {
+        return false;
+    }
+    memcpy(&rel, payload, sizeof(rel));
+    reliable_result_t result = RELIABLE_DUPLICATE;
+    env_lock(rx);
+    peer_t *peer = env_peer(rx, buf->mac);
+    if (peer != NULL) {
+        result = reliable_rx_check(&peer->rel_rx, rel.rseq);
+        peer->rel_ack_owed = true;
+        if (result == RELIABLE_DUPLICATE) {
+            LINK_STATS_INC(&peer->counters, rx_duplicates);
+        }
+    }
+    env_unlock(rx);
+    rx->env->ack_owed(rx->env->ctx);
+    if (result != RELIABLE_NEW) {
+        LINK_STATS_INC(rx->env->counters, rx_duplicates);
+        return false;
+    }
+
+    int len = hdr->payload_len - sizeof(rel);
+    memmove(payload, payload + sizeof(rel), len);
+    buf->len = frame_write_header(buf->data, hdr->type, hdr->flags & ~FRAME_FLAG_RELIABLE, hdr->seq, len);
+    memcpy(hdr, buf->data, FRAME_HEADER_LEN);
+    return true;
+}
+#endif
+
+#if CONFIG_RX_REORDER
+// Delivers held frames from mac for as long as they continue its sequence.
+static void rx_reorder_release(rx_path_t *rx, const uint8_t *mac)
+{
+    uint16_t seq;
+    while (rx_order_next(rx, mac, &seq)) {
+        int index = rx_reorder_take(&rx->reorder, mac, seq);
+        if (index < 0) {
+            break;
+        }
+        rx_order_advance(rx, mac, seq);
+        if (!rx->env->deliver(rx->env->ctx, frame_pool_at(index))) {
+            frame_pool_free(frame_pool_at(index));
+        }
+    }
+}
+#endif
+
+bool rx_path_receive(rx_path_t *rx, frame_buf_t *buf, int64_t now_us)
+{
+    frame_header_t hdr;
+    const uint8_t *payload;
+    if (!frame_decode(buf->data, buf->len, &hdr, &payload)) {
+        ESP_LOGW(TAG, "Dropping malformed frame from " MACSTR " (len: %d)", MAC2STR(buf->mac), buf->len);
+        return false;
+    }
+
+    int32_t counter_hi = -1;
+#if CONFIG_LINK_ENCRYPT
+    if (!rx_unseal(rx, buf, &hdr, &counter_hi)) {
+        ESP_LOGD(TAG, "Rejected frame from " MACSTR " (type %u, flags 0x%02X)", MAC2STR(buf->mac), hdr.type, hdr.flags);
+        LINK_STATS_INC(rx->env->counters, rx_rejected);
+        return false;
+    }
+#endif
+
+    rx_verdict_t verdict = RX_DELIVER;
+    if (!is_broadcast(buf->mac)) {
+        if (rx->env->peer_heard != NULL) {
+            rx->env->peer_heard(rx->env->ctx, buf);
+        }
+        verdict = rx_peer_check(rx, buf, &hdr, payload, counter_hi);
+    }
+    if (verdict == RX_DROP) {
+#if CONFIG_LINK_RELIABLE
+        if (hdr.flags & FRAME_FLAG_RELIABLE) {
+            rx_ack_owe(rx, buf->mac);  // A retry: our ACK was probably lost
+        }
+#endif
+        return false;
+    }
+#if CONFIG_FRAME_COMPRESS
+    bool expanded = rx_expand(rx, buf, &hdr);
+#else
+    bool expanded = !(hdr.flags & FRAME_FLAG_COMPRESSED);
+#endif
+    if (!expanded) {
+        ESP_LOGD(TAG, "Undecodable frame from " MACSTR " (type %u, flags 0x%02X)", MAC2STR(buf->mac), hdr.type, hdr.flags);
+        LINK_STATS_INC(rx->env->counters, rx_decode_failed);
+        rx_replay_forget(rx, buf, hdr.seq);
+        return false;
+    }
+#if CONFIG_LINK_RELIABLE
+    if ((hdr.flags & FRAME_FLAG_RELIABLE) && !rx_reliable_accept(rx, buf, &hdr)) {
+        return false;
+    }
+#endif
+
+#if CONFIG_RX_REORDER
+    if (verdict == RX_HOLD) {
+        int64_t deadline_us = now_us + CONFIG_RX_REORDER_TIMEOUT_MS * 1000LL;
+        if (rx_reorder_hold(&rx->reorder, buf->mac, hdr.seq, frame_pool_index(buf), deadline_us)) {
+            return true;
+        }
+        rx_order_advance(rx, buf->mac, hdr.seq); // Buffer full: skip the gap
+    }
+    // buf may belong to someone else once delivered.
+    uint8_t src_mac[PEER_MAC_LEN];
+    memcpy(src_mac, buf->mac, PEER_MAC_LEN);
+    bool unicast = !is_broadcast(buf->dest_mac);
+    bool kept = rx->env->deliver(rx->env->ctx, buf);
+    if (unicast) {
+        rx_reorder_release(rx, src_mac);
+    }
+    return kept;
+#else
+    return rx->env->deliver(rx->env->ctx, buf);
+#endif
+}
+
+void rx_path_expire(rx_path_t *rx, int64_t now_us)
+{
+#if CONFIG_RX_REORDER
+    uint8_t mac[PEER_MAC_LEN];
+    uint16_t seq;
+    int index;
+    while ((index = rx_reorder_take_expired(&rx->reorder, now_us, mac, &seq)) >= 0) {
+        rx_order_advance(rx, mac, seq);
+        if (!rx->env->deliver(rx->env->ctx, frame_pool_at(index))) {
+            frame_pool_free(frame_pool_at(index));
+        }
+        rx_reorder_release(rx, mac);
+    }
+#endif
+}
+
+int64_t rx_path_next_us(const rx_path_t *rx)
+{
+#if CONFIG_RX_REORDER
+    return rx_reorder_next_deadline(&rx->reorder);
+#else
+    return -1;
+#endif
+}
+
+static void rx_dispatch_message(uint8_t type, const uint8_t *payload, int len, void *arg)
+{
+    const rx_msg_ctx_t *ctx = arg;
+    const rx_path_env_t *env = ctx->rx->env;
+
+    switch (type) {
+    case FRAME_TYPE_ACK:
+#if CONFIG_LINK_RELIABLE
+        if (len >= (int)sizeof(frame_ack_t)) {
+            frame_ack_t ack;
+            memcpy(&ack, payload, sizeof(ack));
+            env->ack_received(env->ctx, ctx->buf->mac, &ack);
+        }
+#endif
+        break;
+    case FRAME_TYPE_KEEPALIVE:
+        if (len >= (int)sizeof(frame_credit_t)) {
+            env->credit_received(env->ctx, ctx->buf->mac, payload[0]);
+        }
+        break;
+    default:
+        env->message(env->ctx, ctx->buf, type, payload, len);
+        break;
+    }
+}
+
+bool rx_path_dispatch(rx_path_t *rx, const frame_buf_t *buf)
+{
+    frame_header_t hdr;
+    const uint8_t *payload;
+    if (!frame_decode(buf->data, buf->len, &hdr, &payload)) {
+        return false;
+    }
+    rx_msg_ctx_t ctx = { .rx = rx, .buf = buf };
+    if (hdr.type == FRAME_TYPE_BATCH) {
+        return batch_split(payload, hdr.payload_len, rx_dispatch_message, &ctx);
+    }
+    rx_dispatch_message(hdr.type, payload, hdr.payload_len, &ctx);
+    return true;
+}
+
+bool rx_path_credit_check(rx_path_t *rx, const uint8_t *mac, int free_slots)
+{
+    if (free_slots > RX_CREDIT_LOW_WATER) {
+        return false;
+    }
+    bool due = false;
+    env_lock(rx);
+    peer_t *peer = env_peer(rx, mac);
+    if (peer != NULL && !peer->rx_credit_due) {
+        peer->rx_credit_due = true;
+        due = true;
+    }
+    env_unlock(rx);
+    return due;
+}
+
+bool rx_path_credit_recovered(rx_path_t *rx, int free_slots)
+{
+    if (!atomic_load_explicit(&rx->credit_owed_any, memory_order_relaxed) || free_slots <= RX_CREDIT_LOW_WATER) {
+        return false;
+    }
+    atomic_store_explicit(&rx->credit_owed_any, false, memory_order_relaxed);
+    env_lock(rx);
+    for (int i = 0; i < PEER_TABLE_SIZE; i++) {
+        peer_t *peer = peer_table_at(rx->env->peers, i);
+        if (peer != NULL && peer->rx_credit_owed) {
+            peer->rx_credit_due = true;
+        }
+    }
+    env_unlock(rx);
+    return true;
+}
+
+uint8_t rx_path_credit_value(int free_slots, int count)
+{
+    if (free_slots > RX_CREDIT_LOW_WATER) {
+        return FRAME_CREDIT_UNLIMITED;
+    }
+    return (uint8_t)(count > 1 ? free_slots / count : free_slots);
+}
+
+int rx_path_credit_updates(rx_path_t *rx, int free_slots, uint8_t macs[][PEER_MAC_LEN], frame_credit_t *credit)
+{
+    int count = 0;
+    env_lock(rx);
+    for (int i = 0; i < PEER_TABLE_SIZE; i++) {
+        peer_t *peer = peer_table_at(rx->env->peers, i);
+        if (peer != NULL && peer->rx_credit_due) {
+            peer->rx_credit_due = false;
+            memcpy(macs[count++], peer->mac, PEER_MAC_LEN);
+        }
+    }
+    credit->credits = rx_path_credit_value(free_slots, count);
+    bool limited = credit->credits != FRAME_CREDIT_UNLIMITED;
+    for (int i = 0; i < count; i++) {
+        peer_t *peer = env_peer(rx, macs[i]);
+        peer->rx_credit_owed = limited;
+        if (limited) {
+            LINK_STATS_INC(&peer->counters, rx_throttled);
+        }
+    }
+    env_unlock(rx);
+    if (limited) {
+        LINK_STATS_ADD(rx->env->counters, rx_throttled, count);
+        atomic_store_explicit(&rx->credit_owed_any, true, memory_order_relaxed);
+    }
+    return count;
+}
+
+void rx_path_credit_retry(rx_path_t *rx, const uint8_t *mac)
+{
+    env_lock(rx);
+    peer_t *peer = env_peer(rx, mac);
+    if (peer != NULL) {
+        peer->rx_credit_due = true;
+    }
+    env_unlock(rx);
+}
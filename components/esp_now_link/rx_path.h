@@ -0,0 +1,144 @@
+/**
+ * rx_path.h
+ *
+ * The receive path of the link, from a frame the transport handed over to the
+ * messages in it: authentication and the session handshake
+ * (CONFIG_LINK_ENCRYPT), the peer's replay windows, expansion
+ * (CONFIG_FRAME_COMPRESS), end-to-end acknowledgement (CONFIG_LINK_RELIABLE),
+ * in-order delivery (CONFIG_RX_REORDER), the receiver side of flow control
+ * and the split of batches into messages. Like tx_window.h, nothing here
+ * depends on FreeRTOS or ESP-IDF: the caller passes the time into every call
+ * and provides the peer table and the rest through rx_path_env_t. On the
+ * device esp_now_link.c runs one RX path on its RX task; the host harness in
+ * host/ runs one per simulated node.
+ *
+ * An RX path is owned by one task. The rx_path_credit_*() calls and
+ * rx_path_hello() may be made from others.
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "frame.h"
+#include "frame_pool.h"
+#include "link_stats.h"
+#include "peer_table.h"
+#include "rx_reorder.h"
+#if CONFIG_LINK_ENCRYPT
+#include "link_crypto.h"
+#endif
+
+#define RX_CREDIT_LOW_WATER 4       // Free RX slots at which senders are asked to slow down
+
+/**
+ * What the RX path needs from its surroundings. Optional operations may be
+ * NULL. The peer table is shared with the send window: every access holds lock.
+ */
+typedef struct {
+    peer_table_t *peers;
+    link_counters_t *counters;      // Totals over all peers and the broadcast address
+    const uint8_t *own_mac;         // Bound into session keys
+
+    void (*lock)(void *ctx);
+    void (*unlock)(void *ctx);
+    uint32_t (*random)(void *ctx);  // For session nonces
+
+    /**
+     * Optional: a frame from the unicast source mac passed authentication.
+     * Adds the sender to the peer table if it is new, see rx_path_peer_added().
+     * Frames from a MAC that is not in the table afterwards are dropped.
+     */
+    void (*peer_heard)(void *ctx, const frame_buf_t *buf);
+
+    /** Optional: mac needs a HELLO-ACK to finish its session handshake, see link_crypto.h. */
+    void (*hello_owed)(void *ctx, const uint8_t *mac);
+
+    /** A peer is owed an end-to-end ACK, due within RELIABLE_ACK_DELAY_US (CONFIG_LINK_RELIABLE). */
+    void (*ack_owed)(void *ctx);
+
+    /** An ACK record from mac, for the send window (CONFIG_LINK_RELIABLE). */
+    void (*ack_received)(void *ctx, const uint8_t *mac, const frame_ack_t *ack);
+
+    /** A credit update from mac, carried by its keepalive, for the send window. */
+    void (*credit_received)(void *ctx, const uint8_t *mac, uint8_t credits);
+
+    /**
+     * A frame ready for delivery, in order and with its seal, compression and
+     * reliable header removed. Returns true if it took buf over, which the RX
+     * path then leaves alone; most frames just go to rx_path_dispatch().
+     */
+    bool (*deliver)(void *ctx, frame_buf_t *buf);
+
+    /** A message of buf that the link does not handle itself: anything but ACK and KEEPALIVE. */
+    void (*message)(void *ctx, const frame_buf_t *buf, uint8_t type, const uint8_t *payload, int len);
+
+    void *ctx;                      // Passed to every operation
+} rx_path_env_t;
+
+typedef struct {
+    const rx_path_env_t *env;
+    atomic_bool credit_owed_any;    // Some peer has rx_credit_owed set
+#if CONFIG_RX_REORDER
+    rx_reorder_t reorder;           // Frames held until the gap before them closes
+#endif
+#if CONFIG_LINK_ENCRYPT
+    link_crypto_ctx_t crypto;
+#endif
+} rx_path_t;
+
+void rx_path_init(rx_path_t *rx, const rx_path_env_t *env);
+
+/** Sets up the receive side of a peer entry that was just created. Call with the env lock held. */
+void rx_path_peer_added(rx_path_t *rx, peer_t *peer);
+
+/**
+ * Runs a received frame through the checks and delivers it, or holds it for
+ * the gap before it. Returns true if buf was held or taken over by deliver,
+ * and must not be freed by the caller. Held frames come from frame_pool.
+ */
+bool rx_path_receive(rx_path_t *rx, frame_buf_t *buf, int64_t now_us);
+
+/** Delivers held frames whose gap stayed open past its deadline. */
+void rx_path_expire(rx_path_t *rx, int64_t now_us);
+
+/** Deadline of the oldest held frame, or -1 if none. */
+int64_t rx_path_next_us(const rx_path_t *rx);
+
+/**
+ * Hands the messages of a delivered frame to the window's or the env's
+ * handlers, splitting batches. Returns false for a malformed frame.
+ */
+bool rx_path_dispatch(rx_path_t *rx, const frame_buf_t *buf);
+
+/**
+ * Fills in the session nonces of a HELLO or HELLO-ACK to mac. Both stay 0
+ * without CONFIG_LINK_ENCRYPT or for a MAC that is not a peer.
+ */
+void rx_path_hello(rx_path_t *rx, const uint8_t *mac, frame_hello_t *hello);
+
+/**
+ * Called for every frame from mac with the RX slots still free. Returns true
+ * once they ran low and the peer became due a credit update.
+ */
+bool rx_path_credit_check(rx_path_t *rx, const uint8_t *mac, int free_slots);
+
+/**
+ * Called once the RX queue is drained. Returns true if peers we limited became
+ * due an unlimited grant again.
+ */
+bool rx_path_credit_recovered(rx_path_t *rx, int free_slots);
+
+/** The credit we advertise to each of count senders while free_slots RX slots are free. */
+uint8_t rx_path_credit_value(int free_slots, int count);
+
+/**
+ * Collects the peers due a credit update into macs, at most PEER_TABLE_SIZE,
+ * and the credit to send them. Returns how many there are.
+ */
+int rx_path_credit_updates(rx_path_t *rx, int free_slots, uint8_t macs[][PEER_MAC_LEN], frame_credit_t *credit);
+
+/** A credit update to mac could not be queued: it stays due. */
+void rx_path_credit_retry(rx_path_t *rx, const uint8_t *mac);
@@ -0,0 +1,83 @@
+/**
+ * rx_reorder.c
+ *
+ * Reorder buffer for received frames (see rx_reorder.h).
+ */
+
+#include <string.h>
+#include "rx_reorder.h"
+
+void rx_reorder_init(rx_reorder_t *reorder, int depth)
+{
+    memset(reorder, 0, sizeof(*reorder));
+    reorder->depth = depth < RX_REORDER_MAX_DEPTH ? depth : RX_REORDER_MAX_DEPTH;
+}
+
+bool rx_reorder_hold(rx_reorder_t *reorder, const uint8_t *mac, uint16_t seq, uint8_t handle, int64_t deadline_us)
+{
+    for (int i = 0; i < reorder->depth; i++) {
+        rx_reorder_entry_t *entry = &reorder->entries[i];
+        if (!entry->used) {
+            entry->used = true;
+            memcpy(entry->mac, mac, sizeof(entry->mac));
+            entry->seq = seq;
+            entry->handle = handle;
+            entry->deadline_us = deadline_us;
+            return true;
+        }
+    }
+    return false;
+}
+
+int rx_reorder_take(rx_reorder_t *reorder, const uint8_t *mac, uint16_t seq)
+{
+    for (int i = 0; i < reorder->depth; i++) {
+        rx_reorder_entry_t *entry = &reorder->entries[i];
+        if (entry->used && entry->seq == seq && memcmp(entry->mac, mac, sizeof(entry->mac)) == 0) {
+            entry->used = false;
+            return entry->handle;
+        }
+    }
+    return -1;
+}
+
+int rx_reorder_take_expired(rx_reorder_t *reorder, int64_t now_us, uint8_t *mac, uint16_t *seq)
+{
+    rx_reorder_entry_t *expired = NULL;
+    for (int i = 0; i < reorder->depth; i++) {
+        rx_reorder_entry_t *entry = &reorder->entries[i];
+        if (entry->used && entry->deadline_us <= now_us &&
+            (expired == NULL || entry->deadline_us < expired->deadline_us)) {
+            expired = entry;
+        }
+    }
+    if (expired == NULL) {
+        return -1;
+    }
+
+    // Release the peer's frames in sequence order, even if a later one was held first.
+    rx_reorder_entry_t *lowest = expired;
+    for (int i = 0; i < reorder->depth; i++) {
+        rx_reorder_entry_t *entry = &reorder->entries[i];
+        if (entry->used && (int16_t)(entry->seq - lowest->seq) < 0 &&
+            memcmp(entry->mac, expired->mac, sizeof(entry->mac)) == 0) {
+            lowest = entry;
+        }
+    }
+    lowest->used = false;
+    memcpy(mac, lowest->mac, sizeof(lowest->mac));
+    *seq = lowest->seq;
+    return lowest->handle;
+}
+
+int64_t rx_reorder_next_deadline(const rx_reorder_t *reorder)
+{
+    int64_t next = -1;
+    for (int i = 0; i < reorder->depth; i++) {
+        const rx_reorder_entry_t *entry = &reorder->entries[i];
+        if (entry->used && (next < 0 || entry->deadline_us < next)) {
+            next = entry->deadline_us;
+        }
+    }
+    return next;
+}
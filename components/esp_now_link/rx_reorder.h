@@ -0,0 +1,45 @@
+/**
+ * rx_reorder.h
+ *
+ * Small shared buffer of received frames that arrived ahead of a gap in their
+ * peer's sequence. Entries only refer to frames by an opaque handle (the frame_pool
+ * index), so holding a frame does not copy it.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define RX_REORDER_MAX_DEPTH 8
+
+typedef struct {
+    bool used;
+    uint8_t mac[6];
+    uint16_t seq;
+    uint8_t handle;
+    int64_t deadline_us;            // Deliver anyway once the gap has been open this long
+} rx_reorder_entry_t;
+
+typedef struct {
+    rx_reorder_entry_t entries[RX_REORDER_MAX_DEPTH];
+    int depth;                      // Entries in use at most, <= RX_REORDER_MAX_DEPTH
+} rx_reorder_t;
+
+void rx_reorder_init(rx_reorder_t *reorder, int depth);
+
+/** Holds handle for (mac, seq). Returns false if the buffer is full. */
+bool rx_reorder_hold(rx_reorder_t *reorder, const uint8_t *mac, uint16_t seq, uint8_t handle, int64_t deadline_us);
+
+/** Removes and returns the handle held for (mac, seq), or -1. */
+int rx_reorder_take(rx_reorder_t *reorder, const uint8_t *mac, uint16_t seq);
+
+/**
+ * If any entry has expired, removes the lowest-sequence entry held for the same
+ * peer as the earliest expired one and returns its handle; otherwise -1. mac and
+ * seq receive the removed entry's key.
+ */
+int rx_reorder_take_expired(rx_reorder_t *reorder, int64_t now_us, uint8_t *mac, uint16_t *seq);
+
+/** Earliest deadline of any held entry, or -1 if the buffer is empty. */
+int64_t rx_reorder_next_deadline(const rx_reorder_t *reorder);
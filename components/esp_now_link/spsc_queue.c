@@ -0,0 +1,45 @@
+/**
+ * spsc_queue.c
+ *
+ * Single-producer single-consumer handle queue (see spsc_queue.h).
+ */
+
+#include "spsc_queue.h"
+
+void spsc_queue_init(spsc_queue_t *queue, unsigned size)
+{
+    queue->size = size <= SPSC_QUEUE_MAX_SIZE ? size : SPSC_QUEUE_MAX_SIZE;
+    atomic_store(&queue->head, 0);
+    atomic_store(&queue->tail, 0);
+}
+
+bool spsc_queue_push(spsc_queue_t *queue, uint8_t item)
+{
+    unsigned head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head - tail >= queue->size) {
+        return false;
+    }
+    queue->items[head & (queue->size - 1)] = item;
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+    return true;
+}
+
+bool spsc_queue_pop(spsc_queue_t *queue, uint8_t *item)
+{
+    unsigned tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail == head) {
+        return false;
+    }
+    *item = queue->items[tail & (queue->size - 1)];
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+unsigned spsc_queue_count(spsc_queue_t *queue)
+{
+    unsigned tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    unsigned head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    return head - tail;
+}
@@ -0,0 +1,34 @@
+/**
+ * spsc_queue.h
+ *
+ * Lock-free single-producer single-consumer queue of one-byte handles (frame_pool
+ * indices), for handing frames from a task on one core to a task on the other
+ * without the critical sections of a FreeRTOS queue. The queue does not block:
+ * the producer wakes the consumer with a task notification after a push.
+ */
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SPSC_QUEUE_MAX_SIZE 32
+
+typedef struct {
+    uint8_t items[SPSC_QUEUE_MAX_SIZE];
+    unsigned size;                  // Power of two, <= SPSC_QUEUE_MAX_SIZE
+    atomic_uint head;               // Only advanced by the producer
+    atomic_uint tail;               // Only advanced by the consumer
+} spsc_queue_t;
+
+void spsc_queue_init(spsc_queue_t *queue, unsigned size);
+
+/** Producer side. Returns false if the queue is full. */
+bool spsc_queue_push(spsc_queue_t *queue, uint8_t item);
+
+/** Consumer side. Returns false if the queue is empty. */
+bool spsc_queue_pop(spsc_queue_t *queue, uint8_t *item);
+
+/** Handles waiting in the queue. Exact on either side, a snapshot anywhere else. */
+unsigned spsc_queue_count(spsc_queue_t *queue);
@@ -0,0 +1,1023 @@
+/**
+ * tx_window.c
+ *
+ * Send window of the link (see tx_window.h).
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "tx_window.h"
+#include "hot_log.h"
+#include "link_trace.h"
+#include "compress.h"
+#include "reliable.h"
+
+static const char *TAG = "ESP-NOW TX";
+
+static const uint8_t broadcast_mac[LINK_TRANSPORT_MAC_LEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+typedef struct {
+    int max_attempts;
+    uint32_t retry_base_us;
+    bool evict_on_failure;          // Losing a frame of this lane means the peer is gone
+    bool supersede;                 // A retrying frame may be dropped to make room for a new one
+} tx_lane_policy_t;
+
+static const tx_lane_policy_t tx_lane_policies[TX_LANE_COUNT] = {
+    [TX_LANE_CONTROL] = { CONTROL_MAX_ATTEMPTS, CONTROL_RETRY_DELAY_US, true, false },
+    [TX_LANE_BULK] = { BULK_MAX_ATTEMPTS, BULK_RETRY_DELAY_US, false, true },
+};
+
+static void env_lock(const tx_window_t *window)
+{
+    window->env->lock(window->env->ctx);
+}
+
+static void env_unlock(const tx_window_t *window)
+{
+    window->env->unlock(window->env->ctx);
+}
+
+static peer_t *env_peer(const tx_window_t *window, const uint8_t *mac_addr)
+{
+    return peer_table_find(window->env->peers, mac_addr);
+}
+
+// Bumps `field` in the global counters and in mac_addr's peer entry, if any.
+#define COUNT_LINK_EVENT(window, mac_addr, field) do {              \
+        LINK_STATS_INC((window)->env->counters, field);             \
+        env_lock(window);                                           \
+        peer_t *peer_ = env_peer((window), (mac_addr));             \
+        if (peer_ != NULL) {                                        \
+            LINK_STATS_INC(&peer_->counters, field);                \
+        }                                                           \
+        env_unlock(window);                                         \
+    } while (0)
+
+void tx_window_init(tx_window_t *window, const tx_window_env_t *env)
+{
+    memset(window, 0, sizeof(*window));
+    window->env = env;
+    link_timing_init(&window->broadcast_timing);
+#if CONFIG_LINK_ENCRYPT
+    link_crypto_ctx_init(&window->crypto);
+#endif
+}
+
+// Periodic data, bulk fragments and the benchmark flood ride the bulk lane;
+// everything else is control traffic.
+tx_lane_t tx_lane_for(uint8_t type)
+{
+    switch (type) {
+    case FRAME_TYPE_DATA:
+    case FRAME_TYPE_FRAG:
+    case FRAME_TYPE_BENCH_FLOOD:
+    case FRAME_TYPE_MESH:
+        return TX_LANE_BULK;
+    default:
+        return TX_LANE_CONTROL;
+    }
+}
+
+bool tx_sent_in_clear(uint8_t type)
+{
+    return type == FRAME_TYPE_DISCOVERY || type == FRAME_TYPE_DISCOVERY_ACK || type == FRAME_TYPE_WAKE_SCHEDULE;
+}
+
+static void tx_slot_release(tx_slot_t *slot)
+{
+    frame_pool_free(slot->frame);
+    slot->frame = NULL;
+    slot->state = TX_SLOT_FREE;
+}
+
+// Releases a slot whose frame is done with and reports its DATA messages.
+static void tx_slot_finish(tx_window_t *window, tx_slot_t *slot, bool delivered)
+{
+    const tx_window_env_t *env = window->env;
+    if (slot->msg_count > 0 && env->finished != NULL) {
+        env->finished(env->ctx, slot->mac, slot->msg_first, slot->msg_last, delivered);
+    }
+    tx_slot_release(slot);
+}
+
+void tx_window_drop(tx_window_t *window, const uint8_t *mac_addr)
+{
+    for (int i = 0; i < TX_WINDOW_SIZE; i++) {
+        tx_slot_t *slot = &window->slots[i];
+        if (slot->state != TX_SLOT_FREE && memcmp(slot->mac, mac_addr, LINK_TRANSPORT_MAC_LEN) == 0) {
+            tx_slot_finish(window, slot, false);
+        }
+    }
+}
+
+// Returns the 32-bit frame counter; its low half goes into the header as seq.
+static uint32_t next_tx_seq(tx_window_t *window, const uint8_t *mac_addr)
+{
+    env_lock(window);
+    peer_t *peer = env_peer(window, mac_addr);
+    uint32_t seq = (peer != NULL) ? peer->tx_seq++ : window->broadcast_seq++;
+    env_unlock(window);
+    return seq;
+}
+
+uint32_t tx_window_next_msg_id(tx_window_t *window, const uint8_t *mac_addr)
+{
+    env_lock(window);
+    peer_t *peer = env_peer(window, mac_addr);
+    uint32_t id = (peer != NULL) ? ++peer->tx_msg_id : ++window->broadcast_msg_id;
+    env_unlock(window);
+    return id;
+}
+
+// Counts a finished frame: acked after `attempts` tries, or given up on.
+static void count_tx_result(tx_window_t *window, const uint8_t *mac_addr, bool delivered, int attempts)
+{
+    if (delivered) {
+        link_stats_acked(window->env->counters, attempts);
+    } else {
+        LINK_STATS_INC(window->env->counters, tx_failed);
+    }
+
+    env_lock(window);
+    peer_t *peer = env_peer(window, mac_addr);
+    if (peer != NULL) {
+        if (delivered) {
+            link_stats_acked(&peer->counters, attempts);
+        } else {
+            LINK_STATS_INC(&peer->counters, tx_failed);
+        }
+    }
+    env_unlock(window);
+}
+
+// The broadcast address has no peer entry; its timing lives in the window.
+static link_timing_t *link_timing_for(tx_window_t *window, const uint8_t *mac_addr)
+{
+    if (memcmp(mac_addr, broadcast_mac, LINK_TRANSPORT_MAC_LEN) == 0) {
+        return &window->broadcast_timing;
+    }
+    peer_t *peer = env_peer(window, mac_addr);
+    return peer != NULL ? &peer->timing : NULL;
+}
+
+// Feeds the outcome of one transmission attempt into the link's RTT estimate
+// and the peer's rate adaptation.
+static void record_tx_attempt(tx_window_t *window, const uint8_t *mac_addr, bool success, int64_t rtt_us,
+                              int64_t now_us)
+{
+    env_lock(window);
+    link_timing_t *timing = link_timing_for(window, mac_addr);
+    if (timing != NULL) {
+        if (success) {
+            link_timing_sample(timing, (int32_t)rtt_us);
+        } else {
+            link_timing_failed(timing);
+        }
+    }
+    peer_t *peer = env_peer(window, mac_addr);
+    if (peer != NULL && success) {
+        peer->last_seen_ms = now_us / 1000; // The MAC-layer ACK proves the peer is there
+    }
+    env_unlock(window);
+
+    if (peer != NULL && window->env->attempt_done != NULL) {
+        window->env->attempt_done(window->env->ctx, mac_addr, success);
+    }
+}
+
+static uint32_t tx_timeout_us(tx_window_t *window, const uint8_t *mac_addr)
+{
+    env_lock(window);
+    link_timing_t *timing = link_timing_for(window, mac_addr);
+    uint32_t timeout_us = timing != NULL ? link_timing_timeout_us(timing) : LINK_RTO_INITIAL_US;
+    env_unlock(window);
+    return timeout_us;
+}
+
+static uint32_t tx_backoff_us(tx_window_t *window, const uint8_t *mac_addr, tx_lane_t lane)
+{
+    uint32_t base_us = tx_lane_policies[lane].retry_base_us;
+    uint32_t rnd = window->env->random(window->env->ctx);
+    env_lock(window);
+    link_timing_t *timing = link_timing_for(window, mac_addr);
+    uint32_t backoff_us = timing != NULL ? link_timing_backoff_us(timing, base_us, rnd) : base_us;
+    env_unlock(window);
+    return backoff_us;
+}
+
+static void on_delivery_failed(tx_window_t *window, const tx_slot_t *slot)
+{
+    count_tx_result(window, slot->mac, false, slot->attempts);
+    if (slot->relayed_rx_us != 0) {
+        LINK_STATS_INC(window->env->counters, fwd_dropped);
+    }
+    if (memcmp(slot->mac, broadcast_mac, LINK_TRANSPORT_MAC_LEN) == 0) {
+        ESP_LOGE(TAG, "Failed to broadcast discovery message after %d attempts.", slot->attempts);
+    } else if (!tx_lane_policies[slot->lane].evict_on_failure) {
+        HOT_LOGW(HOT_LOG_TX_FAILED, TAG, "Dropped bulk frame to " MACSTR " after %d attempts", MAC2STR(slot->mac), slot->attempts);
+    } else if (window->env->peer_failed(window->env->ctx, slot->mac)) {
+        ESP_LOGE(TAG, "Failed to send message to " MACSTR " after %d attempts. Removing peer.", MAC2STR(slot->mac), slot->attempts);
+        tx_window_drop(window, slot->mac);
+    }
+}
+
+// Gives up on a frame. The failure is accounted while the slot is still live;
+// evicting the peer may already have released it along with its other frames.
+static void tx_slot_give_up(tx_window_t *window, tx_slot_t *slot)
+{
+    on_delivery_failed(window, slot);
+    if (slot->state != TX_SLOT_FREE) {
+        tx_slot_finish(window, slot, false);
+    }
+}
+
+// Ends a frame that tx_window_ack() settled while a copy of it was in flight.
+static void tx_slot_settled(tx_window_t *window, tx_slot_t *slot)
+{
+    if (slot->e2e_acked) {
+        tx_slot_finish(window, slot, true);
+    } else {
+        tx_slot_give_up(window, slot);
+    }
+}
+
+// A transmission attempt failed. A reliable frame that used up the lane's
+// attempts starts over with a new set, up to RELIABLE_MAX_TRIES times, like
+// one whose ACK did not come (tx_slot_unacked()).
+static void tx_slot_failed(tx_window_t *window, tx_slot_t *slot, int64_t now_us)
+{
+    record_tx_attempt(window, slot->mac, false, 0, now_us);
+    if (slot->e2e_settled) {
+        tx_slot_settled(window, slot);  // This copy no longer matters
+        return;
+    }
+    if (slot->attempts >= tx_lane_policies[slot->lane].max_attempts) {
+        if (slot->reliable && slot->tries < RELIABLE_MAX_TRIES) {
+            slot->tries++;
+            slot->attempts = 0;
+        } else {
+            if (slot->reliable) {
+                COUNT_LINK_EVENT(window, slot->mac, tx_e2e_failed);
+            }
+            tx_slot_give_up(window, slot);
+            return;
+        }
+    }
+    slot->state = TX_SLOT_PENDING;
+    slot->retry_at_us = now_us + tx_backoff_us(window, slot->mac, slot->lane);
+}
+
+// Transports report send results in the order frames were queued, so a report
+// belongs to the oldest in-flight frame for that MAC, i.e. the lowest tag.
+static tx_slot_t *tx_window_match(tx_window_t *window, const uint8_t *mac_addr)
+{
+    tx_slot_t *oldest = NULL;
+    for (int i = 0; i < TX_WINDOW_SIZE; i++) {
+        tx_slot_t *slot = &window->slots[i];
+        if (slot->state != TX_SLOT_IN_FLIGHT || memcmp(slot->mac, mac_addr, LINK_TRANSPORT_MAC_LEN) != 0) {
+            continue;
+        }
+        if (oldest == NULL || (int16_t)(slot->tag - oldest->tag) < 0) {
+            oldest = slot;
+        }
+    }
+    return oldest;
+}
+
+#if CONFIG_LINK_ENCRYPT
+// Seals a frame right before its first transmission; retransmissions resend the
+// same ciphertext. Broadcasts and discovery frames, which carry the session
+// nonces the key is derived from, go out in clear. Returns false while the peer
+// has no session key: a unicast frame is never sent in clear instead.
+static bool tx_slot_seal(tx_window_t *window, tx_slot_t *slot)
+{
+    if (!slot->unsealed) {
+        return true;
+    }
+    uint8_t key[LINK_CRYPTO_KEY_LEN];
+    bool keyed = false;
+    env_lock(window);
+    const peer_t *peer = env_peer(window, slot->mac);
+    if (peer != NULL && peer->key_valid) {
+        memcpy(key, peer->session_key, sizeof(key));
+        keyed = true;
+    }
+    env_unlock(window);
+    if (!keyed) {
+        return false;
+    }
+    int len = link_crypto_seal(&window->crypto, key, window->env->own_mac, slot->frame->data, slot->len,
+                               slot->counter_hi);
+    if (len <= 0) {
+        return false;
+    }
+    slot->len = len;
+    slot->unsealed = false;
+    return true;
+}
+
+// Holds a frame until the peer's session key is ready, which the handshake
+// normally gets done within a round trip. The frame is given up on, without
+// blaming the peer, once TX_KEY_WAIT_US has passed.
+static void tx_slot_key_wait(tx_window_t *window, tx_slot_t *slot, int64_t now_us)
+{
+    if (slot->key_wait_until_us < 0) {
+        slot->key_wait_until_us = now_us + TX_KEY_WAIT_US;
+    } else if (now_us >= slot->key_wait_until_us) {
+        HOT_LOGW(HOT_LOG_TX_FAILED, TAG, "No session key for " MACSTR ", dropping frame", MAC2STR(slot->mac));
+        count_tx_result(window, slot->mac, false, slot->attempts);
+        tx_slot_finish(window, slot, false);
+        return;
+    }
+    slot->retry_at_us = now_us + tx_lane_policies[slot->lane].retry_base_us;
+}
+#endif
+
+static void tx_window_transmit(tx_window_t *window, tx_slot_t *slot, int64_t now_us)
+{
+    const link_transport_t *transport = window->env->transport;
+#if CONFIG_LINK_ENCRYPT
+    if (!tx_slot_seal(window, slot)) {
+        tx_slot_key_wait(window, slot, now_us);
+        return;
+    }
+#endif
+    slot->attempts++;
+    slot->tag = window->next_tag++;
+    LINK_TRACE(LINK_TRACE_TX_SEND, link_trace_seq(slot->frame->data, slot->len));
+    esp_err_t result = transport->send(transport->ctx, slot->mac, slot->frame->data, slot->len);
+    if (result == ESP_ERR_NOT_FOUND) {
+        tx_slot_finish(window, slot, false);  // Peer was removed while the frame was queued
+        return;
+    }
+    if (result != ESP_OK) {
+        HOT_LOGW(HOT_LOG_TX_QUEUE_ERROR, TAG, "Failed to queue message (Attempt %d): %s", slot->attempts, esp_err_to_name(result));
+        tx_slot_failed(window, slot, now_us);
+        return;
+    }
+    slot->state = TX_SLOT_IN_FLIGHT;
+    slot->sent_at_us = now_us;
+    slot->timeout_at_us = now_us + tx_timeout_us(window, slot->mac);
+    link_counters_t *counters = window->env->counters;
+    if (atomic_load_explicit(&counters->first_tx_us, memory_order_relaxed) == 0) {
+        atomic_store_explicit(&counters->first_tx_us, (unsigned)now_us, memory_order_relaxed);
+    }
+}
+
+#if CONFIG_FRAME_COMPRESS
+static void tx_keyframe_acked(tx_window_t *window, const tx_slot_t *slot);
+#endif
+
+void tx_window_sent(tx_window_t *window, const uint8_t *mac, bool delivered, int64_t done_at_us)
+{
+    tx_slot_t *slot = tx_window_match(window, mac);
+    if (slot == NULL) {
+        return;  // Late report for a frame that already timed out or was dropped
+    }
+    if (delivered && slot->e2e_settled) {
+        record_tx_attempt(window, slot->mac, true, done_at_us - slot->sent_at_us, done_at_us);
+        if (slot->e2e_acked) {
+            count_tx_result(window, slot->mac, true, slot->attempts);
+        }
+        tx_slot_settled(window, slot);
+    } else if (delivered) {
+        HOT_LOGI(HOT_LOG_TX_SENT, TAG, "<--Sent %d bytes to " MACSTR " (Attempt %d)", slot->len, MAC2STR(slot->mac), slot->attempts);
+        record_tx_attempt(window, slot->mac, true, done_at_us - slot->sent_at_us, done_at_us);
+        count_tx_result(window, slot->mac, true, slot->attempts);
+#if CONFIG_FRAME_COMPRESS
+        if (!slot->reliable) {
+            tx_keyframe_acked(window, slot);  // Reliable keyframes wait for the peer's ACK, see tx_window_ack()
+        }
+#endif
+        if (slot->relayed_rx_us != 0) {
+            LINK_STATS_INC(window->env->counters, fwd_frames);
+            LINK_STATS_ADD(window->env->counters, fwd_latency_us, (unsigned)(done_at_us - slot->relayed_rx_us));
+        }
+        if (slot->reliable) {
+            slot->state = TX_SLOT_UNACKED;
+            slot->retry_at_us = done_at_us + RELIABLE_ACK_TIMEOUT_US;
+            return;
+        }
+        tx_slot_finish(window, slot, true);
+    } else {
+        HOT_LOGW(HOT_LOG_TX_FAILED, TAG, "Delivery failed (Attempt %d)", slot->attempts);
+        tx_slot_failed(window, slot, done_at_us);
+    }
+}
+
+// A reliable frame was not acknowledged in time: send it again, with a fresh
+// set of attempts, or give up on it.
+static void tx_slot_unacked(tx_window_t *window, tx_slot_t *slot, int64_t now_us)
+{
+    if (slot->tries >= RELIABLE_MAX_TRIES) {
+        COUNT_LINK_EVENT(window, slot->mac, tx_e2e_failed);
+        tx_slot_give_up(window, slot);
+        return;
+    }
+    slot->tries++;
+    slot->attempts = 0;
+    slot->state = TX_SLOT_PENDING;
+    slot->retry_at_us = now_us;
+}
+
+#if CONFIG_LINK_RELIABLE
+// Releases the frames an ACK from the peer covers. A frame still in flight
+// stays in the window until its send report, which then releases it whatever
+// it says. Frames RELIABLE_SACK_BITS or more behind the newest one are given
+// up on: the peer's window has moved past them.
+void tx_window_ack(tx_window_t *window, const uint8_t *mac, const frame_ack_t *ack)
+{
+    env_lock(window);
+    const peer_t *peer = env_peer(window, mac);
+    bool known = peer != NULL;
+    uint16_t last_rseq = known ? peer->tx_rseq : 0;
+    env_unlock(window);
+    if (!known) {
+        return;
+    }
+    for (int i = 0; i < TX_WINDOW_SIZE; i++) {
+        tx_slot_t *slot = &window->slots[i];
+        if (!slot->reliable || slot->e2e_settled || slot->state == TX_SLOT_FREE || slot->state == TX_SLOT_FILLING ||
+            memcmp(slot->mac, mac, LINK_TRANSPORT_MAC_LEN) != 0) {
+            continue;
+        }
+        bool stale = (uint16_t)(last_rseq - slot->rseq) >= RELIABLE_SACK_BITS;
+        if (!stale && !reliable_acked(ack, last_rseq, slot->rseq)) {
+            continue;
+        }
+        if (stale) {
+            COUNT_LINK_EVENT(window, slot->mac, tx_e2e_failed);
+        } else {
+            COUNT_LINK_EVENT(window, slot->mac, tx_e2e_acked);
+#if CONFIG_FRAME_COMPRESS
+            tx_keyframe_acked(window, slot);
+#endif
+        }
+        slot->e2e_settled = true;
+        slot->e2e_acked = !stale;
+        if (slot->state != TX_SLOT_IN_FLIGHT) {
+            tx_slot_settled(window, slot);
+        }
+    }
+}
+#endif
+
+// Spends one credit on a bulk frame about to be transmitted. Without credit the
+// slot waits for the next grant, or until TX_CREDIT_PROBE_US has passed since
+// the last one: that frame then probes the peer, whose reply carries new credit.
+static bool tx_credit_take(tx_window_t *window, tx_slot_t *slot, int64_t now_us)
+{
+    bool allowed = true;
+    int64_t probe_at_us = 0;
+    env_lock(window);
+    peer_t *peer = env_peer(window, slot->mac);
+    if (peer != NULL && peer->tx_limited) {
+        if (peer->tx_credits > 0) {
+            peer->tx_credits--;
+        } else if (now_us - peer->tx_limited_at_us >= TX_CREDIT_PROBE_US) {
+            peer->tx_limited_at_us = now_us;
+        } else {
+            allowed = false;
+            probe_at_us = peer->tx_limited_at_us + TX_CREDIT_PROBE_US;
+            if (!slot->credit_wait) {
+                LINK_STATS_INC(&peer->counters, tx_credit_waits);
+                LINK_STATS_INC(window->env->counters, tx_credit_waits);
+            }
+        }
+    }
+    env_unlock(window);
+    slot->credit_wait = !allowed;
+    if (!allowed) {
+        slot->retry_at_us = probe_at_us;
+    }
+    return allowed;
+}
+
+bool tx_window_credit_grant(tx_window_t *window, const uint8_t *mac, uint8_t credits, int64_t now_us)
+{
+    env_lock(window);
+    peer_t *peer = env_peer(window, mac);
+    if (peer != NULL) {
+        peer->tx_limited = credits != FRAME_CREDIT_UNLIMITED;
+        peer->tx_credits = peer->tx_limited ? credits : 0;
+        peer->tx_limited_at_us = now_us;
+    }
+    env_unlock(window);
+    return peer != NULL && credits > 0;
+}
+
+void tx_window_credit_resume(tx_window_t *window, int64_t now_us)
+{
+    for (int i = 0; i < TX_WINDOW_SIZE; i++) {
+        tx_slot_t *slot = &window->slots[i];
+        if (slot->credit_wait) {
+            slot->credit_wait = false;
+            slot->retry_at_us = now_us;
+        }
+    }
+}
+
+bool tx_window_credit_available(tx_window_t *window, const uint8_t *mac, int64_t now_us)
+{
+    bool available = true;
+    env_lock(window);
+    const peer_t *peer = env_peer(window, mac);
+    if (peer != NULL && peer->tx_limited && peer->tx_credits == 0) {
+        available = now_us - peer->tx_limited_at_us >= TX_CREDIT_PROBE_US;
+    }
+    env_unlock(window);
+    return available;
+}
+
+static bool tx_radio_up(const tx_window_t *window, int64_t now_us)
+{
+    const tx_window_env_t *env = window->env;
+    return env->tx_allowed == NULL || env->tx_allowed(env->ctx, now_us);
+}
+
+void tx_window_service(tx_window_t *window, int64_t now_us)
+{
+    bool radio_up = tx_radio_up(window, now_us);
+    for (int i = 0; i < TX_WINDOW_SIZE; i++) {
+        tx_slot_t *slot = &window->slots[i];
+        if (slot->state == TX_SLOT_IN_FLIGHT && now_us >= slot->timeout_at_us) {
+            HOT_LOGW(HOT_LOG_TX_TIMEOUT, TAG, "Timeout waiting for send callback (Attempt %d)", slot->attempts);
+            COUNT_LINK_EVENT(window, slot->mac, cb_timeouts);
+            tx_slot_failed(window, slot, now_us);
+        } else if (slot->state == TX_SLOT_UNACKED && radio_up && now_us >= slot->retry_at_us) {
+            tx_slot_unacked(window, slot, now_us);
+        }
+    }
+    for (int lane = 0; lane < TX_LANE_COUNT; lane++) {
+        for (int i = 0; i < TX_WINDOW_SIZE; i++) {
+            tx_slot_t *slot = &window->slots[i];
+            if (radio_up && slot->state == TX_SLOT_PENDING && slot->lane == (tx_lane_t)lane &&
+                now_us >= slot->retry_at_us && (lane != TX_LANE_BULK || tx_credit_take(window, slot, now_us))) {
+                tx_window_transmit(window, slot, now_us);
+            }
+        }
+    }
+}
+
+// While the radio sleeps, pending frames wait for the caller to wake the
+// window instead.
+int64_t tx_window_next_us(const tx_window_t *window, int64_t now_us)
+{
+    bool radio_up = tx_radio_up(window, now_us);
+    int64_t next_us = -1;
+    for (int i = 0; i < TX_WINDOW_SIZE; i++) {
+        const tx_slot_t *slot = &window->slots[i];
+        int64_t due_us;
+        if (slot->state == TX_SLOT_PENDING && radio_up) {
+            due_us = slot->retry_at_us;
+        } else if (slot->state == TX_SLOT_IN_FLIGHT) {
+            due_us = slot->timeout_at_us;
+        } else if (slot->state == TX_SLOT_UNACKED && radio_up) {
+            due_us = slot->retry_at_us;
+        } else {
+            continue;
+        }
+        if (next_us < 0 || due_us < next_us) {
+            next_us = due_us;
+        }
+    }
+    return next_us;
+}
+
+// The bulk lane is kept out of the last TX_CONTROL_RESERVED_SLOTS slots. When
+// it has used up its share, its oldest retrying frame gives way to the new one.
+// The slot gets frame if one is given, else a buffer from frame_pool.
+static tx_slot_t *tx_window_free_slot(tx_window_t *window, tx_lane_t lane, frame_buf_t *frame)
+{
+    tx_slot_t *free_slot = NULL;
+    tx_slot_t *stale = NULL;
+    int lane_used = 0;
+    for (int i = 0; i < TX_WINDOW_SIZE; i++) {
+        tx_slot_t *slot = &window->slots[i];
+        if (slot->state == TX_SLOT_FREE) {
+            free_slot = free_slot != NULL ? free_slot : slot;
+            continue;
+        }
+        if (slot->lane != lane) {
+            continue;
+        }
+        lane_used++;
+        if (slot->state == TX_SLOT_PENDING && slot->attempts > 0 && !slot->reliable &&
+            (stale == NULL || slot->sent_at_us < stale->sent_at_us)) {
+            stale = slot;
+        }
+    }
+
+    if (lane == TX_LANE_BULK && lane_used >= TX_WINDOW_SIZE - TX_CONTROL_RESERVED_SLOTS) {
+        free_slot = NULL;
+    }
+    if (free_slot == NULL && tx_lane_policies[lane].supersede && stale != NULL) {
+        COUNT_LINK_EVENT(window, stale->mac, tx_superseded);
+        tx_slot_finish(window, stale, false);
+        free_slot = stale;
+    }
+    if (free_slot == NULL) {
+        return NULL;
+    }
+    // The window size bounds how many pool buffers TX can hold at once.
+    free_slot->frame = frame != NULL ? frame : frame_pool_alloc();
+    if (free_slot->frame == NULL) {
+        return NULL;
+    }
+    free_slot->lane = lane;
+    free_slot->relayed_rx_us = 0;
+    free_slot->credit_wait = false;
+    free_slot->reliable = false;
+    free_slot->e2e_settled = false;
+    free_slot->msg_count = 0;
+    return free_slot;
+}
+
+static tx_slot_t *tx_batch_find(tx_window_t *window, const uint8_t *mac_addr, tx_lane_t lane)
+{
+    for (int i = 0; i < TX_WINDOW_SIZE; i++) {
+        tx_slot_t *slot = &window->slots[i];
+        if (slot->state == TX_SLOT_FILLING && slot->lane == lane &&
+            memcmp(slot->mac, mac_addr, LINK_TRANSPORT_MAC_LEN) == 0) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+#if CONFIG_FRAME_COMPRESS
+// Codec per frame type: telemetry is delta-coded, batches and bulk fragments
+// are LZ-compressed. Everything else is short or read in place by relays.
+static uint8_t tx_codec_for(uint8_t type)
+{
+    switch (type) {
+    case FRAME_TYPE_DATA:
+        return FRAME_FLAG_DELTA;
+#if CONFIG_FRAME_COMPRESS_LZ
+    case FRAME_TYPE_BATCH:
+    case FRAME_TYPE_FRAG:
+        return FRAME_FLAG_LZ;
+#endif
+    default:
+        return 0;
+    }
+}
+
+// Compresses a finished frame in place, before it is sealed. A DATA frame is
+// delta-coded against the newest keyframe the peer acknowledged; one sent in
+// full becomes a keyframe itself. Frames that would not shrink stay as they are.
+static void tx_slot_compress(tx_window_t *window, tx_slot_t *slot)
+{
+    frame_header_t hdr;
+    memcpy(&hdr, slot->frame->data, FRAME_HEADER_LEN);
+    uint8_t codec = tx_codec_for(hdr.type);
+    uint8_t *payload = slot->frame->data + FRAME_HEADER_LEN;
+    uint8_t packed[FRAME_MAX_PAYLOAD_LEN];
+    int packed_len = 0;
+
+    if (codec == FRAME_FLAG_DELTA) {
+        if (memcmp(slot->mac, broadcast_mac, LINK_TRANSPORT_MAC_LEN) == 0 ||
+            hdr.payload_len > CONFIG_FRAME_COMPRESS_DELTA_MAX_LEN) {
+            return;
+        }
+        compress_ref_t ref;
+        bool found = false;
+        env_lock(window);
+        peer_t *peer = env_peer(window, slot->mac);
+        const compress_ref_t *newest = peer != NULL ? compress_history_newest_acked(&peer->delta_tx) : NULL;
+        if (newest != NULL && (uint16_t)(hdr.seq - newest->seq) <= COMPRESS_REF_MAX_AGE) {
+            ref = *newest;
+            found = true;
+        }
+        env_unlock(window);
+        if (found) {
+            packed[0] = (uint8_t)(hdr.seq - ref.seq);
+            packed_len = compress_delta_encode(ref.data, ref.len, payload, hdr.payload_len, packed + 1,
+                                               hdr.payload_len - 2);
+            packed_len = packed_len > 0 ? packed_len + 1 : 0;
+        }
+        if (packed_len == 0) {
+            env_lock(window);
+            peer = env_peer(window, slot->mac);
+            if (peer != NULL) {
+                compress_history_put(&peer->delta_tx, hdr.seq, payload, hdr.payload_len);
+            }
+            env_unlock(window);
+            return;
+        }
+    } else if (codec == FRAME_FLAG_LZ) {
+        packed_len = compress_lz_encode(payload, hdr.payload_len, packed, hdr.payload_len - 1);
+        if (packed_len == 0) {
+            return;
+        }
+    } else {
+        return;
+    }
+
+    memcpy(payload, packed, packed_len);
+    slot->len = frame_write_header(slot->frame->data, hdr.type, hdr.flags | codec, hdr.seq, packed_len);
+    unsigned saved = hdr.payload_len - packed_len;
+    LINK_STATS_INC(window->env->counters, tx_compressed);
+    LINK_STATS_ADD(window->env->counters, tx_bytes_saved, saved);
+    env_lock(window);
+    peer_t *peer = env_peer(window, slot->mac);
+    if (peer != NULL) {
+        LINK_STATS_INC(&peer->counters, tx_compressed);
+        LINK_STATS_ADD(&peer->counters, tx_bytes_saved, saved);
+    }
+    env_unlock(window);
+}
+
+// A keyframe can be referenced once the peer has acknowledged it. A MAC ACK
+// only says the radio got it: the frame may still be dropped before the RX
+// side keeps it, so with CONFIG_LINK_RELIABLE only the end-to-end ACK counts.
+static void tx_keyframe_acked(tx_window_t *window, const tx_slot_t *slot)
+{
+    frame_header_t hdr;
+    memcpy(&hdr, slot->frame->data, FRAME_HEADER_LEN);
+    if (hdr.type != FRAME_TYPE_DATA || (hdr.flags & FRAME_FLAG_DELTA)) {
+        return;
+    }
+    env_lock(window);
+    peer_t *peer = env_peer(window, slot->mac);
+    compress_ref_t *ref = peer != NULL ? compress_history_find(&peer->delta_tx, hdr.seq) : NULL;
+    if (ref != NULL) {
+        ref->acked = true;
+    }
+    env_unlock(window);
+}
+#endif
+
+#if CONFIG_LINK_RELIABLE
+// Messages whose loss the application would notice. Keepalives, discovery and
+// channel switches have their own timeouts, benchmark frames measure the raw
+// link and relays forward mesh frames in place.
+static bool tx_reliable_type(uint8_t type)
+{
+    switch (type) {
+    case FRAME_TYPE_DATA:
+    case FRAME_TYPE_CMD:
+    case FRAME_TYPE_FRAG:
+    case FRAME_TYPE_FRAG_ACK:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Numbers a finished frame for end-to-end acknowledgement, before it is
+// compressed and sealed. The room for frame_rel_t is kept free by
+// FRAME_MAX_PAYLOAD_LEN.
+static void tx_slot_number(tx_window_t *window, tx_slot_t *slot)
+{
+    env_lock(window);
+    peer_t *peer = env_peer(window, slot->mac);
+    uint16_t rseq = peer != NULL ? ++peer->tx_rseq : 0;
+    env_unlock(window);
+    if (peer == NULL) {
+        slot->reliable = false;
+        return;
+    }
+    frame_header_t hdr;
+    memcpy(&hdr, slot->frame->data, FRAME_HEADER_LEN);
+    uint8_t *payload = slot->frame->data + FRAME_HEADER_LEN;
+    frame_rel_t rel = { .rseq = rseq };
+    memmove(payload + sizeof(rel), payload, hdr.payload_len);
+    memcpy(payload, &rel, sizeof(rel));
+    slot->len = frame_write_header(slot->frame->data, hdr.type, hdr.flags | FRAME_FLAG_RELIABLE, hdr.seq,
+                                   hdr.payload_len + sizeof(rel));
+    slot->rseq = rseq;
+    slot->tries = 1;
+}
+
+// Adds the ACK we owe the peer to a batch that is about to go out to it, which
+// saves the ACK a frame of its own.
+static void tx_batch_piggyback_ack(tx_window_t *window, tx_slot_t *slot)
+{
+    bool added = false;
+    env_lock(window);
+    peer_t *peer = env_peer(window, slot->mac);
+    if (peer != NULL && peer->rel_ack_owed) {
+        frame_ack_t ack;
+        reliable_rx_ack(&peer->rel_rx, &ack);
+        added = batch_add(&slot->batch, FRAME_TYPE_ACK, &ack, sizeof(ack));
+        if (added) {
+            peer->rel_ack_owed = false;
+            LINK_STATS_INC(&peer->counters, rx_acks_piggybacked);
+        }
+    }
+    env_unlock(window);
+    if (added) {
+        LINK_STATS_INC(window->env->counters, rx_acks_piggybacked);
+    }
+}
+
+bool tx_window_send_acks(tx_window_t *window, int64_t now_us)
+{
+    uint8_t macs[PEER_TABLE_SIZE][LINK_TRANSPORT_MAC_LEN];
+    frame_ack_t acks[PEER_TABLE_SIZE];
+    int count = 0;
+    env_lock(window);
+    for (int i = 0; i < PEER_TABLE_SIZE; i++) {
+        peer_t *peer = peer_table_at(window->env->peers, i);
+        if (peer != NULL && peer->rel_ack_owed) {
+            peer->rel_ack_owed = false;
+            reliable_rx_ack(&peer->rel_rx, &acks[count]);
+            memcpy(macs[count++], peer->mac, LINK_TRANSPORT_MAC_LEN);
+        }
+    }
+    env_unlock(window);
+
+    bool all_sent = true;
+    tx_msg_t msg = {
+        .type = FRAME_TYPE_ACK,
+        .flags = TX_MSG_FLAG_FLUSH,
+        .len = sizeof(frame_ack_t),
+    };
+    for (int i = 0; i < count; i++) {
+        memcpy(msg.mac, macs[i], LINK_TRANSPORT_MAC_LEN);
+        memcpy(msg.data, &acks[i], sizeof(acks[i]));
+        if (tx_window_append(window, &msg, TX_LANE_CONTROL, now_us)) {
+            COUNT_LINK_EVENT(window, macs[i], rx_acks_sent);
+            continue;
+        }
+        all_sent = false;  // Window full: owed again, with the newer state by then
+        env_lock(window);
+        peer_t *peer = env_peer(window, macs[i]);
+        if (peer != NULL) {
+            peer->rel_ack_owed = true;
+        }
+        env_unlock(window);
+    }
+    return all_sent;
+}
+#endif
+
+static void tx_slot_ready(tx_window_t *window, tx_slot_t *slot, uint32_t counter, int64_t now_us)
+{
+#if CONFIG_LINK_RELIABLE
+    if (slot->reliable) {
+        tx_slot_number(window, slot);
+    }
+#endif
+#if CONFIG_FRAME_COMPRESS
+    tx_slot_compress(window, slot);
+#endif
+#if CONFIG_LINK_ENCRYPT
+    frame_header_t hdr;
+    memcpy(&hdr, slot->frame->data, FRAME_HEADER_LEN);
+    slot->unsealed = !tx_sent_in_clear(hdr.type) && memcmp(slot->mac, broadcast_mac, LINK_TRANSPORT_MAC_LEN) != 0;
+    slot->counter_hi = counter >> 16;
+    slot->key_wait_until_us = -1;
+#endif
+    slot->attempts = 0;
+    slot->state = TX_SLOT_PENDING;
+    slot->retry_at_us = now_us;
+}
+
+static void tx_batch_close(tx_window_t *window, tx_slot_t *slot, int64_t now_us)
+{
+#if CONFIG_LINK_RELIABLE
+    if (slot->reliable) {
+        tx_batch_piggyback_ack(window, slot);
+    }
+#endif
+    uint32_t counter = next_tx_seq(window, slot->mac);
+    slot->len = batch_finish(&slot->batch, (uint16_t)counter);
+    tx_slot_ready(window, slot, counter, now_us);
+}
+
+// Unicast messages of the reliable types are acknowledged end to end when
+// CONFIG_LINK_RELIABLE is set.
+static bool tx_wants_ack(const tx_msg_t *msg)
+{
+#if CONFIG_LINK_RELIABLE
+    return tx_reliable_type(msg->type) && memcmp(msg->mac, broadcast_mac, LINK_TRANSPORT_MAC_LEN) != 0;
+#else
+    return false;
+#endif
+}
+
+// Notes an application message that went into slot's frame. A peer's DATA
+// messages are numbered per peer and all take the bulk lane in queue order, so
+// a frame holds a run of consecutive IDs.
+static void tx_slot_track(tx_slot_t *slot, const tx_msg_t *msg)
+{
+    if (msg->type != FRAME_TYPE_DATA) {
+        return;
+    }
+    if (slot->msg_count++ == 0) {
+        slot->msg_first = msg->id;
+    }
+    slot->msg_last = msg->id;
+}
+
+bool tx_window_append(tx_window_t *window, const tx_msg_t *msg, tx_lane_t lane, int64_t now_us)
+{
+    tx_slot_t *slot = tx_batch_find(window, msg->mac, lane);
+
+    if (msg->type == 0) {
+        if (slot != NULL) {
+            tx_batch_close(window, slot, now_us);
+        }
+        return true;
+    }
+
+    if (msg->frame != NULL) {
+        // A mesh frame to forward already holds its payload: only the link header is rewritten.
+        if (slot != NULL) {
+            tx_batch_close(window, slot, now_us);
+        }
+        slot = tx_window_free_slot(window, lane, msg->frame);
+        if (slot == NULL) {
+            return false;
+        }
+        memcpy(slot->mac, msg->mac, LINK_TRANSPORT_MAC_LEN);
+        slot->relayed_rx_us = msg->frame->rx_at_us;
+        uint32_t counter = next_tx_seq(window, slot->mac);
+        slot->len = frame_write_header(slot->frame->data, msg->type, 0, (uint16_t)counter, msg->len);
+        tx_slot_ready(window, slot, counter, now_us);
+        return true;
+    }
+
+    if (msg->ref != NULL) {
+        // Referenced payloads are bulk fragments that fill a frame on their own:
+        // copy them straight from the caller's buffer into a slot.
+        if (slot != NULL) {
+            tx_batch_close(window, slot, now_us);
+        }
+        slot = tx_window_free_slot(window, lane, NULL);
+        if (slot == NULL) {
+            return false;
+        }
+        memcpy(slot->mac, msg->mac, LINK_TRANSPORT_MAC_LEN);
+        slot->reliable = tx_wants_ack(msg);
+        memcpy(slot->frame->data + FRAME_HEADER_LEN, msg->data, msg->len);
+        memcpy(slot->frame->data + FRAME_HEADER_LEN + msg->len, msg->ref, msg->ref_len);
+        uint32_t counter = next_tx_seq(window, slot->mac);
+        slot->len = frame_write_header(slot->frame->data, msg->type, 0, (uint16_t)counter, msg->len + msg->ref_len);
+        tx_slot_ready(window, slot, counter, now_us);
+        return true;
+    }
+
+#if CONFIG_LINK_ENCRYPT
+    if (slot != NULL && tx_sent_in_clear(msg->type)) {
+        tx_batch_close(window, slot, now_us);  // Discovery messages need a plain frame of their own
+        slot = NULL;
+    }
+#endif
+    if (slot != NULL && !batch_add(&slot->batch, msg->type, msg->data, msg->len)) {
+        tx_batch_close(window, slot, now_us);
+        slot = NULL;
+    } else if (slot != NULL) {
+        slot->reliable |= tx_wants_ack(msg);
+        tx_slot_track(slot, msg);
+    }
+    if (slot == NULL) {
+        slot = tx_window_free_slot(window, lane, NULL);
+        if (slot == NULL) {
+            return false;
+        }
+        memcpy(slot->mac, msg->mac, LINK_TRANSPORT_MAC_LEN);
+        slot->reliable = tx_wants_ack(msg);
+        slot->state = TX_SLOT_FILLING;
+        slot->flush_at_us = now_us + BATCH_FLUSH_DEADLINE_US;
+        batch_begin(&slot->batch, slot->frame->data);
+        tx_slot_track(slot, msg);
+        if (!batch_add(&slot->batch, msg->type, msg->data, msg->len)) {
+            // Too large to carry the record overhead: send it as a frame of its own.
+            uint32_t counter = next_tx_seq(window, slot->mac);
+            slot->len = frame_encode(slot->frame->data, sizeof(slot->frame->data), msg->type, 0, (uint16_t)counter, msg->data, msg->len);
+            tx_slot_ready(window, slot, counter, now_us);
+            return true;
+        }
+    }
+
+    bool flush = msg->flags & TX_MSG_FLAG_FLUSH;
+#if CONFIG_LINK_ENCRYPT
+    flush |= tx_sent_in_clear(msg->type);
+#endif
+    if (flush) {
+        tx_batch_close(window, slot, now_us);
+    }
+    return true;
+}
+
+int64_t tx_window_flush(tx_window_t *window, int64_t now_us)
+{
+    int64_t next_flush_us = -1;
+    for (int i = 0; i < TX_WINDOW_SIZE; i++) {
+        tx_slot_t *slot = &window->slots[i];
+        if (slot->state != TX_SLOT_FILLING) {
+            continue;
+        }
+        if (slot->flush_at_us <= now_us) {
+            tx_batch_close(window, slot, now_us);
+        } else if (next_flush_us < 0 || slot->flush_at_us < next_flush_us) {
+            next_flush_us = slot->flush_at_us;
+        }
+    }
+    return next_flush_us;
+}
@@ -0,0 +1,217 @@
+/**
+ * tx_window.h
+ *
+ * The send window of the link: batching of queued messages into frames, the
+ * per-lane retry policies, matching of send reports, end-to-end
+ * acknowledgement (CONFIG_LINK_RELIABLE) and the sender side of flow control.
+ * Nothing here depends on FreeRTOS or ESP-IDF: the caller passes the time into
+ * every call, arms its own timers for the deadlines returned, and provides the
+ * transport, the peer table and the rest through tx_window_env_t. On the device
+ * esp_now_link.c drives one window from its sender task; the host harness in
+ * host/ drives one per simulated node.
+ *
+ * A window is owned by one task. Only tx_window_credit_grant() and
+ * tx_window_credit_available() may be called from others.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "frame.h"
+#include "batch.h"
+#include "frame_pool.h"
+#include "link_stats.h"
+#include "link_timing.h"
+#include "link_transport.h"
+#include "peer_table.h"
+#if CONFIG_LINK_ENCRYPT
+#include "link_crypto.h"
+#endif
+
+#define CONTROL_MAX_ATTEMPTS 8      // Control frames retry hard, then the peer is declared lost
+#define CONTROL_RETRY_DELAY_US 2000 // Base delay before a control retry, doubled per consecutive failure
+#define BULK_MAX_ATTEMPTS 3         // Bulk frames are best effort
+#define BULK_RETRY_DELAY_US 13000
+#define TX_WINDOW_SIZE 8            // Maximum number of frames in flight at once
+#define TX_CONTROL_RESERVED_SLOTS 2 // Window slots the bulk lane can never take
+#define BATCH_FLUSH_DEADLINE_US 2000 // Longest a queued message waits for others to share its frame
+#define TX_CREDIT_PROBE_US 100000   // A peer that grants no credit for this long still gets one frame
+#define RELIABLE_ACK_DELAY_US 5000  // Longest an end-to-end ACK waits for one of our frames to ride on
+#define RELIABLE_ACK_TIMEOUT_US 30000 // Resend a reliable frame whose ACK has not come this long after its MAC ACK
+#define RELIABLE_MAX_TRIES 5        // Sends of a reliable frame before it is given up on
+#define TX_KEY_WAIT_US 500000       // Longest a unicast frame waits for the peer's session key (CONFIG_LINK_ENCRYPT)
+
+#define TX_MSG_FLAG_FLUSH 0x01     // Send the destination's batch right after this message
+
+typedef enum {
+    TX_SLOT_FREE = 0,
+    TX_SLOT_FILLING,    // Collecting messages into a batch until flush_at_us or it is full
+    TX_SLOT_PENDING,    // Waiting to be (re)transmitted at retry_at_us
+    TX_SLOT_IN_FLIGHT,  // Handed to the transport, waiting for its send report
+    TX_SLOT_UNACKED,    // Reliable frame the peer's MAC took, waiting for its end-to-end ACK until retry_at_us
+} tx_slot_state_t;
+
+// Control messages (commands, discovery, keepalives...) have their own lane and
+// always go first, so their latency does not depend on the telemetry load.
+typedef enum {
+    TX_LANE_CONTROL = 0,
+    TX_LANE_BULK,
+    TX_LANE_COUNT,
+} tx_lane_t;
+
+typedef struct {
+    uint8_t mac[LINK_TRANSPORT_MAC_LEN];
+    uint8_t type;                   // frame_type_t, 0 marks an explicit flush request
+    uint8_t flags;
+    int len;
+    uint8_t data[FRAME_MAX_PAYLOAD_LEN];
+    const uint8_t *ref;             // Caller-owned bytes appended to data when the frame is built
+    int ref_len;
+    frame_buf_t *frame;             // Received frame handed over whole for forwarding
+    uint32_t id;                    // DATA messages: from tx_window_next_msg_id(), reported back through finished
+} tx_msg_t;
+
+typedef struct {
+    tx_slot_state_t state;
+    tx_lane_t lane;
+    uint16_t tag;                   // Sequence tag of the current transmission attempt
+    int attempts;
+    int64_t sent_at_us;
+    int64_t timeout_at_us;          // Send report deadline derived from the link's RTT
+    int64_t retry_at_us;
+    int64_t flush_at_us;
+    batch_t batch;                  // Builds the frame in place in data while FILLING
+    uint8_t mac[LINK_TRANSPORT_MAC_LEN];
+    frame_buf_t *frame;             // Taken from frame_pool while the slot is not FREE
+    int len;
+    int64_t relayed_rx_us;          // Arrival of a mesh frame we forward, 0 for our own frames
+    bool credit_wait;               // Held until the peer grants RX credit
+    bool reliable;                  // Kept until the peer acknowledges it end to end, see reliable.h
+    uint16_t rseq;
+    int tries;                      // Sends of a reliable frame, each with up to the lane's attempts
+    bool e2e_settled;               // ACKed or given up on while a copy was in flight: ends on its send report
+    bool e2e_acked;                 // How it was settled
+    int msg_count;                  // DATA messages in the frame, with IDs msg_first to msg_last
+    uint32_t msg_first;
+    uint32_t msg_last;
+    bool unsealed;                  // CONFIG_LINK_ENCRYPT: to be sealed before its first transmission
+    uint16_t counter_hi;            // High half of its frame counter, bound into the seal
+    int64_t key_wait_until_us;      // Deadline for the peer's session key once it had to wait, -1 before
+} tx_slot_t;
+
+/**
+ * What the window needs from its surroundings. Optional operations may be NULL.
+ * The peer table is shared with the RX side: every access holds lock.
+ */
+typedef struct {
+    const link_transport_t *transport;
+    peer_table_t *peers;
+    link_counters_t *counters;      // Totals over all peers and the broadcast address
+    const uint8_t *own_mac;         // Bound into sealed frames
+
+    void (*lock)(void *ctx);
+    void (*unlock)(void *ctx);
+    uint32_t (*random)(void *ctx);  // For retry jitter
+
+    /** Optional: false while the radio sleeps, which holds back pending frames. */
+    bool (*tx_allowed)(void *ctx, int64_t now_us);
+
+    /** Optional: outcome of one transmission attempt to a unicast peer, for rate adaptation. */
+    void (*attempt_done)(void *ctx, const uint8_t *mac, bool delivered);
+
+    /**
+     * A control frame to mac failed for good. Returns true if the peer was
+     * removed, which drops everything else queued for it.
+     */
+    bool (*peer_failed)(void *ctx, const uint8_t *mac);
+
+    /**
+     * Optional: DATA messages first_id to last_id to mac were delivered, or
+     * given up on. The range is (uint32_t)(last_id - first_id) + 1 long and
+     * may wrap, see tx_window_next_msg_id().
+     */
+    void (*finished)(void *ctx, const uint8_t *mac, uint32_t first_id, uint32_t last_id, bool delivered);
+
+    void *ctx;                      // Passed to every operation
+} tx_window_env_t;
+
+typedef struct {
+    const tx_window_env_t *env;
+    tx_slot_t slots[TX_WINDOW_SIZE];
+    uint16_t next_tag;
+    uint32_t broadcast_seq;
+    uint32_t broadcast_msg_id;      // Last ID of a DATA message with no peer entry, under the env lock
+    link_timing_t broadcast_timing; // The broadcast address has no peer entry
+#if CONFIG_LINK_ENCRYPT
+    link_crypto_ctx_t crypto;
+#endif
+} tx_window_t;
+
+void tx_window_init(tx_window_t *window, const tx_window_env_t *env);
+
+/** The lane a message of type travels in. */
+tx_lane_t tx_lane_for(uint8_t type);
+
+/**
+ * Frames that always travel in clear, as the RX side expects: discovery frames
+ * carry the session nonces that keys are derived from, and wake schedules are
+ * broadcast, which has no key.
+ */
+bool tx_sent_in_clear(uint8_t type);
+
+/**
+ * Numbers a DATA message to mac, under the env lock so any task may call it.
+ * IDs count up by one per peer, so the messages of a frame are the IDs from
+ * its first to its last and nothing else. Messages to the broadcast address,
+ * or to a MAC with no peer entry, share one count. IDs wrap after 2^32 and
+ * start over when a removed peer is added again.
+ */
+uint32_t tx_window_next_msg_id(tx_window_t *window, const uint8_t *mac);
+
+/**
+ * Adds a message to its destination's batch in the lane, opening one if
+ * needed. Returns false if no window slot is free; the caller keeps the
+ * message and tries again once a send report or ACK has freed one.
+ */
+bool tx_window_append(tx_window_t *window, const tx_msg_t *msg, tx_lane_t lane, int64_t now_us);
+
+/** Closes the batches whose deadline has passed. Returns the next deadline, or -1 if none. */
+int64_t tx_window_flush(tx_window_t *window, int64_t now_us);
+
+/** The transport's send report for mac, delivered at done_at_us. */
+void tx_window_sent(tx_window_t *window, const uint8_t *mac, bool delivered, int64_t done_at_us);
+
+/** Expires lost send reports and (re)transmits every pending frame that is due. */
+void tx_window_service(tx_window_t *window, int64_t now_us);
+
+/** Earliest retransmission or send report deadline, or -1 if none. Open batches are left to tx_window_flush(). */
+int64_t tx_window_next_us(const tx_window_t *window, int64_t now_us);
+
+/** Drops everything queued for mac, e.g. once the peer is gone. */
+void tx_window_drop(tx_window_t *window, const uint8_t *mac);
+
+#if CONFIG_LINK_RELIABLE
+/** An ACK record from mac: settles the reliable frames it covers. */
+void tx_window_ack(tx_window_t *window, const uint8_t *mac, const frame_ack_t *ack);
+
+/**
+ * Queues the ACKs no batch took along, in frames of their own. Returns false
+ * if some did not fit in the window; they stay owed for the next call.
+ */
+bool tx_window_send_acks(tx_window_t *window, int64_t now_us);
+#endif
+
+/**
+ * A credit update from a peer we send to, carried by its keepalive. Only
+ * touches the peer table. Returns true if mac may send again, in which case
+ * tx_window_credit_resume() should follow on the window's task.
+ */
+bool tx_window_credit_grant(tx_window_t *window, const uint8_t *mac, uint8_t credits, int64_t now_us);
+
+/** Retries the bulk frames held for lack of credit now. */
+void tx_window_credit_resume(tx_window_t *window, int64_t now_us);
+
+/** True if a bulk frame to mac would go out now. Only touches the peer table. */
+bool tx_window_credit_available(tx_window_t *window, const uint8_t *mac, int64_t now_us);
@@ -0,0 +1,73 @@
+/**
+ * bench.c
+ *
+ * Microbenchmark runner (see bench.h).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "bench.h"
+
+#define BENCH_FIRST_ITERATIONS 1
+#define BENCH_MAX_ITERATIONS (1ull << 34)
+
+static double bench_now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static double bench_once(const bench_t *bench, uint64_t iterations, bench_state_t *state)
+{
+    memset(state, 0, sizeof(*state));
+    state->iterations = iterations;
+    state->arg = bench->arg;
+    double start_s = bench_now_s();
+    bench->fn(state);
+    return bench_now_s() - start_s;
+}
+
+int bench_run_all(const bench_t *benches, int count, const char *filter, double min_time_s)
+{
+    printf("%-40s %14s %14s %12s\n", "Benchmark", "Time", "Iterations", "Throughput");
+    printf("--------------------------------------------------------------------------------------\n");
+    int ran = 0;
+    for (int i = 0; i < count; i++) {
+        const bench_t *bench = &benches[i];
+        char name[64];
+        if (bench->arg != 0) {
+            snprintf(name, sizeof(name), "%s/%lld", bench->name, (long long)bench->arg);
+        } else {
+            snprintf(name, sizeof(name), "%s", bench->name);
+        }
+        if (filter != NULL && strstr(name, filter) == NULL) {
+            continue;
+        }
+
+        // Grow the iteration count until one run lasts min_time_s, as Google Benchmark does.
+        bench_state_t state;
+        uint64_t iterations = BENCH_FIRST_ITERATIONS;
+        double elapsed_s = bench_once(bench, iterations, &state);
+        while (elapsed_s < min_time_s && iterations < BENCH_MAX_ITERATIONS) {
+            double scale = elapsed_s > 0 ? min_time_s * 1.4 / elapsed_s : 10.0;
+            if (scale > 10.0) {
+                scale = 10.0;
+            }
+            uint64_t next = (uint64_t)((double)iterations * scale);
+            iterations = next > iterations ? next : iterations + 1;
+            elapsed_s = bench_once(bench, iterations, &state);
+        }
+
+        double ns = elapsed_s * 1e9 / (double)iterations;
+        if (state.bytes != 0) {
+            printf("%-40s %11.1f ns %14llu %7.1f MB/s\n", name, ns, (unsigned long long)iterations,
+                   (double)state.bytes / elapsed_s / 1e6);
+        } else {
+            printf("%-40s %11.1f ns %14llu\n", name, ns, (unsigned long long)iterations);
+        }
+        ran++;
+    }
+    return ran;
+}
@@ -0,0 +1,60 @@
+/**
+ * bench.h
+ *
+ * Minimal microbenchmark runner in the style of Google Benchmark: a benchmark
+ * loops on bench_keep_running() and the runner picks the iteration count that
+ * fills the minimum run time, then reports the time per iteration. Also the
+ * entry points of the two benchmark suites of link_bench.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+    uint64_t iterations;            // Wanted for this run
+    uint64_t done;
+    int64_t arg;                    // From the benchmark's table entry
+    uint64_t bytes;                 // Set by the benchmark to report throughput
+} bench_state_t;
+
+typedef void (*bench_fn_t)(bench_state_t *state);
+
+typedef struct {
+    const char *name;
+    bench_fn_t fn;
+    int64_t arg;                    // Shown after a slash in the name, and passed in state->arg
+} bench_t;
+
+static inline bool bench_keep_running(bench_state_t *state)
+{
+    return state->done++ < state->iterations;
+}
+
+/** Keeps the compiler from optimizing away a result that is otherwise unused. */
+static inline void bench_do_not_optimize(const void *value)
+{
+    __asm__ volatile("" : : "g"(value) : "memory");
+}
+
+/**
+ * Runs every benchmark whose name contains filter (all of them when NULL) for
+ * at least min_time_s each and prints one line per benchmark. Returns how many ran.
+ */
+int bench_run_all(const bench_t *benches, int count, const char *filter, double min_time_s);
+
+/** Microbenchmarks of the framing, dedup, acknowledgement, compression and peer table code. */
+int bench_micro_run(const char *filter, double min_time_s);
+
+typedef struct {
+    float loss;                     // Per frame and per MAC ACK
+    uint32_t latency_us;
+    uint32_t bitrate_kbps;
+    int messages;                   // Reliable messages to deliver
+    int message_len;                // Application bytes per message
+    uint32_t seed;
+} bench_sim_config_t;
+
+/** Sends config->messages reliable messages between two simulated nodes and prints one SIM line. */
+void bench_sim_run(const bench_sim_config_t *config);
@@ -0,0 +1,324 @@
+/**
+ * bench_micro.c
+ *
+ * Microbenchmarks of the protocol code that runs per frame: encoding and
+ * decoding, batching, duplicate detection, end-to-end acknowledgement state,
+ * the compression codecs and peer table lookups. Inputs are built once per run,
+ * outside the timed loop.
+ */
+
+#include <string.h>
+#include "bench.h"
+#include "frame.h"
+#include "batch.h"
+#include "replay_window.h"
+#include "reliable.h"
+#include "compress.h"
+#include "peer_table.h"
+
+#define BENCH_TELEMETRY_LEN 48      // A typical sensor record
+#define BENCH_SMALL_RECORD_LEN 16   // Messages that share a batch
+
+static uint8_t bench_payload[FRAME_MAX_LEN];
+
+static void bench_fill(uint8_t *buf, int len, uint32_t seed)
+{
+    // Sensor-like data: slowly changing words with some noise, so the codecs have work to do.
+    for (int i = 0; i < len; i++) {
+        seed = seed * 1103515245u + 12345u;
+        buf[i] = (uint8_t)((i / 4) + ((seed >> 28) & 1));
+    }
+}
+
+static void bm_frame_encode(bench_state_t *state)
+{
+    int len = (int)state->arg;
+    uint8_t buf[FRAME_MAX_LEN];
+    uint16_t seq = 0;
+    while (bench_keep_running(state)) {
+        int n = frame_encode(buf, sizeof(buf), FRAME_TYPE_DATA, 0, seq++, bench_payload, len);
+        bench_do_not_optimize(&n);
+        bench_do_not_optimize(buf);
+    }
+    state->bytes = state->iterations * (uint64_t)len;
+}
+
+static void bm_frame_decode(bench_state_t *state)
+{
+    int len = (int)state->arg;
+    uint8_t buf[FRAME_MAX_LEN];
+    int frame_len = frame_encode(buf, sizeof(buf), FRAME_TYPE_DATA, 0, 1, bench_payload, len);
+    while (bench_keep_running(state)) {
+        frame_header_t hdr;
+        const uint8_t *payload;
+        bool ok = frame_decode(buf, frame_len, &hdr, &payload);
+        bench_do_not_optimize(&ok);
+        bench_do_not_optimize(&hdr);
+        bench_do_not_optimize(&payload);
+    }
+}
+
+static void bm_frame_data_roundtrip(bench_state_t *state)
+{
+    uint8_t buf[FRAME_MAX_LEN];
+    frame_data_t data = { .node_id = 0x1234, .counter = 0 };
+    while (bench_keep_running(state)) {
+        data.counter++;
+        int n = frame_encode_data(buf, sizeof(buf), (uint16_t)data.counter, &data);
+        frame_header_t hdr;
+        const uint8_t *payload;
+        frame_data_t out;
+        bool ok = n > 0 && frame_decode(buf, n, &hdr, &payload) && frame_decode_data(payload, hdr.payload_len, &out);
+        bench_do_not_optimize(&ok);
+        bench_do_not_optimize(&out);
+    }
+}
+
+static void bench_count_record(uint8_t type, const uint8_t *payload, int len, void *ctx)
+{
+    (*(int *)ctx)++;
+}
+
+// Fills a frame with small records, the way the sender packs a burst of messages.
+static void bm_batch_build(bench_state_t *state)
+{
+    uint8_t buf[FRAME_MAX_LEN];
+    uint16_t seq = 0;
+    while (bench_keep_running(state)) {
+        batch_t batch;
+        batch_begin(&batch, buf);
+        while (batch_add(&batch, FRAME_TYPE_DATA, bench_payload, BENCH_SMALL_RECORD_LEN)) {
+        }
+        int n = batch_finish(&batch, seq++);
+        bench_do_not_optimize(&n);
+        bench_do_not_optimize(buf);
+    }
+}
+
+static void bm_batch_split(bench_state_t *state)
+{
+    uint8_t buf[FRAME_MAX_LEN];
+    batch_t batch;
+    batch_begin(&batch, buf);
+    while (batch_add(&batch, FRAME_TYPE_DATA, bench_payload, BENCH_SMALL_RECORD_LEN)) {
+    }
+    int frame_len = batch_finish(&batch, 1);
+    frame_header_t hdr;
+    const uint8_t *payload;
+    frame_decode(buf, frame_len, &hdr, &payload);
+    while (bench_keep_running(state)) {
+        int records = 0;
+        bool ok = batch_split(payload, hdr.payload_len, bench_count_record, &records);
+        bench_do_not_optimize(&ok);
+        bench_do_not_optimize(&records);
+    }
+}
+
+static void bm_replay_window_in_order(bench_state_t *state)
+{
+    replay_window_t window;
+    replay_window_init(&window);
+    uint16_t seq = 0;
+    while (bench_keep_running(state)) {
+        replay_result_t result = replay_window_check(&window, seq++);
+        bench_do_not_optimize(&result);
+    }
+}
+
+// Every other frame arrives late, as after a retransmission.
+static void bm_replay_window_reordered(bench_state_t *state)
+{
+    replay_window_t window;
+    replay_window_init(&window);
+    uint16_t seq = 0;
+    while (bench_keep_running(state)) {
+        uint16_t got = (seq & 1) ? seq - 1 : seq + 1;
+        replay_result_t result = replay_window_check(&window, got);
+        bench_do_not_optimize(&result);
+        seq++;
+    }
+}
+
+static void bm_reliable_rx(bench_state_t *state)
+{
+    reliable_rx_t rx;
+    reliable_rx_init(&rx);
+    uint16_t rseq = 1;
+    while (bench_keep_running(state)) {
+        reliable_result_t result = reliable_rx_check(&rx, rseq++);
+        frame_ack_t ack;
+        reliable_rx_ack(&rx, &ack);
+        bench_do_not_optimize(&result);
+        bench_do_not_optimize(&ack);
+    }
+}
+
+// One ACK checked against a full window of outstanding frames, as tx_ack_apply() does.
+static void bm_reliable_acked_window(bench_state_t *state)
+{
+    frame_ack_t ack = { .cum = 100, .sack = 0x55 };
+    while (bench_keep_running(state)) {
+        int acked = 0;
+        for (uint16_t rseq = 97; rseq < 97 + 8; rseq++) {
+            acked += reliable_acked(&ack, 110, rseq);
+        }
+        bench_do_not_optimize(&acked);
+    }
+}
+
+static void bm_delta_encode(bench_state_t *state)
+{
+    int len = (int)state->arg;
+    uint8_t ref[FRAME_MAX_LEN];
+    uint8_t in[FRAME_MAX_LEN];
+    uint8_t out[FRAME_MAX_LEN];
+    bench_fill(ref, len, 1);
+    memcpy(in, ref, len);
+    in[len / 2] ^= 0x5A;            // One changed field
+    while (bench_keep_running(state)) {
+        int n = compress_delta_encode(ref, len, in, len, out, sizeof(out));
+        bench_do_not_optimize(&n);
+        bench_do_not_optimize(out);
+    }
+    state->bytes = state->iterations * (uint64_t)len;
+}
+
+static void bm_delta_decode(bench_state_t *state)
+{
+    int len = (int)state->arg;
+    uint8_t ref[FRAME_MAX_LEN];
+    uint8_t in[FRAME_MAX_LEN];
+    uint8_t coded[FRAME_MAX_LEN];
+    uint8_t out[FRAME_MAX_LEN];
+    bench_fill(ref, len, 1);
+    memcpy(in, ref, len);
+    in[len / 2] ^= 0x5A;
+    int coded_len = compress_delta_encode(ref, len, in, len, coded, sizeof(coded));
+    while (bench_keep_running(state)) {
+        int n = compress_delta_decode(ref, len, coded, coded_len, out, sizeof(out));
+        bench_do_not_optimize(&n);
+        bench_do_not_optimize(out);
+    }
+    state->bytes = state->iterations * (uint64_t)len;
+}
+
+static void bm_lz_encode(bench_state_t *state)
+{
+    int len = (int)state->arg;
+    uint8_t in[FRAME_MAX_LEN];
+    uint8_t out[FRAME_MAX_LEN];
+    bench_fill(in, len, 7);
+    while (bench_keep_running(state)) {
+        int n = compress_lz_encode(in, len, out, sizeof(out));
+        bench_do_not_optimize(&n);
+        bench_do_not_optimize(out);
+    }
+    state->bytes = state->iterations * (uint64_t)len;
+}
+
+static void bm_lz_decode(bench_state_t *state)
+{
+    int len = (int)state->arg;
+    uint8_t in[FRAME_MAX_LEN];
+    uint8_t coded[FRAME_MAX_LEN];
+    uint8_t out[FRAME_MAX_LEN];
+    bench_fill(in, len, 7);
+    int coded_len = compress_lz_encode(in, len, coded, sizeof(coded));
+    if (coded_len <= 0) {
+        return;                     // Incompressible input, nothing to measure
+    }
+    while (bench_keep_running(state)) {
+        int n = compress_lz_decode(coded, coded_len, out, sizeof(out));
+        bench_do_not_optimize(&n);
+        bench_do_not_optimize(out);
+    }
+    state->bytes = state->iterations * (uint64_t)len;
+}
+
+static peer_table_t bench_peers;
+
+static void bench_peer_mac(uint8_t *mac, int i)
+{
+    static const uint8_t base[PEER_MAC_LEN] = {0x34, 0x85, 0x18, 0x00, 0x00, 0x00};
+    memcpy(mac, base, PEER_MAC_LEN);
+    mac[4] = (uint8_t)(i * 37);
+    mac[5] = (uint8_t)i;
+}
+
+static void bench_peers_fill(void)
+{
+    peer_table_init(&bench_peers);
+    for (int i = 0; i < PEER_TABLE_SIZE; i++) {
+        uint8_t mac[PEER_MAC_LEN];
+        bool created;
+        bench_peer_mac(mac, i);
+        peer_table_add(&bench_peers, mac, &created);
+    }
+}
+
+// Lookups in a full table, cycling through every peer.
+static void bm_peer_table_find_hit(bench_state_t *state)
+{
+    bench_peers_fill();
+    uint8_t macs[PEER_TABLE_SIZE][PEER_MAC_LEN];
+    for (int i = 0; i < PEER_TABLE_SIZE; i++) {
+        bench_peer_mac(macs[i], i);
+    }
+    int i = 0;
+    while (bench_keep_running(state)) {
+        peer_t *peer = peer_table_find(&bench_peers, macs[i]);
+        bench_do_not_optimize(&peer);
+        i = i + 1 < PEER_TABLE_SIZE ? i + 1 : 0;
+    }
+}
+
+// A stranger's frames: every lookup walks a bucket to its end.
+static void bm_peer_table_find_miss(bench_state_t *state)
+{
+    bench_peers_fill();
+    uint8_t mac[PEER_MAC_LEN];
+    bench_peer_mac(mac, PEER_TABLE_SIZE + 1);
+    while (bench_keep_running(state)) {
+        peer_t *peer = peer_table_find(&bench_peers, mac);
+        bench_do_not_optimize(&peer);
+    }
+}
+
+static void bm_peer_table_churn(bench_state_t *state)
+{
+    bench_peers_fill();
+    uint8_t mac[PEER_MAC_LEN];
+    bench_peer_mac(mac, 0);
+    while (bench_keep_running(state)) {
+        bool created;
+        peer_table_remove(&bench_peers, mac);
+        peer_t *peer = peer_table_add(&bench_peers, mac, &created);
+        bench_do_not_optimize(&peer);
+    }
+}
+
+static const bench_t micro_benches[] = {
+    { "BM_frame_encode", bm_frame_encode, 16 },
+    { "BM_frame_encode", bm_frame_encode, FRAME_MAX_PAYLOAD_LEN },
+    { "BM_frame_decode", bm_frame_decode, FRAME_MAX_PAYLOAD_LEN },
+    { "BM_frame_data_roundtrip", bm_frame_data_roundtrip, 0 },
+    { "BM_batch_build", bm_batch_build, 0 },
+    { "BM_batch_split", bm_batch_split, 0 },
+    { "BM_replay_window_in_order", bm_replay_window_in_order, 0 },
+    { "BM_replay_window_reordered", bm_replay_window_reordered, 0 },
+    { "BM_reliable_rx", bm_reliable_rx, 0 },
+    { "BM_reliable_acked_window", bm_reliable_acked_window, 0 },
+    { "BM_delta_encode", bm_delta_encode, BENCH_TELEMETRY_LEN },
+    { "BM_delta_decode", bm_delta_decode, BENCH_TELEMETRY_LEN },
+    { "BM_lz_encode", bm_lz_encode, FRAME_MAX_PAYLOAD_LEN },
+    { "BM_lz_decode", bm_lz_decode, FRAME_MAX_PAYLOAD_LEN },
+    { "BM_peer_table_find_hit", bm_peer_table_find_hit, 0 },
+    { "BM_peer_table_find_miss", bm_peer_table_find_miss, 0 },
+    { "BM_peer_table_churn", bm_peer_table_churn, 0 },
+};
+
+int bench_micro_run(const char *filter, double min_time_s)
+{
+    bench_fill(bench_payload, sizeof(bench_payload), 3);
+    return bench_run_all(micro_benches, sizeof(micro_benches) / sizeof(micro_benches[0]), filter, min_time_s);
+}
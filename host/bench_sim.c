@@ -0,0 +1,193 @@
+/**
+ * bench_sim.c
+ *
+ * Throughput simulation: one node sends reliable messages to another over the
+ * simulated channel of sim_transport.c. Both nodes are sim_link.c nodes, so
+ * the sender runs the device's own send window (tx_window.c) with its lanes,
+ * batching, MAC-level retries and end-to-end timeouts, and the receiver runs
+ * the device's receive path (rx_path.c): replay windows, end-to-end ACKs and
+ * RX credit. The numbers move when any of those modules change. Everything
+ * runs on the medium's virtual clock; the wall time shows the cost of the code
+ * itself.
+ *
+ * Each message is counted once on each side: the sender's send report says
+ * delivered or failed, and the receiver counts the messages it got the first
+ * time and any it was handed again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "bench.h"
+#include "frame.h"
+#include "frame_pool.h"
+#include "sim_link.h"
+
+#define SIM_TIME_LIMIT_US (3600ll * 1000000) // Give up on a run that stalls
+#define SIM_MESSAGE_MIN_LEN ((int)sizeof(uint32_t)) // Messages carry their index
+
+_Static_assert(CONFIG_LINK_RELIABLE, "The simulation needs CONFIG_LINK_RELIABLE");
+
+typedef struct {
+    const bench_sim_config_t *config;
+    int queued;                     // Messages handed to the sender's window
+    int delivered;                  // Reported delivered by the sender
+    int failed;                     // Reported given up on by the sender
+    int received;                   // Distinct messages the receiver got
+    int redelivered;                // Messages the receiver got again; the link should filter these
+    int64_t *queued_at_us;          // Per message
+    bool *seen;                     // Per message, at the receiver
+    int32_t *latency_us;            // Per received message, in arrival order
+} sim_run_t;
+
+static const uint8_t sender_mac[LINK_TRANSPORT_MAC_LEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+static const uint8_t receiver_mac[LINK_TRANSPORT_MAC_LEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+
+static sim_medium_t medium;
+static sim_link_t sender;
+static sim_link_t receiver;
+
+static void sender_on_tx(sim_link_t *link, const uint8_t *mac, uint32_t first_id, uint32_t last_id, bool delivered)
+{
+    sim_run_t *run = link->arg;
+    int count = (int)(uint32_t)(last_id - first_id) + 1;  // Wraps with the IDs
+    if (delivered) {
+        run->delivered += count;
+    } else {
+        run->failed += count;
+    }
+}
+
+static void receiver_on_recv(sim_link_t *link, const uint8_t *src_mac, uint8_t type, const uint8_t *payload, int len)
+{
+    sim_run_t *run = link->arg;
+    uint32_t message;
+    if (type != FRAME_TYPE_DATA || len < (int)sizeof(message)) {
+        return;
+    }
+    memcpy(&message, payload, sizeof(message));
+    if (message >= (uint32_t)run->queued) {
+        return;
+    }
+    if (run->seen[message]) {
+        run->redelivered++;
+        return;
+    }
+    run->seen[message] = true;
+    run->latency_us[run->received++] = (int32_t)(sim_medium_now_us(&medium) - run->queued_at_us[message]);
+}
+
+// Queues messages until the window is full, as the sender task does from its ring.
+static void sender_fill(sim_run_t *run)
+{
+    uint8_t payload[FRAME_MAX_PAYLOAD_LEN];
+    while (run->queued < run->config->messages) {
+        uint32_t message = run->queued;
+        memset(payload, (uint8_t)message, run->config->message_len);
+        memcpy(payload, &message, sizeof(message));
+        if (!sim_link_send(&sender, receiver_mac, FRAME_TYPE_DATA, payload, run->config->message_len, 0, NULL)) {
+            break;
+        }
+        run->queued_at_us[message] = sim_medium_now_us(&medium);
+        run->queued++;
+    }
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+    int32_t x = *(const int32_t *)a;
+    int32_t y = *(const int32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static double wall_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec * 1e-6;
+}
+
+void bench_sim_run(const bench_sim_config_t *config)
+{
+    bench_sim_config_t clamped = *config;
+    if (clamped.message_len < SIM_MESSAGE_MIN_LEN) {
+        clamped.message_len = SIM_MESSAGE_MIN_LEN;
+    } else if (clamped.message_len > FRAME_MAX_PAYLOAD_LEN) {
+        clamped.message_len = FRAME_MAX_PAYLOAD_LEN;
+    }
+    if (clamped.messages <= 0) {
+        return;
+    }
+    sim_run_t run = {
+        .config = &clamped,
+        .queued_at_us = calloc(clamped.messages, sizeof(*run.queued_at_us)),
+        .seen = calloc(clamped.messages, sizeof(*run.seen)),
+        .latency_us = calloc(clamped.messages, sizeof(*run.latency_us)),
+    };
+    if (run.queued_at_us == NULL || run.seen == NULL || run.latency_us == NULL) {
+        fprintf(stderr, "Out of memory for %d messages\n", clamped.messages);
+        free(run.queued_at_us);
+        free(run.seen);
+        free(run.latency_us);
+        return;
+    }
+
+    sim_medium_config_t medium_config = {
+        .loss = clamped.loss,
+        .latency_us = clamped.latency_us,
+        .bitrate_kbps = clamped.bitrate_kbps,
+        .seed = clamped.seed,
+    };
+    sim_medium_init(&medium, &medium_config);
+    frame_pool_init();
+    sim_link_init(&sender, &medium, sender_mac);
+    sim_link_init(&receiver, &medium, receiver_mac);
+    sim_link_add_peer(&sender, receiver_mac);
+    sim_link_add_peer(&receiver, sender_mac);
+    sender.tx_cb = sender_on_tx;
+    sender.arg = &run;
+    receiver.recv_cb = receiver_on_recv;
+    receiver.arg = &run;
+
+    double start_ms = wall_ms();
+    int64_t done_us = 0;
+    while (sim_medium_now_us(&medium) < SIM_TIME_LIMIT_US) {
+        sim_link_service(&sender);
+        sim_link_service(&receiver);
+        sender_fill(&run);
+        if (run.delivered + run.failed == clamped.messages) {
+            done_us = sim_medium_now_us(&medium);
+            break;
+        }
+        int64_t next_us = sim_medium_next_us(&medium);
+        int64_t timer_us = sim_link_next_us(&sender);
+        next_us = timer_us < next_us ? timer_us : next_us;
+        timer_us = sim_link_next_us(&receiver);
+        next_us = timer_us < next_us ? timer_us : next_us;
+        if (next_us == INT64_MAX) {
+            break;                  // Nothing left that could make progress
+        }
+        sim_medium_step(&medium, next_us);
+    }
+    double elapsed_ms = wall_ms() - start_ms;
+
+    int received = run.received;
+    qsort(run.latency_us, received, sizeof(*run.latency_us), compare_latency);
+    double duration_s = (done_us > 0 ? done_us : sim_medium_now_us(&medium)) / 1e6;
+    printf("SIM,loss_pct=%.1f,latency_us=%u,len=%d,msgs=%d,delivered=%d,failed=%d,received=%d,redelivered=%d,"
+           "data_tx=%u,acks=%u,fps=%.0f,bytes_per_s=%.0f,p50_us=%ld,p99_us=%ld,air_pct=%.1f,wall_ms=%.1f%s\n",
+           clamped.loss * 100.0f, clamped.latency_us, clamped.message_len, clamped.messages, run.delivered,
+           run.failed, received, run.redelivered, sender.frames_sent,
+           (unsigned)receiver.counters.rx_acks_sent,
+           duration_s > 0 ? received / duration_s : 0.0,
+           duration_s > 0 ? (double)received * clamped.message_len / duration_s : 0.0,
+           received > 0 ? (long)run.latency_us[received / 2] : 0L,
+           received > 0 ? (long)run.latency_us[(int)((int64_t)received * 99 / 100)] : 0L,
+           duration_s > 0 ? (double)medium.stats.air_us / 1e4 / duration_s : 0.0,
+           elapsed_ms, done_us > 0 ? "" : ",stalled");
+
+    free(run.queued_at_us);
+    free(run.seen);
+    free(run.latency_us);
+}
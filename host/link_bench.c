@@ -0,0 +1,107 @@
+/**
+ * link_bench.c
+ *
+ * Host benchmark of the link's protocol code. Runs the microbenchmarks, then
+ * the throughput simulation once per loss rate:
+ *
+ *     link_bench [micro|sim|all] [--filter TEXT] [--min-time S] [--loss PCT,PCT,...]
+ *                [--latency-us N] [--bitrate-kbps N] [--messages N] [--len N] [--seed N]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+#include "frame.h"
+
+#define DEFAULT_MIN_TIME_S 0.2
+#define DEFAULT_LOSSES "0,1,5,10,20,30"
+#define DEFAULT_MESSAGES 5000
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [micro|sim|all] [--filter TEXT] [--min-time S] [--loss PCT,PCT,...]\n"
+            "          [--latency-us N] [--bitrate-kbps N] [--messages N] [--len N] [--seed N]\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    bool micro = true;
+    bool sim = true;
+    const char *filter = NULL;
+    double min_time_s = DEFAULT_MIN_TIME_S;
+    const char *losses = DEFAULT_LOSSES;
+    bench_sim_config_t config = {
+        .latency_us = 200,
+        .bitrate_kbps = 1000,
+        .messages = DEFAULT_MESSAGES,
+        .message_len = FRAME_MAX_PAYLOAD_LEN,
+        .seed = 1,
+    };
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (strcmp(arg, "micro") == 0) {
+            sim = false;
+        } else if (strcmp(arg, "sim") == 0) {
+            micro = false;
+        } else if (strcmp(arg, "all") == 0) {
+            micro = sim = true;
+        } else if (value == NULL) {
+            usage(argv[0]);
+            return 2;
+        } else if (strcmp(arg, "--filter") == 0) {
+            filter = value;
+            i++;
+        } else if (strcmp(arg, "--min-time") == 0) {
+            min_time_s = atof(value);
+            i++;
+        } else if (strcmp(arg, "--loss") == 0) {
+            losses = value;
+            i++;
+        } else if (strcmp(arg, "--latency-us") == 0) {
+            config.latency_us = (uint32_t)strtoul(value, NULL, 10);
+            i++;
+        } else if (strcmp(arg, "--bitrate-kbps") == 0) {
+            config.bitrate_kbps = (uint32_t)strtoul(value, NULL, 10);
+            i++;
+        } else if (strcmp(arg, "--messages") == 0) {
+            config.messages = atoi(value);
+            i++;
+        } else if (strcmp(arg, "--len") == 0) {
+            config.message_len = atoi(value);
+            i++;
+        } else if (strcmp(arg, "--seed") == 0) {
+            config.seed = (uint32_t)strtoul(value, NULL, 10);
+            i++;
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (micro && bench_micro_run(filter, min_time_s) == 0) {
+        fprintf(stderr, "No benchmark matches \"%s\"\n", filter);
+        return 1;
+    }
+    if (sim) {
+        if (micro) {
+            printf("\n");
+        }
+        for (const char *p = losses; *p != '\0';) {
+            char *end;
+            double pct = strtod(p, &end);
+            if (end == p) {
+                usage(argv[0]);
+                return 2;
+            }
+            config.loss = (float)(pct / 100.0);
+            bench_sim_run(&config);
+            p = *end == ',' ? end + 1 : end;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,375 @@
+/**
+ * link_test.c
+ *
+ * Behaviour of the link's send window, end-to-end acknowledgements, bulk
+ * reassembly and RX credit, on two sim_link.c nodes. Each test prints what it
+ * checked; the exit status is nonzero if any check failed:
+ *
+ *     ctest --test-dir build-host --output-on-failure
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bulk_frag.h"
+#include "frame.h"
+#include "frame_pool.h"
+#include "sim_link.h"
+
+#define TEST_TIME_LIMIT_US (600ll * 1000000)
+#define TEST_MESSAGES 1000
+#define TEST_BULK_LEN 5000
+
+#define CHECK(cond) do {                                                \
+        if (!(cond)) {                                                  \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++;                                                 \
+        }                                                               \
+    } while (0)
+
+typedef enum {
+    OUTCOME_NONE,
+    OUTCOME_DELIVERED,
+    OUTCOME_FAILED,
+} outcome_t;
+
+typedef struct {
+    int messages;
+    int message_len;
+    int queued;
+    uint32_t first_id;              // ID of message 0; the sender numbers the rest after it
+    outcome_t outcome[TEST_MESSAGES];
+    int reported;                   // Messages with an outcome
+    int reported_twice;             // Outcomes for a message that already had one
+    int stray_ids;                  // Reported IDs that name no message of the run
+    int received[TEST_MESSAGES];    // Times the receiving application got each message
+} messages_run_t;
+
+typedef struct {
+    const uint8_t *data;
+    frag_header_t base;
+    uint64_t all;
+    uint64_t acked;                 // Bits past the last fragment count as acknowledged
+    int next;                       // Next fragment of the current round, -1 once it is sent
+    int64_t ack_deadline_us;
+    int rounds;
+    int completed;                  // Transfers the receiver reassembled
+    bool intact;                    // Every one matched data
+} bulk_run_t;
+
+static const uint8_t sender_mac[LINK_TRANSPORT_MAC_LEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+static const uint8_t receiver_mac[LINK_TRANSPORT_MAC_LEN] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x02};
+
+static int failures;
+static sim_medium_t medium;
+static sim_link_t sender;
+static sim_link_t receiver;
+
+static void setup(float loss, uint32_t seed)
+{
+    sim_medium_config_t config = SIM_MEDIUM_CONFIG_DEFAULT();
+    config.loss = loss;
+    config.seed = seed;
+    sim_medium_init(&medium, &config);
+    frame_pool_init();
+    sim_link_init(&sender, &medium, sender_mac);
+    sim_link_init(&receiver, &medium, receiver_mac);
+    sim_link_add_peer(&sender, receiver_mac);
+    sim_link_add_peer(&receiver, sender_mac);
+}
+
+static int64_t now_us(void)
+{
+    return sim_medium_now_us(&medium);
+}
+
+// Runs both nodes until done() or until_us, calling tick() after each round of service.
+static void run_until(int64_t until_us, bool (*done)(void *arg), void (*tick)(void *arg), void *arg,
+                      int64_t (*next)(void *arg))
+{
+    while (now_us() < until_us) {
+        sim_link_service(&sender);
+        sim_link_service(&receiver);
+        if (tick != NULL) {
+            tick(arg);
+        }
+        if (done != NULL && done(arg)) {
+            return;
+        }
+        int64_t next_us = sim_medium_next_us(&medium);
+        int64_t other_us[] = {
+            sim_link_next_us(&sender),
+            sim_link_next_us(&receiver),
+            next != NULL ? next(arg) : INT64_MAX,
+        };
+        for (int i = 0; i < (int)(sizeof(other_us) / sizeof(other_us[0])); i++) {
+            next_us = other_us[i] < next_us ? other_us[i] : next_us;
+        }
+        sim_medium_step(&medium, next_us < until_us ? next_us : until_us);
+    }
+}
+
+static void messages_on_tx(sim_link_t *link, const uint8_t *mac, uint32_t first_id, uint32_t last_id, bool delivered)
+{
+    messages_run_t *run = link->arg;
+    uint32_t count = (uint32_t)(last_id - first_id) + 1;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t message = first_id + i - run->first_id;
+        if (message >= (uint32_t)run->queued) {
+            run->stray_ids++;
+            continue;
+        }
+        if (run->outcome[message] != OUTCOME_NONE) {
+            run->reported_twice++;
+            continue;
+        }
+        run->outcome[message] = delivered ? OUTCOME_DELIVERED : OUTCOME_FAILED;
+        run->reported++;
+    }
+}
+
+static void messages_on_recv(sim_link_t *link, const uint8_t *src_mac, uint8_t type, const uint8_t *payload, int len)
+{
+    messages_run_t *run = link->arg;
+    uint32_t message;
+    if (type == FRAME_TYPE_DATA && len == run->message_len) {
+        memcpy(&message, payload, sizeof(message));
+        if (message < (uint32_t)run->queued) {
+            run->received[message]++;
+        }
+    }
+}
+
+static void messages_fill(void *arg)
+{
+    messages_run_t *run = arg;
+    uint8_t payload[FRAME_MAX_PAYLOAD_LEN];
+    while (run->queued < run->messages) {
+        uint32_t message = run->queued;
+        memset(payload, (uint8_t)message, run->message_len);
+        memcpy(payload, &message, sizeof(message));
+        uint32_t id;
+        if (!sim_link_send(&sender, receiver_mac, FRAME_TYPE_DATA, payload, run->message_len, 0, &id)) {
+            break;
+        }
+        if (message == 0) {
+            run->first_id = id;
+        }
+        if (id != run->first_id + message) {
+            run->stray_ids++;       // IDs must be dense per peer
+        }
+        run->queued++;
+    }
+}
+
+static bool messages_done(void *arg)
+{
+    messages_run_t *run = arg;
+    return run->reported == run->messages;
+}
+
+// Sends messages over a lossy medium: each gets exactly one outcome, the
+// receiver gets each at most once, and every one reported delivered arrived.
+// The sender's IDs for the peer start after last_id.
+static void test_messages(float loss, uint32_t seed, int message_len, uint32_t last_id)
+{
+    static messages_run_t run;
+    memset(&run, 0, sizeof(run));
+    run.messages = TEST_MESSAGES;
+    run.message_len = message_len;
+    setup(loss, seed);
+    peer_table_find(&sender.peers, receiver_mac)->tx_msg_id = last_id;
+    sender.tx_cb = messages_on_tx;
+    sender.arg = &run;
+    receiver.recv_cb = messages_on_recv;
+    receiver.arg = &run;
+
+    run_until(TEST_TIME_LIMIT_US, messages_done, messages_fill, &run, NULL);
+
+    int delivered = 0;
+    int failed = 0;
+    int received = 0;
+    int received_twice = 0;
+    int delivered_unseen = 0;
+    for (int i = 0; i < run.messages; i++) {
+        delivered += run.outcome[i] == OUTCOME_DELIVERED;
+        failed += run.outcome[i] == OUTCOME_FAILED;
+        received += run.received[i] > 0;
+        received_twice += run.received[i] > 1;
+        delivered_unseen += run.outcome[i] == OUTCOME_DELIVERED && run.received[i] == 0;
+    }
+    printf("messages loss=%.0f%% len=%d seed=%u first_id=%u: delivered=%d failed=%d received=%d frames=%u\n",
+           loss * 100.0f, message_len, seed, run.first_id, delivered, failed, received, sender.frames_sent);
+
+    CHECK(run.queued == run.messages);
+    CHECK(delivered + failed == run.messages);
+    CHECK(run.reported_twice == 0);
+    CHECK(run.stray_ids == 0);
+    CHECK(received_twice == 0);
+    CHECK(delivered_unseen == 0);
+    CHECK(sim_link_idle(&sender));
+    if (loss == 0.0f) {
+        CHECK(delivered == run.messages);
+        CHECK(received == run.messages);
+        if (message_len > BATCH_MAX_RECORD_LEN) {
+            CHECK(sender.frames_sent == (uint32_t)run.messages);  // One frame each, none resent
+        } else {
+            CHECK(sender.frames_sent < (uint32_t)run.messages);   // Batched
+        }
+    } else {
+        CHECK(delivered > run.messages * 9 / 10);
+    }
+}
+
+static void bulk_on_recv(sim_link_t *link, const uint8_t *src_mac, uint8_t type, const uint8_t *payload, int len)
+{
+    bulk_run_t *run = link->arg;
+    frag_ack_t ack;
+    if (type != FRAME_TYPE_FRAG_ACK || len < (int)sizeof(ack)) {
+        return;
+    }
+    memcpy(&ack, payload, sizeof(ack));
+    if (ack.transfer_id == run->base.transfer_id && run->next < 0) {
+        run->acked |= ack.received & run->all;
+        run->ack_deadline_us = now_us();  // Start the next round now
+    }
+}
+
+static void bulk_on_complete(sim_link_t *link, const uint8_t *src_mac, const uint8_t *data, int len)
+{
+    bulk_run_t *run = link->arg;
+    run->completed++;
+    run->intact = run->intact && len == run->base.total_len && memcmp(data, run->data, len) == 0;
+}
+
+// As bulk_send()'s rounds: every missing fragment, the last one asking for an ACK.
+static void bulk_tick(void *arg)
+{
+    bulk_run_t *run = arg;
+    if (run->acked == UINT64_MAX) {
+        return;
+    }
+    if (run->next < 0) {
+        if (now_us() < run->ack_deadline_us) {
+            return;
+        }
+        run->next = 0;
+        run->rounds++;
+    }
+    int last = bulk_frag_last_missing(run->acked);
+    for (; run->next <= last; run->next++) {
+        int i = run->next;
+        if (run->acked & ((uint64_t)1 << i)) {
+            continue;
+        }
+        frag_header_t hdr = run->base;
+        hdr.index = i;
+        hdr.flags = i == last ? FRAG_FLAG_ACK_REQ : 0;
+        if (!sim_link_send_ref(&sender, receiver_mac, FRAME_TYPE_FRAG, &hdr, sizeof(hdr),
+                               run->data + i * FRAG_CHUNK_LEN, bulk_frag_len(i, run->base.count, run->base.total_len))) {
+            return;                 // Window full: carry on after the next service
+        }
+    }
+    run->next = -1;
+    run->ack_deadline_us = now_us() + BULK_ACK_TIMEOUT_MS * 1000LL;
+}
+
+static bool bulk_done(void *arg)
+{
+    bulk_run_t *run = arg;
+    return run->acked == UINT64_MAX && sim_link_idle(&sender);
+}
+
+static int64_t bulk_next_us(void *arg)
+{
+    bulk_run_t *run = arg;
+    return run->acked != UINT64_MAX && run->next < 0 ? run->ack_deadline_us : INT64_MAX;
+}
+
+// A bulk transfer over a lossy medium arrives once and intact.
+static void test_bulk(float loss, uint32_t seed)
+{
+    static uint8_t data[TEST_BULK_LEN];
+    for (int i = 0; i < TEST_BULK_LEN; i++) {
+        data[i] = (uint8_t)(i * 7 + i / 251);
+    }
+    bulk_run_t run = {
+        .data = data,
+        .base = { .transfer_id = 1, .count = bulk_frag_count(TEST_BULK_LEN), .total_len = TEST_BULK_LEN },
+        .next = -1,
+        .intact = true,
+    };
+    run.all = bulk_frag_mask(run.base.count);
+    run.acked = ~run.all;
+    setup(loss, seed);
+    sender.recv_cb = bulk_on_recv;
+    sender.arg = &run;
+    receiver.bulk_cb = bulk_on_complete;
+    receiver.arg = &run;
+
+    run_until(TEST_TIME_LIMIT_US, bulk_done, bulk_tick, &run, bulk_next_us);
+
+    printf("bulk loss=%.0f%% len=%d seed=%u: fragments=%d rounds=%d completed=%d\n", loss * 100.0f, TEST_BULK_LEN,
+           seed, run.base.count, run.rounds, run.completed);
+
+    CHECK(run.acked == UINT64_MAX);
+    CHECK(run.completed == 1);
+    CHECK(run.intact);
+}
+
+static void count_received(sim_link_t *link, const uint8_t *src_mac, uint8_t type, const uint8_t *payload, int len)
+{
+    int *received = link->arg;
+    if (type == FRAME_TYPE_DATA) {
+        (*received)++;
+    }
+}
+
+static void grant(uint8_t credits)
+{
+    frame_credit_t credit = { .credits = credits };
+    sim_link_send(&receiver, sender_mac, FRAME_TYPE_KEEPALIVE, &credit, sizeof(credit), TX_MSG_FLAG_FLUSH, NULL);
+}
+
+// With no credit from the peer, bulk frames wait for a grant instead of going out.
+static void test_credit(void)
+{
+    int received = 0;
+    setup(0.0f, 1);
+    receiver.recv_cb = count_received;
+    receiver.arg = &received;
+
+    grant(0);
+    run_until(now_us() + 10000, NULL, NULL, NULL, NULL);
+    uint8_t payload[16] = {0};
+    CHECK(sim_link_send(&sender, receiver_mac, FRAME_TYPE_DATA, payload, sizeof(payload), TX_MSG_FLAG_FLUSH, NULL));
+    int64_t held_until_us = now_us() + TX_CREDIT_PROBE_US / 2;
+    run_until(held_until_us, NULL, NULL, NULL, NULL);
+    CHECK(received == 0);
+    CHECK(sender.counters.tx_credit_waits == 1);
+
+    grant(FRAME_CREDIT_UNLIMITED);
+    run_until(now_us() + 10000, NULL, NULL, NULL, NULL);
+    printf("credit: held %lld us, received=%d after the grant\n", (long long)(TX_CREDIT_PROBE_US / 2), received);
+    CHECK(received == 1);
+}
+
+int main(void)
+{
+    test_messages(0.0f, 1, 24, 0);
+    test_messages(0.0f, 1, FRAME_MAX_PAYLOAD_LEN, 0);
+    for (uint32_t seed = 1; seed <= 3; seed++) {
+        test_messages(0.2f, seed, 24, 0);
+        test_messages(0.2f, seed, FRAME_MAX_PAYLOAD_LEN, 0);
+    }
+    test_messages(0.1f, 4, 24, UINT32_MAX - TEST_MESSAGES / 2); // IDs wrap halfway through
+    test_bulk(0.0f, 1);
+    test_bulk(0.2f, 2);
+    test_credit();
+
+    if (failures > 0) {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,18 @@
+/**
+ * esp_log.h
+ *
+ * ESP-IDF's logging macros for host builds. They compile to nothing, so the
+ * simulations stay quiet, but the compiler still checks their format strings.
+ */
+
+#pragma once
+
+#include <stdio.h>
+
+#define ESP_LOG_HOST_(tag, fmt, ...) do { if (0) { printf("%s: " fmt "\n", tag, ##__VA_ARGS__); } } while (0)
+
+#define ESP_LOGE(tag, fmt, ...) ESP_LOG_HOST_(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) ESP_LOG_HOST_(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) ESP_LOG_HOST_(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) ESP_LOG_HOST_(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...) ESP_LOG_HOST_(tag, fmt, ##__VA_ARGS__)
@@ -0,0 +1,10 @@
+/**
+ * esp_mac.h
+ *
+ * The MAC address formatting macros of ESP-IDF's esp_mac.h, for host builds.
+ */
+
+#pragma once
+
+#define MACSTR "%02x:%02x:%02x:%02x:%02x:%02x"
+#define MAC2STR(a) (a)[0], (a)[1], (a)[2], (a)[3], (a)[4], (a)[5]
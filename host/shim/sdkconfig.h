@@ -0,0 +1,43 @@
+/**
+ * sdkconfig.h
+ *
+ * Stand-in for the generated ESP-IDF configuration in host builds. Only the
+ * options the host-built modules read are here; each can be overridden with
+ * -D on the CMake command line.
+ */
+
+#pragma once
+
+#ifndef CONFIG_LINK_ENCRYPT
+#define CONFIG_LINK_ENCRYPT 0
+#endif
+#ifndef CONFIG_LINK_RELIABLE
+#define CONFIG_LINK_RELIABLE 1      // The throughput simulation numbers its frames end to end
+#endif
+#ifndef CONFIG_FRAME_COMPRESS
+#define CONFIG_FRAME_COMPRESS 0     // The codecs are benchmarked on their own
+#endif
+#ifndef CONFIG_FRAME_COMPRESS_DELTA_MAX_LEN
+#define CONFIG_FRAME_COMPRESS_DELTA_MAX_LEN 64
+#endif
+#ifndef CONFIG_RX_REORDER
+#define CONFIG_RX_REORDER 0
+#endif
+#ifndef CONFIG_RX_REORDER_DEPTH
+#define CONFIG_RX_REORDER_DEPTH 4
+#endif
+#ifndef CONFIG_RX_REORDER_TIMEOUT_MS
+#define CONFIG_RX_REORDER_TIMEOUT_MS 20
+#endif
+#ifndef CONFIG_MESH
+#define CONFIG_MESH 0
+#endif
+#ifndef CONFIG_FRAME_POOL_SIZE
+#define CONFIG_FRAME_POOL_SIZE 32   // Shared by every simulated node's send window
+#endif
+#ifndef CONFIG_BULK_MAX_LEN
+#define CONFIG_BULK_MAX_LEN 8192
+#endif
+#ifndef CONFIG_BULK_RX_SLOTS
+#define CONFIG_BULK_RX_SLOTS 2
+#endif
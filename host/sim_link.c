@@ -0,0 +1,327 @@
+/**
+ * sim_link.c
+ *
+ * Simulated node of the link (see sim_link.h).
+ */
+
+#include <string.h>
+#include "sim_link.h"
+#include "frame.h"
+#include "frame_pool.h"
+#include "reliable.h"
+
+static sim_link_t *sim_link_current(void)
+{
+    return sim_node_current()->owner;
+}
+
+static int64_t sim_link_now(const sim_link_t *link)
+{
+    return sim_medium_now_us(link->medium);
+}
+
+static void sim_env_lock(void *ctx)
+{
+}
+
+static void sim_env_unlock(void *ctx)
+{
+}
+
+static uint32_t sim_env_random(void *ctx)
+{
+    sim_link_t *link = ctx;
+    return sim_medium_random(link->medium);
+}
+
+// The device removes the peer here; the simulation keeps it and counts.
+static bool sim_env_peer_failed(void *ctx, const uint8_t *mac)
+{
+    sim_link_t *link = ctx;
+    link->peer_failures++;
+    return false;
+}
+
+static void sim_env_finished(void *ctx, const uint8_t *mac, uint32_t first_id, uint32_t last_id, bool delivered)
+{
+    sim_link_t *link = ctx;
+    if (link->tx_cb != NULL) {
+        link->tx_cb(link, mac, first_id, last_id, delivered);
+    }
+}
+
+static esp_err_t sim_link_transport_send(void *ctx, const uint8_t *mac, const uint8_t *data, int len)
+{
+    sim_link_t *link = ctx;
+    link->frames_sent++;
+    return link->node_transport.send(link->node_transport.ctx, mac, data, len);
+}
+
+static void sim_link_on_sent(const uint8_t *mac, bool delivered)
+{
+    sim_link_t *link = sim_link_current();
+    tx_window_sent(&link->window, mac, delivered, sim_link_now(link));
+}
+
+static void sim_link_fragment(sim_link_t *link, const uint8_t *src_mac, const uint8_t *payload, int len)
+{
+    const bulk_rx_slot_t *slot = NULL;
+    bulk_frag_result_t result = bulk_rx_fragment(&link->bulk_rx, src_mac, payload, len, sim_link_now(link), &slot);
+    if (result != BULK_FRAG_ACK && result != BULK_FRAG_COMPLETE) {
+        return;
+    }
+    frag_ack_t ack;
+    bulk_rx_ack(slot, &ack);
+    sim_link_send(link, src_mac, FRAME_TYPE_FRAG_ACK, &ack, sizeof(ack), TX_MSG_FLAG_FLUSH, NULL);
+    if (result == BULK_FRAG_COMPLETE && link->bulk_cb != NULL) {
+        link->bulk_cb(link, src_mac, slot->buf, slot->total_len);
+    }
+}
+
+// As rx_env_ack_owed() in esp_now_link.c: the ACK goes out within
+// RELIABLE_ACK_DELAY_US unless a batch takes it along.
+static void sim_rx_ack_owed(void *ctx)
+{
+    sim_link_t *link = ctx;
+    if (link->ack_at_us < 0) {
+        link->ack_at_us = sim_link_now(link) + RELIABLE_ACK_DELAY_US;
+    }
+}
+
+static void sim_rx_ack_received(void *ctx, const uint8_t *mac, const frame_ack_t *ack)
+{
+    sim_link_t *link = ctx;
+    tx_window_ack(&link->window, mac, ack);
+}
+
+static void sim_rx_credit_received(void *ctx, const uint8_t *mac, uint8_t credits)
+{
+    sim_link_t *link = ctx;
+    if (tx_window_credit_grant(&link->window, mac, credits, sim_link_now(link))) {
+        tx_window_credit_resume(&link->window, sim_link_now(link));
+    }
+}
+
+static bool sim_rx_deliver(void *ctx, frame_buf_t *buf)
+{
+    sim_link_t *link = ctx;
+    rx_path_dispatch(&link->rx, buf);
+    return false;
+}
+
+static void sim_rx_message(void *ctx, const frame_buf_t *buf, uint8_t type, const uint8_t *payload, int len)
+{
+    sim_link_t *link = ctx;
+    if (type == FRAME_TYPE_FRAG) {
+        sim_link_fragment(link, buf->mac, payload, len);
+    } else if (link->recv_cb != NULL) {
+        link->recv_cb(link, buf->mac, type, payload, len);
+    }
+}
+
+// As on_data_recv() and rx_task in esp_now_link.c, with the RX queue always
+// drained right away: the frame goes through the device's rx_path.c.
+static void sim_link_on_recv(const link_transport_rx_info_t *info, const uint8_t *data, int len)
+{
+    sim_link_t *link = sim_link_current();
+    frame_buf_t *buf = NULL;
+    if (len <= 0 || len > FRAME_MAX_LEN || (buf = frame_pool_alloc()) == NULL) {
+        LINK_STATS_INC(&link->counters, rx_dropped);
+    } else {
+        LINK_STATS_INC(&link->counters, rx_frames);
+        LINK_STATS_ADD(&link->counters, rx_bytes, len);
+        memcpy(buf->mac, info->src_mac, LINK_TRANSPORT_MAC_LEN);
+        memcpy(buf->dest_mac, info->dest_mac, LINK_TRANSPORT_MAC_LEN);
+        buf->rssi = info->rssi;
+        buf->rx_at_us = sim_link_now(link);
+        memcpy(buf->data, data, len);
+        buf->len = len;
+    }
+    if (rx_path_credit_check(&link->rx, info->src_mac, frame_pool_available())) {
+        link->credit_updates_due = true;
+    }
+    if (buf != NULL && !rx_path_receive(&link->rx, buf, sim_link_now(link))) {
+        frame_pool_free(buf);
+    }
+    if (rx_path_credit_recovered(&link->rx, frame_pool_available())) {
+        link->credit_updates_due = true;
+    }
+}
+
+bool sim_link_init(sim_link_t *link, sim_medium_t *medium, const uint8_t *mac)
+{
+    memset(link, 0, sizeof(*link));
+    if (!sim_node_init(&link->node, medium, mac, &link->node_transport)) {
+        return false;
+    }
+    link->medium = medium;
+    link->node.owner = link;
+    link->transport = link->node_transport;
+    link->transport.send = sim_link_transport_send;
+    link->transport.ctx = link;
+    link->flush_at_us = -1;
+    link->ack_at_us = -1;
+    peer_table_init(&link->peers);
+    bulk_rx_init(&link->bulk_rx);
+    link->env = (tx_window_env_t){
+        .transport = &link->transport,
+        .peers = &link->peers,
+        .counters = &link->counters,
+        .own_mac = link->node.mac,
+        .lock = sim_env_lock,
+        .unlock = sim_env_unlock,
+        .random = sim_env_random,
+        .peer_failed = sim_env_peer_failed,
+        .finished = sim_env_finished,
+        .ctx = link,
+    };
+    tx_window_init(&link->window, &link->env);
+    link->rx_env = (rx_path_env_t){
+        .peers = &link->peers,
+        .counters = &link->counters,
+        .own_mac = link->node.mac,
+        .lock = sim_env_lock,
+        .unlock = sim_env_unlock,
+        .random = sim_env_random,
+        .ack_owed = sim_rx_ack_owed,
+        .ack_received = sim_rx_ack_received,
+        .credit_received = sim_rx_credit_received,
+        .deliver = sim_rx_deliver,
+        .message = sim_rx_message,
+        .ctx = link,
+    };
+    rx_path_init(&link->rx, &link->rx_env);
+    return link->node_transport.init(link->node_transport.ctx, sim_link_on_sent, sim_link_on_recv) == ESP_OK;
+}
+
+bool sim_link_add_peer(sim_link_t *link, const uint8_t *mac)
+{
+    if (link->node_transport.add_peer(link->node_transport.ctx, mac) != ESP_OK) {
+        return false;
+    }
+    bool created;
+    peer_t *peer = peer_table_add(&link->peers, mac, &created);
+    if (peer != NULL && created) {
+        rx_path_peer_added(&link->rx, peer);
+    }
+    return peer != NULL;
+}
+
+static bool sim_link_append(sim_link_t *link, const tx_msg_t *msg)
+{
+    int64_t now_us = sim_link_now(link);
+    if (!tx_window_append(&link->window, msg, tx_lane_for(msg->type), now_us)) {
+        return false;
+    }
+    link->flush_at_us = tx_window_flush(&link->window, now_us);
+    return true;
+}
+
+// The device numbers messages as they enter its TX ring, which the window
+// never refuses. Without a ring, the ID of a message the window refused is
+// handed back so the peer's IDs stay dense.
+static void sim_link_return_msg_id(sim_link_t *link, const uint8_t *mac)
+{
+    peer_t *peer = peer_table_find(&link->peers, mac);
+    if (peer != NULL) {
+        peer->tx_msg_id--;
+    } else {
+        link->window.broadcast_msg_id--;
+    }
+}
+
+bool sim_link_send(sim_link_t *link, const uint8_t *mac, uint8_t type, const void *payload, int len, uint8_t flags,
+                   uint32_t *msg_id)
+{
+    if (len < 0 || len > FRAME_MAX_PAYLOAD_LEN) {
+        return false;
+    }
+    tx_msg_t msg = { .type = type, .flags = flags, .len = len };
+    memcpy(msg.mac, mac, LINK_TRANSPORT_MAC_LEN);
+    memcpy(msg.data, payload, len);
+    if (type == FRAME_TYPE_DATA) {
+        msg.id = tx_window_next_msg_id(&link->window, mac);
+    }
+    if (!sim_link_append(link, &msg)) {
+        if (type == FRAME_TYPE_DATA) {
+            sim_link_return_msg_id(link, mac);
+        }
+        return false;
+    }
+    if (msg_id != NULL) {
+        *msg_id = msg.id;
+    }
+    return true;
+}
+
+bool sim_link_send_ref(sim_link_t *link, const uint8_t *mac, uint8_t type, const void *header, int header_len,
+                       const void *data, int data_len)
+{
+    if (header_len < 0 || data_len < 0 || header_len + data_len > FRAME_MAX_PAYLOAD_LEN) {
+        return false;
+    }
+    tx_msg_t msg = { .type = type, .len = header_len, .ref = data, .ref_len = data_len };
+    memcpy(msg.mac, mac, LINK_TRANSPORT_MAC_LEN);
+    memcpy(msg.data, header, header_len);
+    return sim_link_append(link, &msg);
+}
+
+// As tx_send_credit_updates() in esp_now_link.c.
+static void sim_link_send_credit_updates(sim_link_t *link)
+{
+    uint8_t macs[PEER_TABLE_SIZE][PEER_MAC_LEN];
+    frame_credit_t credit;
+    link->credit_updates_due = false;
+    int count = rx_path_credit_updates(&link->rx, frame_pool_available(), macs, &credit);
+    for (int i = 0; i < count; i++) {
+        if (!sim_link_send(link, macs[i], FRAME_TYPE_KEEPALIVE, &credit, sizeof(credit), TX_MSG_FLAG_FLUSH, NULL)) {
+            rx_path_credit_retry(&link->rx, macs[i]);
+            link->credit_updates_due = true;
+        }
+    }
+}
+
+// In the order of sender_task's loop, after rx_task's reorder deadlines.
+void sim_link_service(sim_link_t *link)
+{
+    int64_t now_us = sim_link_now(link);
+    rx_path_expire(&link->rx, now_us);
+    if (link->credit_updates_due) {
+        sim_link_send_credit_updates(link);
+    }
+    if (link->ack_at_us >= 0 && now_us >= link->ack_at_us) {
+        link->ack_at_us = -1;
+        if (!tx_window_send_acks(&link->window, now_us)) {
+            link->ack_at_us = now_us + RELIABLE_ACK_DELAY_US;
+        }
+    }
+    link->flush_at_us = tx_window_flush(&link->window, now_us);
+    tx_window_service(&link->window, now_us);
+}
+
+int64_t sim_link_next_us(const sim_link_t *link)
+{
+    int64_t next_us = INT64_MAX;
+    int64_t due_us[] = {
+        link->flush_at_us,
+        link->ack_at_us,
+        tx_window_next_us(&link->window, sim_link_now(link)),
+        rx_path_next_us(&link->rx),
+    };
+    for (int i = 0; i < (int)(sizeof(due_us) / sizeof(due_us[0])); i++) {
+        if (due_us[i] >= 0 && due_us[i] < next_us) {
+            next_us = due_us[i];
+        }
+    }
+    return next_us;
+}
+
+bool sim_link_idle(const sim_link_t *link)
+{
+    for (int i = 0; i < TX_WINDOW_SIZE; i++) {
+        if (link->window.slots[i].state != TX_SLOT_FREE) {
+            return false;
+        }
+    }
+    return true;
+}
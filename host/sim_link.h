@@ -0,0 +1,85 @@
+/**
+ * sim_link.h
+ *
+ * One simulated node of the link: the device's send window (tx_window.c),
+ * receive path (rx_path.c), peer table and bulk reassembly (bulk_frag.c) on a
+ * sim_transport.c node. What the window and the receive path schedule runs on
+ * the medium's virtual clock, from sim_link_service(). Discovery is not
+ * simulated: only peers added with sim_link_add_peer() get through. The host
+ * build turns encryption, compression, reordering and the mesh off.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "bulk_frag.h"
+#include "link_stats.h"
+#include "peer_table.h"
+#include "rx_path.h"
+#include "sim_transport.h"
+#include "tx_window.h"
+
+typedef struct sim_link sim_link_t;
+
+/** A message for the application: DATA, FRAG_ACK and anything else the link does not handle itself. */
+typedef void (*sim_link_recv_cb_t)(sim_link_t *link, const uint8_t *src_mac, uint8_t type, const uint8_t *payload,
+                                   int len);
+
+/** Outcome of DATA messages first_id to last_id, as esp_now_link_tx_cb_t: the range may wrap. */
+typedef void (*sim_link_tx_cb_t)(sim_link_t *link, const uint8_t *mac, uint32_t first_id, uint32_t last_id,
+                                 bool delivered);
+
+/** A bulk transfer that completed on this node. */
+typedef void (*sim_link_bulk_cb_t)(sim_link_t *link, const uint8_t *src_mac, const uint8_t *data, int len);
+
+struct sim_link {
+    sim_medium_t *medium;
+    sim_node_t node;
+    link_transport_t node_transport; // The node's ops, from sim_node_init()
+    link_transport_t transport;     // The same, counting frames_sent
+    peer_table_t peers;
+    link_counters_t counters;
+    tx_window_env_t env;
+    tx_window_t window;
+    rx_path_env_t rx_env;
+    rx_path_t rx;
+    bulk_rx_t bulk_rx;
+    int64_t flush_at_us;            // Next batch deadline, -1 if none
+    int64_t ack_at_us;              // When owed ACKs go out, -1 if none are owed
+    bool credit_updates_due;        // Some peer is due a credit update from us
+    uint32_t frames_sent;           // Frames handed to the node, retries and resends included
+    uint32_t peer_failures;         // Control frames given up on; the device would drop the peer
+    sim_link_recv_cb_t recv_cb;
+    sim_link_tx_cb_t tx_cb;
+    sim_link_bulk_cb_t bulk_cb;
+    void *arg;                      // Free for the callbacks
+};
+
+/** Puts link on medium with the given MAC. frame_pool_init() must have run. */
+bool sim_link_init(sim_link_t *link, sim_medium_t *medium, const uint8_t *mac);
+
+/** Registers a peer with the transport and the peer table. */
+bool sim_link_add_peer(sim_link_t *link, const uint8_t *mac);
+
+/**
+ * Adds a message to the send window, as the sender task does with one from its
+ * ring. A DATA message gets the peer's next ID, stored in msg_id if not NULL
+ * and reported to tx_cb. Returns false while the window has no room: try again
+ * after sim_link_service().
+ */
+bool sim_link_send(sim_link_t *link, const uint8_t *mac, uint8_t type, const void *payload, int len, uint8_t flags,
+                   uint32_t *msg_id);
+
+/** Like sim_link_send(), for a frame of header followed by data, as send_message_ref(). */
+bool sim_link_send_ref(sim_link_t *link, const uint8_t *mac, uint8_t type, const void *header, int header_len,
+                       const void *data, int data_len);
+
+/** Runs what is due at the medium's current time: held frames, credit updates, batch deadlines, owed ACKs and the window. */
+void sim_link_service(sim_link_t *link);
+
+/** Time of the next deadline of the link, or INT64_MAX if it has none. */
+int64_t sim_link_next_us(const sim_link_t *link);
+
+/** True if the send window holds no frame. */
+bool sim_link_idle(const sim_link_t *link);
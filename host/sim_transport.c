@@ -0,0 +1,269 @@
+/**
+ * sim_transport.c
+ *
+ * Simulated ESP-NOW channel (see sim_transport.h).
+ */
+
+#include <string.h>
+#include "sim_transport.h"
+
+static const uint8_t broadcast_mac[LINK_TRANSPORT_MAC_LEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+static sim_node_t *current_node;    // See sim_node_current()
+
+// xorshift32: fast, and the same sequence on every host for a given seed.
+static uint32_t sim_rng_next(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static bool sim_lost(sim_medium_t *medium)
+{
+    return medium->config.loss > 0.0f &&
+           (float)(sim_rng_next(&medium->rng) >> 8) < medium->config.loss * (float)(1u << 24);
+}
+
+static sim_event_t *sim_event_add(sim_medium_t *medium, sim_event_type_t type, sim_node_t *node, int64_t at_us)
+{
+    for (int i = 0; i < SIM_MAX_EVENTS; i++) {
+        if (!medium->used[i]) {
+            medium->used[i] = true;
+            medium->event_count++;
+            sim_event_t *event = &medium->events[i];
+            event->at_us = at_us;
+            event->order = medium->next_order++;
+            event->type = type;
+            event->node = node;
+            return event;
+        }
+    }
+    return NULL;
+}
+
+static int sim_event_next(const sim_medium_t *medium)
+{
+    int next = -1;
+    for (int i = 0; i < SIM_MAX_EVENTS; i++) {
+        if (!medium->used[i]) {
+            continue;
+        }
+        const sim_event_t *event = &medium->events[i];
+        if (next < 0 || event->at_us < medium->events[next].at_us ||
+            (event->at_us == medium->events[next].at_us &&
+             (int32_t)(event->order - medium->events[next].order) < 0)) {
+            next = i;
+        }
+    }
+    return next;
+}
+
+static int sim_peer_index(const sim_node_t *node, const uint8_t *mac)
+{
+    for (int i = 0; i < node->peer_count; i++) {
+        if (memcmp(node->peers[i], mac, LINK_TRANSPORT_MAC_LEN) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static sim_node_t *sim_node_find(sim_medium_t *medium, const uint8_t *mac)
+{
+    for (int i = 0; i < medium->node_count; i++) {
+        if (memcmp(medium->nodes[i]->mac, mac, LINK_TRANSPORT_MAC_LEN) == 0) {
+            return medium->nodes[i];
+        }
+    }
+    return NULL;
+}
+
+static void sim_deliver(sim_node_t *from, sim_node_t *to, const uint8_t *dest_mac, const uint8_t *data, int len,
+                        int64_t at_us)
+{
+    sim_medium_t *medium = from->medium;
+    sim_event_t *event = sim_event_add(medium, SIM_EVENT_RECV, to, at_us);
+    if (event == NULL) {
+        medium->stats.frames_lost++;  // Medium overloaded, same as a dropped frame
+        return;
+    }
+    memcpy(event->src_mac, from->mac, LINK_TRANSPORT_MAC_LEN);
+    memcpy(event->dest_mac, dest_mac, LINK_TRANSPORT_MAC_LEN);
+    event->len = (uint8_t)len;
+    memcpy(event->data, data, len);
+}
+
+static esp_err_t sim_init(void *ctx, link_transport_sent_cb_t sent_cb, link_transport_recv_cb_t recv_cb)
+{
+    sim_node_t *node = ctx;
+    node->sent_cb = sent_cb;
+    node->recv_cb = recv_cb;
+    return ESP_OK;
+}
+
+static esp_err_t sim_add_peer(void *ctx, const uint8_t *mac)
+{
+    sim_node_t *node = ctx;
+    if (sim_peer_index(node, mac) >= 0) {
+        return ESP_OK;
+    }
+    if (node->peer_count >= SIM_MAX_PEERS) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(node->peers[node->peer_count++], mac, LINK_TRANSPORT_MAC_LEN);
+    return ESP_OK;
+}
+
+static esp_err_t sim_del_peer(void *ctx, const uint8_t *mac)
+{
+    sim_node_t *node = ctx;
+    int index = sim_peer_index(node, mac);
+    if (index < 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    memmove(node->peers[index], node->peers[index + 1], (node->peer_count - index - 1) * LINK_TRANSPORT_MAC_LEN);
+    node->peer_count--;
+    return ESP_OK;
+}
+
+static esp_err_t sim_send(void *ctx, const uint8_t *mac, const uint8_t *data, int len)
+{
+    sim_node_t *node = ctx;
+    sim_medium_t *medium = node->medium;
+    if (len <= 0 || len > LINK_TRANSPORT_MAX_LEN) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (sim_peer_index(node, mac) < 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    int64_t start_us = medium->air_free_at_us > medium->now_us ? medium->air_free_at_us : medium->now_us;
+    int64_t air_us = (int64_t)(len + SIM_FRAME_OVERHEAD) * 8000 / medium->config.bitrate_kbps;
+    int64_t end_us = start_us + air_us;
+    sim_event_t *report = sim_event_add(medium, SIM_EVENT_SENT, node, end_us + medium->config.latency_us);
+    if (report == NULL) {
+        return ESP_ERR_NO_MEM;      // As ESP-NOW does when its TX queue is full
+    }
+    medium->air_free_at_us = end_us;
+    medium->stats.frames++;
+    medium->stats.air_us += air_us;
+    memcpy(report->dest_mac, mac, LINK_TRANSPORT_MAC_LEN);
+
+    int64_t arrive_us = end_us + medium->config.latency_us;
+    if (memcmp(mac, broadcast_mac, LINK_TRANSPORT_MAC_LEN) == 0) {
+        for (int i = 0; i < medium->node_count; i++) {
+            sim_node_t *to = medium->nodes[i];
+            if (to == node) {
+                continue;
+            }
+            if (sim_lost(medium)) {
+                medium->stats.frames_lost++;
+            } else {
+                sim_deliver(node, to, mac, data, len, arrive_us);
+            }
+        }
+        report->delivered = true;   // Broadcasts get no MAC ACK to fail on
+        return ESP_OK;
+    }
+
+    sim_node_t *to = sim_node_find(medium, mac);
+    bool received = to != NULL && !sim_lost(medium);
+    if (received) {
+        sim_deliver(node, to, mac, data, len, arrive_us);
+    } else {
+        medium->stats.frames_lost++;
+    }
+    bool acked = received && !sim_lost(medium);
+    if (received && !acked) {
+        medium->stats.acks_lost++;
+    }
+    report->delivered = acked;
+    return ESP_OK;
+}
+
+void sim_medium_init(sim_medium_t *medium, const sim_medium_config_t *config)
+{
+    memset(medium, 0, sizeof(*medium));
+    medium->config = *config;
+    if (medium->config.bitrate_kbps == 0) {
+        medium->config.bitrate_kbps = 1000;
+    }
+    medium->rng = config->seed != 0 ? config->seed : 1;
+}
+
+bool sim_node_init(sim_node_t *node, sim_medium_t *medium, const uint8_t *mac, link_transport_t *transport)
+{
+    if (medium->node_count >= SIM_MAX_NODES) {
+        return false;
+    }
+    memset(node, 0, sizeof(*node));
+    node->medium = medium;
+    memcpy(node->mac, mac, LINK_TRANSPORT_MAC_LEN);
+    medium->nodes[medium->node_count++] = node;
+
+    transport->init = sim_init;
+    transport->add_peer = sim_add_peer;
+    transport->del_peer = sim_del_peer;
+    transport->send = sim_send;
+    transport->ctx = node;
+    return true;
+}
+
+int64_t sim_medium_now_us(const sim_medium_t *medium)
+{
+    return medium->now_us;
+}
+
+int64_t sim_medium_next_us(const sim_medium_t *medium)
+{
+    int next = sim_event_next(medium);
+    return next >= 0 ? medium->events[next].at_us : INT64_MAX;
+}
+
+bool sim_medium_step(sim_medium_t *medium, int64_t until_us)
+{
+    int next = sim_event_next(medium);
+    if (next < 0 || medium->events[next].at_us > until_us) {
+        if (until_us != INT64_MAX && until_us > medium->now_us) {
+            medium->now_us = until_us;
+        }
+        return false;
+    }
+
+    // Callbacks may schedule new events, so work on a copy.
+    sim_event_t event = medium->events[next];
+    medium->used[next] = false;
+    medium->event_count--;
+    if (event.at_us > medium->now_us) {
+        medium->now_us = event.at_us;
+    }
+    sim_node_t *node = event.node;
+    current_node = node;
+    if (event.type == SIM_EVENT_SENT) {
+        if (node->sent_cb != NULL) {
+            node->sent_cb(event.dest_mac, event.delivered);
+        }
+    } else if (node->recv_cb != NULL) {
+        link_transport_rx_info_t info = {
+            .src_mac = event.src_mac,
+            .dest_mac = event.dest_mac,
+            .rssi = -50,
+        };
+        node->recv_cb(&info, event.data, event.len);
+    }
+    current_node = NULL;
+    return true;
+}
+
+sim_node_t *sim_node_current(void)
+{
+    return current_node;
+}
+
+uint32_t sim_medium_random(sim_medium_t *medium)
+{
+    return sim_rng_next(&medium->rng);
+}
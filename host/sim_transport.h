@@ -0,0 +1,110 @@
+/**
+ * sim_transport.h
+ *
+ * Simulated ESP-NOW channel for host builds. Nodes on one medium exchange
+ * frames through link_transport_t, as the link does with ESP-NOW, but on a
+ * virtual clock. Frames take turns on the air at the configured bit rate, in
+ * the order they were sent, and arrive after a fixed latency. Each copy is
+ * lost with the configured probability, and so is a unicast frame's MAC ACK,
+ * so a sender may see a failure for a frame the peer did receive, as on a
+ * real radio. Runs are repeatable for a given seed. Single-threaded:
+ * callbacks run from sim_medium_step().
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "link_transport.h"
+
+#define SIM_MAX_NODES 4
+#define SIM_MAX_PEERS 20            // Per node, the broadcast address included, as in ESP-NOW
+#define SIM_MAX_EVENTS 256          // Frames and send reports in flight on the medium
+#define SIM_FRAME_OVERHEAD 43       // MAC header, vendor action frame fields and FCS around the payload
+
+typedef struct {
+    float loss;                     // Probability of losing a frame, and separately its MAC ACK
+    uint32_t latency_us;            // From the end of a frame's air time to its delivery
+    uint32_t bitrate_kbps;          // Air rate, 1000 for ESP-NOW's default 802.11b 1 Mbps
+    uint32_t seed;
+} sim_medium_config_t;
+
+#define SIM_MEDIUM_CONFIG_DEFAULT() { .loss = 0.0f, .latency_us = 200, .bitrate_kbps = 1000, .seed = 1 }
+
+typedef struct sim_medium sim_medium_t;
+
+typedef struct {
+    sim_medium_t *medium;
+    uint8_t mac[LINK_TRANSPORT_MAC_LEN];
+    uint8_t peers[SIM_MAX_PEERS][LINK_TRANSPORT_MAC_LEN];
+    int peer_count;
+    link_transport_sent_cb_t sent_cb;
+    link_transport_recv_cb_t recv_cb;
+    void *owner;                    // Free for the user, see sim_node_current()
+} sim_node_t;
+
+typedef enum {
+    SIM_EVENT_RECV,
+    SIM_EVENT_SENT,
+} sim_event_type_t;
+
+typedef struct {
+    int64_t at_us;
+    uint32_t order;                 // Breaks ties in the order events were scheduled
+    sim_event_type_t type;
+    sim_node_t *node;               // Receiver of the frame, or sender for the report
+    uint8_t src_mac[LINK_TRANSPORT_MAC_LEN];
+    uint8_t dest_mac[LINK_TRANSPORT_MAC_LEN];
+    bool delivered;
+    uint8_t len;
+    uint8_t data[LINK_TRANSPORT_MAX_LEN];
+} sim_event_t;
+
+typedef struct {
+    uint32_t frames;                // Frames sent onto the medium
+    uint32_t frames_lost;           // Copies that did not arrive, one per receiver
+    uint32_t acks_lost;
+    uint64_t air_us;                // Air time used by all nodes together
+} sim_medium_stats_t;
+
+struct sim_medium {
+    sim_medium_config_t config;
+    int64_t now_us;
+    int64_t air_free_at_us;         // End of the last frame queued on the channel
+    uint32_t rng;
+    uint32_t next_order;
+    sim_node_t *nodes[SIM_MAX_NODES];
+    int node_count;
+    sim_event_t events[SIM_MAX_EVENTS];
+    bool used[SIM_MAX_EVENTS];
+    int event_count;
+    sim_medium_stats_t stats;
+};
+
+void sim_medium_init(sim_medium_t *medium, const sim_medium_config_t *config);
+
+/**
+ * Puts node on medium with the given MAC and fills transport with the ops that
+ * drive it. Returns false if the medium already has SIM_MAX_NODES nodes.
+ */
+bool sim_node_init(sim_node_t *node, sim_medium_t *medium, const uint8_t *mac, link_transport_t *transport);
+
+int64_t sim_medium_now_us(const sim_medium_t *medium);
+
+/** Time of the next event, or INT64_MAX when the medium is idle. */
+int64_t sim_medium_next_us(const sim_medium_t *medium);
+
+/**
+ * Runs the next event if it is due by until_us, moving the clock to it, and
+ * returns true. Otherwise moves the clock to until_us and returns false.
+ */
+bool sim_medium_step(sim_medium_t *medium, int64_t until_us);
+
+/**
+ * The node whose callback sim_medium_step() is running, NULL outside of one.
+ * Transport callbacks carry no context; this tells nodes sharing them apart.
+ */
+sim_node_t *sim_node_current(void);
+
+/** Uniform random number from the medium's generator, for callers that want the same seed. */
+uint32_t sim_medium_random(sim_medium_t *medium);